@@ -6,41 +6,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-static void print_value(up_value_t *value, int indent);
-
-static void print_indent(int indent) {
-    for (int i = 0; i < indent; i++) {
-        printf("  ");
-    }
-}
-
-static void print_value(up_value_t *value, int indent) {
-    switch (value->type) {
-        case UP_TYPE_STRING:
-            printf("%s\n", value->as.string.data);
-            break;
-        case UP_TYPE_BLOCK:
-            printf("{\n");
-            for (size_t i = 0; i < value->as.block.count; i++) {
-                print_indent(indent + 1);
-                printf("%s: ", value->as.block.keys[i]);
-                print_value(value->as.block.values[i], indent + 1);
-            }
-            print_indent(indent);
-            printf("}\n");
-            break;
-        case UP_TYPE_LIST:
-            printf("[\n");
-            for (size_t i = 0; i < value->as.list.count; i++) {
-                print_indent(indent + 1);
-                print_value(value->as.list.items[i], indent + 1);
-            }
-            print_indent(indent);
-            printf("]\n");
-            break;
-    }
-}
-
 int main(void) {
     const char *up_text =
         "name John Doe\n"
@@ -69,16 +34,13 @@ int main(void) {
 
     printf("Parsed %zu top-level nodes:\n\n", doc->count);
 
-    for (size_t i = 0; i < doc->count; i++) {
-        up_node_t *node = doc->nodes[i];
-        printf("%s", node->key);
-        if (node->type_annotation) {
-            printf("!%s", node->type_annotation);
-        }
-        printf(": ");
-        print_value(node->value, 0);
-        printf("\n");
+    up_sink_t sink = {up_sink_file, stdout};
+    if (!up_document_write(doc, sink)) {
+        fprintf(stderr, "Write error: %s\n", up_get_error());
+        up_document_free(doc);
+        return 1;
     }
+    printf("\n");
 
     /* Test lookup */
     up_node_t *name_node = up_document_get(doc, "name");
@@ -0,0 +1,69 @@
+/**
+ * Minimal test harness shared by the tests/test_*.c programs
+ *
+ * Each test file is its own executable: it runs its cases with RUN and
+ * returns test_report() from main, so `make test` stops at the first
+ * file with a failing check and any single file can be run on its own.
+ */
+
+#ifndef UP_TEST_H
+#define UP_TEST_H
+
+#include "up.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int test_failures;
+static int test_cases;
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                     \
+        }                                                                        \
+    } while (0)
+
+#define CHECK_STR(actual, expected)                                              \
+    do {                                                                         \
+        const char *check_a = (actual);                                          \
+        const char *check_e = (expected);                                        \
+        if (!check_a || strcmp(check_a, check_e) != 0) {                         \
+            fprintf(stderr, "%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__,  \
+                    __LINE__, #actual, check_a ? check_a : "(null)", check_e);   \
+            test_failures++;                                                     \
+        }                                                                        \
+    } while (0)
+
+#define RUN(test)                                                                \
+    do {                                                                         \
+        int failures_before = test_failures;                                     \
+        test();                                                                  \
+        test_cases++;                                                            \
+        printf("  %s %s\n", test_failures == failures_before ? "ok  " : "FAIL", #test); \
+    } while (0)
+
+static inline int test_report(const char *file) {
+    printf("%s: %d cases, %d failed checks\n", file, test_cases, test_failures);
+    up_pool_trim();
+    return test_failures ? 1 : 0;
+}
+
+// Parse `text` and fail the current case if that does not work
+static inline up_document_t *test_parse(const char *text) {
+    up_document_t *doc = up_parse_string(text);
+    if (!doc) {
+        fprintf(stderr, "parse failed: %s\n", up_get_error());
+        test_failures++;
+    }
+    return doc;
+}
+
+// String value at `key` of a document, or NULL
+static inline const char *test_string(up_document_t *doc, const char *key) {
+    up_node_t *node = up_document_get(doc, key);
+    return node && node->value->type == UP_TYPE_STRING ? node->value->as.string.data : NULL;
+}
+
+#endif // UP_TEST_H
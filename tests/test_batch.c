@@ -0,0 +1,110 @@
+/**
+ * Batch lookup tests: up_document_get_many and up_block_get_many must
+ * agree with one-at-a-time lookups on every path they take
+ */
+
+#include "test.h"
+
+// "k0 v0\nk1 v1\n..." as a document, or inside "b {...}" when `nested`
+static up_document_t *numbered(size_t count, bool nested) {
+    size_t size = count * 32 + 16;
+    char *text = malloc(size);
+    if (!text) {
+        CHECK(!"out of memory");
+        return NULL;
+    }
+    size_t used = nested ? (size_t)snprintf(text, size, "b {\n") : 0;
+    for (size_t i = 0; i < count; i++) {
+        used += (size_t)snprintf(text + used, size - used, "k%zu v%zu\n", i, i);
+    }
+    if (nested) {
+        snprintf(text + used, size - used, "}\n");
+    }
+    up_document_t *doc = test_parse(text);
+    free(text);
+    return doc;
+}
+
+// Present keys, absent keys, a repeated key and a NULL entry
+static const char *const REQUEST[] = {"k3", "absent", "k0", NULL, "k3", "k2", "k7", "k1x"};
+#define REQUEST_COUNT (sizeof(REQUEST) / sizeof(REQUEST[0]))
+
+static void test_document_batches(void) {
+    size_t sizes[] = {5, 40};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        up_document_t *doc = numbered(sizes[s], false);
+        if (!doc) {
+            return;
+        }
+        up_node_t *out[REQUEST_COUNT];
+        size_t expected = 0;
+        for (size_t i = 0; i < REQUEST_COUNT; i++) {
+            expected += REQUEST[i] && up_document_get(doc, REQUEST[i]);
+        }
+        CHECK(up_document_get_many(doc, REQUEST, REQUEST_COUNT, out) == expected);
+        for (size_t i = 0; i < REQUEST_COUNT; i++) {
+            CHECK(out[i] == (REQUEST[i] ? up_document_get(doc, REQUEST[i]) : NULL));
+        }
+        CHECK(out[0] && out[0] == out[4]);
+
+        // Single keys, nothing at all, and bad arguments
+        CHECK(up_document_get_many(doc, REQUEST, 1, out) == 1 && out[0] == up_document_get(doc, "k3"));
+        CHECK(up_document_get_many(doc, REQUEST, 0, out) == 0);
+        CHECK(up_document_get_many(NULL, REQUEST, 1, out) == 0);
+        CHECK(up_document_get_many(doc, NULL, 1, out) == 0);
+        up_document_free(doc);
+    }
+}
+
+static void test_block_batches(void) {
+    // Hash-prefix scan, indexed, and sorted blocks
+    size_t sizes[] = {5, 100, 100};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        up_document_t *doc = numbered(sizes[s], true);
+        if (!doc) {
+            return;
+        }
+        up_block_t *block = &up_document_get(doc, "b")->value->as.block;
+        if (s == 2) {
+            CHECK(up_block_sort(block));
+        }
+        up_value_t *out[REQUEST_COUNT];
+        CHECK(up_block_get_many(block, REQUEST, REQUEST_COUNT, out) == (sizes[s] > 7 ? 5 : 4));
+        for (size_t i = 0; i < REQUEST_COUNT; i++) {
+            CHECK(out[i] == (REQUEST[i] ? up_block_get(block, REQUEST[i]) : NULL));
+        }
+        CHECK_STR(out[2] ? out[2]->as.string.data : NULL, "v0");
+        CHECK(out[1] == NULL && out[3] == NULL && out[7] == NULL);
+        CHECK(up_block_get_many(NULL, REQUEST, REQUEST_COUNT, out) == 0);
+        up_document_free(doc);
+    }
+}
+
+// Many requested keys against a larger block grow the request table
+static void test_large_requests(void) {
+    up_document_t *doc = numbered(20, true);
+    if (!doc) {
+        return;
+    }
+    up_block_t *block = &up_document_get(doc, "b")->value->as.block;
+    enum { N = 60 };
+    char names[N][16];
+    const char *keys[N];
+    up_value_t *out[N];
+    for (size_t i = 0; i < N; i++) {
+        snprintf(names[i], sizeof(names[i]), "k%zu", i);
+        keys[i] = names[i];
+    }
+    CHECK(up_block_get_many(block, keys, N, out) == 20);
+    for (size_t i = 0; i < N; i++) {
+        CHECK((out[i] != NULL) == (i < 20));
+    }
+    up_document_free(doc);
+}
+
+int main(void) {
+    RUN(test_document_batches);
+    RUN(test_block_batches);
+    RUN(test_large_requests);
+    return test_report(__FILE__);
+}
@@ -0,0 +1,213 @@
+/**
+ * Binary document tests: reads through a saved image, and hostile images
+ * whose records overrun the file or lose their terminators
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "test.h"
+#include "up_internal.h"
+#include <unistd.h>
+
+static const char *BINARY_INPUT =
+    "name app\nport!int 8080\nratio!float 0.5\non!bool true\n"
+    "server {\n  host localhost\n}\nitems [a, b]\n";
+
+// A writable heap copy of the image built from `text`, so tests can damage
+// it; up_binary_close frees it like any built image
+static up_binary_t *build_copy(const char *text, size_t *size) {
+    up_document_t *doc = test_parse(text);
+    if (!doc) {
+        return NULL;
+    }
+    const up_binary_t *built = up_binary_build(doc, 0);
+    up_document_free(doc);
+    CHECK(built != NULL);
+    if (!built) {
+        return NULL;
+    }
+    uint32_t length;
+    memcpy(&length, (const char *)built + 12, sizeof(length));
+    up_binary_t *copy = malloc(length);
+    if (copy) {
+        memcpy(copy, built, length);
+        *size = length;
+    }
+    up_binary_close(built);
+    return copy;
+}
+
+static void put_u32(void *image, uint32_t offset, uint32_t value) {
+    memcpy((char *)image + offset, &value, sizeof(value));
+}
+
+static void test_reads(void) {
+    size_t size;
+    up_binary_t *image = build_copy(BINARY_INPUT, &size);
+    if (!image) {
+        return;
+    }
+    up_value_type_t type;
+    size_t length = 0;
+    CHECK_STR(up_bvalue_string(up_binary_get(image, "name"), &length), "app");
+    CHECK(length == 3);
+    int64_t port = 0;
+    double ratio = 0;
+    bool on = false;
+    CHECK(up_bvalue_int(up_binary_get(image, "port"), &port) && port == 8080);
+    CHECK(up_bvalue_float(up_binary_get(image, "ratio"), &ratio) && ratio == 0.5);
+    CHECK(up_bvalue_bool(up_binary_get(image, "on"), &on) && on);
+    CHECK(!up_bvalue_int(up_binary_get(image, "name"), &port));
+
+    up_bvalue_t server = up_binary_get(image, "server");
+    CHECK(up_bvalue_type(server, &type) && type == UP_TYPE_BLOCK);
+    CHECK_STR(up_bvalue_string(up_bvalue_get(server, "host"), NULL), "localhost");
+    up_bvalue_t items = up_binary_get(image, "items");
+    CHECK(up_bvalue_type(items, &type) && type == UP_TYPE_LIST);
+    CHECK(up_bvalue_count(items) == 2);
+    CHECK_STR(up_bvalue_string(up_bvalue_at(items, 1), NULL), "b");
+    CHECK(up_bvalue_at(items, 2).offset == 0);
+
+    up_bvalue_t root = up_binary_root(image);
+    CHECK(up_bvalue_count(root) == 6);
+    CHECK_STR(up_bvalue_key_at(root, 1), "port");
+    CHECK_STR(up_bvalue_type_at(root, 1), "int");
+    CHECK(up_bvalue_type_at(root, 0) == NULL);
+
+    // A missing value has no type, rather than reading as a string
+    up_bvalue_t missing = up_binary_get(image, "nothing");
+    CHECK(missing.offset == 0 && !up_bvalue_type(missing, &type));
+    CHECK(up_bvalue_string(missing, NULL) == NULL);
+    CHECK(up_bvalue_count(missing) == 0);
+    up_binary_close(image);
+}
+
+// Strings and names that overrun the image or lose their NUL read as missing
+static void test_hostile_records(void) {
+    size_t size;
+    up_binary_t *image = build_copy(BINARY_INPUT, &size);
+    if (!image) {
+        return;
+    }
+    up_value_type_t type;
+    uint32_t name = up_binary_get(image, "name").offset;
+    up_bvalue_t value = {image, name};
+
+    put_u32(image, name + 4, 0xfffffff0u);
+    CHECK(up_bvalue_string(value, NULL) == NULL && !up_bvalue_type(value, &type));
+    put_u32(image, name + 4, (uint32_t)size);
+    CHECK(up_bvalue_string(value, NULL) == NULL);
+    put_u32(image, name + 4, 2);
+    CHECK(up_bvalue_string(value, NULL) == NULL);
+    put_u32(image, name + 4, 3);
+    ((char *)image)[name + 8 + 3] = 'x';
+    CHECK(up_bvalue_string(value, NULL) == NULL);
+    ((char *)image)[name + 8 + 3] = '\0';
+    CHECK_STR(up_bvalue_string(value, NULL), "app");
+
+    // Unknown tags and scalar kinds
+    put_u32(image, name, 7);
+    CHECK(!up_bvalue_type(value, &type) && up_bvalue_string(value, NULL) == NULL);
+    put_u32(image, name, UP_TYPE_STRING | (9u << 8));
+    CHECK(!up_bvalue_type(value, &type));
+    put_u32(image, name, UP_TYPE_STRING);
+
+    // A key whose terminator is gone can be neither listed nor found
+    up_bvalue_t root = up_binary_root(image);
+    const char *key = up_bvalue_key_at(root, 1);
+    CHECK_STR(key, "port");
+    if (key) {
+        uint32_t text = (uint32_t)(key - (const char *)image);
+        ((char *)image)[text + 4] = '!';
+        CHECK(up_bvalue_key_at(root, 1) == NULL);
+        CHECK(up_binary_get(image, "port").offset == 0);
+        put_u32(image, text - 4, 0xffffffffu);
+        CHECK(up_bvalue_key_at(root, 1) == NULL);
+    }
+
+    // Counts larger than the image: reads stop at its end
+    uint32_t items = up_binary_get(image, "items").offset;
+    put_u32(image, items + 4, 0x7fffffffu);
+    up_bvalue_t list = {image, items};
+    CHECK(up_bvalue_at(list, 0x3fffffffu).offset == 0);
+    CHECK(up_bvalue_at(list, 0x40000002u).offset == 0);
+    put_u32(image, root.offset + 4, 0xffffffffu);
+    CHECK(up_binary_get(image, "missing").offset == 0);
+    CHECK(up_bvalue_key_at(root, 0x20000000u) == NULL);
+    CHECK(up_bvalue_at(root, 0x15555556u).offset == 0);
+    up_binary_close(image);
+}
+
+// Write `length` bytes of `data` to `path` and try to open the result
+static const up_binary_t *open_bytes(const char *path, const void *data, size_t length) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        CHECK(!"cannot write the scratch file");
+        return NULL;
+    }
+    fwrite(data, 1, length, file);
+    fclose(file);
+    return up_document_open_binary(path);
+}
+
+static void test_hostile_files(void) {
+    size_t size;
+    up_binary_t *image = build_copy(BINARY_INPUT, &size);
+    if (!image) {
+        return;
+    }
+    char dir[] = "/tmp/up-binary-XXXXXX";
+    if (!mkdtemp(dir)) {
+        CHECK(!"cannot create a scratch directory");
+        up_binary_close(image);
+        return;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/doc.upb", dir);
+
+    // The image as built opens (flags, at byte 20, are 0 on disk)
+    put_u32(image, 20, 0);
+    const up_binary_t *opened = open_bytes(path, image, size);
+    CHECK(opened != NULL);
+    CHECK_STR(up_bvalue_string(up_binary_get(opened, "name"), NULL), "app");
+    up_binary_close(opened);
+
+    // Truncated, padded, or with a damaged header
+    CHECK(open_bytes(path, image, size - 4) == NULL && up_last_error()->code == UP_ERROR_FORMAT);
+    CHECK(open_bytes(path, image, 16) == NULL);
+    char *padded = calloc(1, size + 8);
+    if (padded) {
+        memcpy(padded, image, size);
+        CHECK(open_bytes(path, padded, size + 8) == NULL);
+        free(padded);
+    }
+    char *bad = malloc(size);
+    if (bad) {
+        uint32_t fields[][2] = {{0, 0x21425055u}, {4, 99}, {8, 0x04030201u}, {16, 0},
+                                {16, (uint32_t)size}, {20, 1}};
+        for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+            memcpy(bad, image, size);
+            put_u32(bad, fields[i][0], fields[i][1]);
+            CHECK(open_bytes(path, bad, size) == NULL);
+        }
+        // A root that is not a block
+        memcpy(bad, image, size);
+        put_u32(bad, 16, up_binary_get(image, "name").offset);
+        CHECK(open_bytes(path, bad, size) == NULL);
+        free(bad);
+    }
+    CHECK(up_document_open_binary("/nonexistent/doc.upb") == NULL);
+    CHECK(up_last_error()->code == UP_ERROR_IO);
+
+    unlink(path);
+    rmdir(dir);
+    put_u32(image, 20, 1);
+    up_binary_close(image);
+}
+
+int main(void) {
+    RUN(test_reads);
+    RUN(test_hostile_records);
+    RUN(test_hostile_files);
+    return test_report(__FILE__);
+}
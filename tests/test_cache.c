@@ -0,0 +1,145 @@
+/**
+ * Compiled cache tests: sidecar and cache directory entries, rebuilds on
+ * edited text, and images the trust model refuses
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "test.h"
+#include "up_internal.h"
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char scratch[] = "/tmp/up-cache-XXXXXX";
+
+static void write_text(const char *path, const char *text) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        CHECK(!"cannot write the scratch file");
+        return;
+    }
+    fputs(text, file);
+    fclose(file);
+}
+
+// The cache directory entry up_load_cached uses for `text`
+static void entry_for(const char *cache_dir, const char *text, char *out, size_t size) {
+    uint64_t hash = up_hash_bytes(text, strlen(text), UP_BINARY_VERSION) | 1;
+    snprintf(out, size, "%s/%016llx.v%d.upb", cache_dir, (unsigned long long)hash,
+             UP_BINARY_VERSION);
+}
+
+// The "name" value of a cached load of `path`, copied to `out`
+static const char *load_name(const char *path, const up_cache_options_t *opts, char *out,
+                             size_t size) {
+    const up_binary_t *binary = up_load_cached(path, opts);
+    CHECK(binary != NULL);
+    const char *name = binary ? up_bvalue_string(up_binary_get(binary, "name"), NULL) : NULL;
+    snprintf(out, size, "%s", name ? name : "(none)");
+    up_binary_close(binary);
+    return out;
+}
+
+static mode_t mode_of(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_mode & 0777 : 0;
+}
+
+static void test_sidecar(void) {
+    char path[128], sidecar[140], out[64];
+    snprintf(path, sizeof(path), "%s/app.up", scratch);
+    snprintf(sidecar, sizeof(sidecar), "%s.upb", path);
+    write_text(path, "name first\n");
+    CHECK_STR(load_name(path, NULL, out, sizeof(out)), "first");
+    CHECK(access(sidecar, F_OK) == 0);
+    CHECK((mode_of(sidecar) & 022) == 0);
+    CHECK_STR(load_name(path, NULL, out, sizeof(out)), "first");
+
+    // An edit misses and replaces the sidecar
+    write_text(path, "name second\n");
+    CHECK_STR(load_name(path, NULL, out, sizeof(out)), "second");
+    const up_binary_t *binary = up_document_open_binary(sidecar);
+    CHECK_STR(binary ? up_bvalue_string(up_binary_get(binary, "name"), NULL) : NULL, "second");
+    up_binary_close(binary);
+    unlink(sidecar);
+    unlink(path);
+}
+
+static void test_cache_dir(void) {
+    char path[128], dir[128], entry[192], out[64];
+    snprintf(path, sizeof(path), "%s/app.up", scratch);
+    snprintf(dir, sizeof(dir), "%s/cache", scratch);
+    const char *text = "name cached\n";
+    write_text(path, text);
+    up_cache_options_t opts = {dir};
+    CHECK_STR(load_name(path, &opts, out, sizeof(out)), "cached");
+    CHECK(mode_of(dir) == 0700);
+    entry_for(dir, text, entry, sizeof(entry));
+    CHECK(access(entry, F_OK) == 0);
+    CHECK((mode_of(entry) & 022) == 0);
+    CHECK_STR(load_name(path, &opts, out, sizeof(out)), "cached");
+    unlink(entry);
+    rmdir(dir);
+    unlink(path);
+}
+
+// An image planted under the right name is only used when the loading
+// user owns it and nobody else can write it
+static void test_planted_images(void) {
+    char path[128], entry[192], out[64];
+    snprintf(path, sizeof(path), "%s/app.up", scratch);
+    const char *text = "name real\n";
+    write_text(path, text);
+    entry_for(scratch, text, entry, sizeof(entry));
+    up_cache_options_t opts = {scratch};
+
+    up_document_t *evil = test_parse("name injected\n");
+    if (!evil) {
+        return;
+    }
+    uint64_t hash = up_hash_bytes(text, strlen(text), UP_BINARY_VERSION) | 1;
+
+    // Writable by others: ignored, recompiled and replaced
+    CHECK(up_binary_save(evil, entry, hash));
+    CHECK(chmod(entry, 0666) == 0);
+    CHECK(up_binary_open(entry, true) == NULL && up_last_error()->code == UP_ERROR_IO);
+    CHECK_STR(load_name(path, &opts, out, sizeof(out)), "real");
+    CHECK((mode_of(entry) & 022) == 0);
+    const up_binary_t *binary = up_document_open_binary(entry);
+    CHECK_STR(binary ? up_bvalue_string(up_binary_get(binary, "name"), NULL) : NULL, "real");
+    up_binary_close(binary);
+
+    CHECK(up_binary_save(evil, entry, hash));
+    CHECK(chmod(entry, 0620) == 0);
+    CHECK_STR(load_name(path, &opts, out, sizeof(out)), "real");
+
+    // Owned by another user; only root can set that up
+    CHECK(up_binary_save(evil, entry, hash));
+    if (geteuid() == 0 && chown(entry, 65534, 65534) == 0) {
+        CHECK(up_binary_open(entry, true) == NULL);
+        CHECK_STR(load_name(path, &opts, out, sizeof(out)), "real");
+    }
+
+    // Plain opens keep no such rule
+    CHECK(up_binary_save(evil, entry, hash));
+    CHECK(chmod(entry, 0666) == 0);
+    binary = up_document_open_binary(entry);
+    CHECK(binary != NULL);
+    up_binary_close(binary);
+
+    up_document_free(evil);
+    unlink(entry);
+    unlink(path);
+}
+
+int main(void) {
+    if (!mkdtemp(scratch)) {
+        fprintf(stderr, "cannot create a scratch directory\n");
+        return 1;
+    }
+    RUN(test_sidecar);
+    RUN(test_cache_dir);
+    RUN(test_planted_images);
+    rmdir(scratch);
+    return test_report(__FILE__);
+}
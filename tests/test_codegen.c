@@ -0,0 +1,133 @@
+/**
+ * up-codegen tests: accessors generated from tests/schema.up, and schemas
+ * the generator must refuse
+ *
+ * Run from the repository root, like `make test` does: the rejection
+ * cases invoke ./up-codegen in a scratch directory.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "test.h"
+#include "schema_cfg.h"
+#include <unistd.h>
+
+static const char *CONFIG =
+    "name demo\nport!int 8080\ndebug true\nratio 0.5\ntags [a, b]\nextra {\n  x 1\n}\n"
+    "server {\n  host example.org\n  max-conns 64\n  tls {\n    on false\n  }\n  other 1\n}\n"
+    "unknown 1\n";
+
+static void test_bound_accessors(void) {
+    up_document_t *doc = test_parse(CONFIG);
+    if (!doc) {
+        return;
+    }
+    schema_cfg_t cfg;
+    schema_cfg_bind(&cfg, doc);
+
+    long port = 0, conns = 0;
+    bool debug = false, on = true;
+    double ratio = 0;
+    CHECK_STR(schema_cfg_name(&cfg), "demo");
+    CHECK(schema_cfg_port(&cfg, &port) && port == 8080);
+    CHECK(schema_cfg_debug(&cfg, &debug) && debug);
+    CHECK(schema_cfg_ratio(&cfg, &ratio) && ratio == 0.5);
+    CHECK(schema_cfg_tags(&cfg) && schema_cfg_tags(&cfg)->as.list.count == 2);
+    CHECK(schema_cfg_extra(&cfg) && schema_cfg_extra(&cfg)->type == UP_TYPE_BLOCK);
+    CHECK(schema_cfg_server(&cfg) == up_document_get(doc, "server")->value);
+    CHECK_STR(schema_cfg_server_host(&cfg), "example.org");
+    CHECK(schema_cfg_server_max_conns(&cfg, &conns) && conns == 64);
+    CHECK(schema_cfg_server_tls_on(&cfg, &on) && !on);
+
+    // Absent keys leave their slots empty
+    CHECK(schema_cfg_server_tls_cert(&cfg) == NULL);
+    CHECK(schema_cfg_server_empty(&cfg) == NULL);
+    up_document_free(doc);
+}
+
+static void test_malformed_scalars(void) {
+    up_document_t *doc = test_parse("port 80x\ndebug yes\nratio\nname {\n  a 1\n}\n");
+    if (!doc) {
+        return;
+    }
+    schema_cfg_t cfg;
+    schema_cfg_bind(&cfg, doc);
+    long port;
+    bool debug;
+    double ratio;
+    CHECK(!schema_cfg_port(&cfg, &port));
+    CHECK(!schema_cfg_debug(&cfg, &debug));
+    CHECK(!schema_cfg_ratio(&cfg, &ratio));
+    CHECK(schema_cfg_name(&cfg) == NULL);
+    up_document_free(doc);
+
+    // Out of range numbers fail instead of clamping, and leave *out alone
+    doc = test_parse("port 99999999999999999999999\nratio 1e999\n");
+    if (!doc) {
+        return;
+    }
+    schema_cfg_bind(&cfg, doc);
+    port = 7;
+    ratio = 7;
+    CHECK(!schema_cfg_port(&cfg, &port) && port == 7);
+    CHECK(!schema_cfg_ratio(&cfg, &ratio) && ratio == 7);
+
+    schema_cfg_bind(&cfg, NULL);
+    CHECK(schema_cfg_server(&cfg) == NULL);
+    up_document_free(doc);
+}
+
+// Run up-codegen on `schema` in a scratch directory; returns its exit status
+static int run_codegen(const char *schema) {
+    char dir[] = "/tmp/up-codegen-XXXXXX";
+    char cwd[4096], path[4200], command[8600];
+    if (!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd))) {
+        CHECK(!"cannot create a scratch directory");
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "%s/schema.up", dir);
+    FILE *file = fopen(path, "w");
+    if (file) {
+        fputs(schema, file);
+        fclose(file);
+    }
+    snprintf(command, sizeof(command), "cd %s && %s/up-codegen schema.up gen 2>/dev/null", dir, cwd);
+    int status = system(command);
+
+    // Nothing is written for a rejected schema
+    snprintf(path, sizeof(path), "%s/gen.c", dir);
+    bool wrote = access(path, F_OK) == 0;
+    if (status != 0) {
+        CHECK(!wrote);
+    }
+    snprintf(command, sizeof(command), "rm -rf %s", dir);
+    if (system(command) != 0) {
+        fprintf(stderr, "could not remove %s\n", dir);
+    }
+    return status;
+}
+
+static void test_rejected_schemas(void) {
+    const char *bad[] = {
+        "server_tls string\nserver {\n  tls string\n}\n",  // Same accessor name
+        "a-b string\na_b int\n",
+        "bind string\n",                                    // Clashes with schema_cfg_bind
+        "keys_0 string\n",
+        "name text\n",                                      // Unknown type
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        int status = run_codegen(bad[i]);
+        if (status == 0) {
+            fprintf(stderr, "accepted schema %zu\n", i);
+        }
+        CHECK(status != 0);
+    }
+    CHECK(run_codegen("a-b string\nkeys_x string\nbinding int\n") == 0);
+}
+
+int main(void) {
+    RUN(test_bound_accessors);
+    RUN(test_malformed_scalars);
+    RUN(test_rejected_schemas);
+    return test_report(__FILE__);
+}
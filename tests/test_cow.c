@@ -0,0 +1,134 @@
+/**
+ * Copy-on-write tests: clones share subtrees, mutation copies only the
+ * path it touches, and either side can be freed first
+ */
+
+#include "test.h"
+
+static const char *COW_INPUT =
+    "name app\n"
+    "server {\n  host localhost\n  tls {\n    on true\n  }\n}\n"
+    "items [a, b]\n";
+
+static up_value_t *block_at(up_value_t *block, const char *key) {
+    return up_block_get(&block->as.block, key);
+}
+
+static void test_clone_shares_nodes(void) {
+    up_document_t *doc = test_parse(COW_INPUT);
+    if (!doc) {
+        return;
+    }
+    up_document_t *clone = up_document_clone(doc);
+    CHECK(clone && clone->count == doc->count);
+    for (size_t i = 0; clone && i < doc->count; i++) {
+        CHECK(clone->nodes[i] == doc->nodes[i]);
+        CHECK(doc->nodes[i]->refs == 1);
+    }
+
+    // A clone of a clone adds another owner to the same nodes
+    up_document_t *second = up_document_clone(clone);
+    CHECK(second && second->nodes[0] == doc->nodes[0] && doc->nodes[0]->refs == 2);
+
+    up_document_free(clone);
+    CHECK(doc->nodes[0]->refs == 1);
+    up_document_free(doc);
+    CHECK(second->nodes[0]->refs == 0);
+    CHECK_STR(test_string(second, "name"), "app");
+    up_document_free(second);
+}
+
+static void test_mutating_clone_leaves_original(void) {
+    up_document_t *doc = test_parse(COW_INPUT);
+    if (!doc) {
+        return;
+    }
+    up_value_t *server = up_document_get(doc, "server")->value;
+    up_value_t *tls = block_at(server, "tls");
+    up_document_t *clone = up_document_clone(doc);
+
+    up_value_t *mine = up_document_mutable(clone, "server");
+    CHECK(mine && mine != server && mine->type == UP_TYPE_BLOCK);
+    if (!mine) {
+        up_document_free(clone);
+        up_document_free(doc);
+        return;
+    }
+    up_block_set(&mine->as.block, "host", up_value_new_string("example.org"));
+    up_block_set(&mine->as.block, "port", up_value_new_string("443"));
+
+    CHECK_STR(block_at(server, "host")->as.string.data, "localhost");
+    CHECK(block_at(server, "port") == NULL);
+    CHECK_STR(block_at(mine, "host")->as.string.data, "example.org");
+    CHECK_STR(block_at(mine, "port")->as.string.data, "443");
+
+    // Untouched children stay shared, as do the untouched top-level nodes
+    CHECK(block_at(mine, "tls") == tls && tls->refs == 1);
+    CHECK(up_document_get(clone, "name") == up_document_get(doc, "name"));
+    CHECK(up_document_get(clone, "server") != up_document_get(doc, "server"));
+
+    // A second call finds the value already private
+    CHECK(up_document_mutable(clone, "server") == mine);
+    CHECK(up_document_mutable(clone, "missing") == NULL);
+
+    up_document_free(doc);
+    CHECK(tls->refs == 0);
+    CHECK_STR(block_at(mine, "host")->as.string.data, "example.org");
+    up_document_free(clone);
+}
+
+static void test_nested_mutation(void) {
+    up_document_t *doc = test_parse(COW_INPUT);
+    if (!doc) {
+        return;
+    }
+    up_document_t *clone = up_document_clone(doc);
+    up_value_t *server = up_document_mutable(clone, "server");
+    up_value_t *tls = server ? up_block_mutable(&server->as.block, "tls") : NULL;
+    CHECK(tls != NULL);
+    if (tls) {
+        up_block_set(&tls->as.block, "on", up_value_new_string("false"));
+    }
+
+    up_value_t *original = block_at(up_document_get(doc, "server")->value, "tls");
+    CHECK(original != tls);
+    CHECK_STR(block_at(original, "on")->as.string.data, "true");
+    CHECK_STR(tls ? block_at(tls, "on")->as.string.data : NULL, "false");
+
+    // Lists are unshared the same way
+    up_value_t *items = up_document_mutable(clone, "items");
+    CHECK(items && items->type == UP_TYPE_LIST);
+    if (items) {
+        up_list_append(&items->as.list, up_value_new_string("c"));
+    }
+    CHECK(up_document_get(doc, "items")->value->as.list.count == 2);
+    CHECK(items && items->as.list.count == 3);
+
+    up_document_free(clone);
+    CHECK_STR(block_at(original, "on")->as.string.data, "true");
+    up_document_free(doc);
+}
+
+static void test_retained_values(void) {
+    up_document_t *doc = test_parse(COW_INPUT);
+    if (!doc) {
+        return;
+    }
+    up_value_t *server = up_value_retain(up_document_get(doc, "server")->value);
+    CHECK(server->refs == 1);
+    up_document_free(doc);
+    CHECK(server->refs == 0);
+    CHECK_STR(block_at(server, "host")->as.string.data, "localhost");
+    up_value_free(server);
+
+    CHECK(up_value_retain(NULL) == NULL);
+    CHECK(up_document_clone(NULL) == NULL);
+}
+
+int main(void) {
+    RUN(test_clone_shares_nodes);
+    RUN(test_mutating_clone_leaves_original);
+    RUN(test_nested_mutation);
+    RUN(test_retained_values);
+    return test_report(__FILE__);
+}
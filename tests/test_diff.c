@@ -0,0 +1,157 @@
+/**
+ * Structural diff tests: the exact paths and kinds reported for scalar,
+ * block, list and annotation changes, key matching in large and
+ * reordered containers, and shortcuts through shared or frozen subtrees
+ */
+
+#include "test.h"
+
+// Every reported change as "+path", "-path" or "~path", joined with ','
+typedef struct {
+    char text[4096];
+    size_t calls;
+} changes_t;
+
+static void record(up_diff_kind_t kind, const char *path, const up_value_t *old_value,
+                   const up_value_t *new_value, void *context) {
+    changes_t *c = context;
+    size_t used = strlen(c->text);
+    char sign = kind == UP_DIFF_ADDED ? '+' : kind == UP_DIFF_REMOVED ? '-' : '~';
+    snprintf(c->text + used, sizeof(c->text) - used, "%s%c%s", used ? "," : "", sign, path);
+    c->calls++;
+
+    // The missing side is NULL, and only that one
+    if ((kind == UP_DIFF_ADDED) != (old_value == NULL) ||
+        (kind == UP_DIFF_REMOVED) != (new_value == NULL)) {
+        fprintf(stderr, "wrong sides for %s\n", path);
+        test_failures++;
+    }
+}
+
+// Changes from `a` to `b` parsed as text, optionally frozen first
+static const char *diff_text(const char *a, const char *b, bool freeze, changes_t *c) {
+    c->text[0] = '\0';
+    c->calls = 0;
+    up_document_t *da = test_parse(a);
+    up_document_t *db = test_parse(b);
+    if (da && db) {
+        if (freeze) {
+            up_document_freeze(da);
+            up_document_freeze(db);
+        }
+        CHECK(up_diff(da, db, record, c));
+    }
+    up_document_free(da);
+    up_document_free(db);
+    return c->text;
+}
+
+static const char *DIFF_BASE =
+    "name app\n"
+    "port!int 80\n"
+    "server {\n  host a\n  tls {\n    on true\n    cert x.pem\n  }\n}\n"
+    "items [a, b, c]\n"
+    "rows {\n  [1, 2]\n  [3, 4]\n}\n";
+
+static void test_paths(void) {
+    changes_t c;
+    for (int freeze = 0; freeze < 2; freeze++) {
+        CHECK_STR(diff_text(DIFF_BASE, DIFF_BASE, freeze, &c), "");
+        CHECK_STR(diff_text(DIFF_BASE,
+                            "name app2\nport!int 80\n"
+                            "server {\n  host a\n  tls {\n    on false\n    cert x.pem\n  }\n}\n"
+                            "items [a, B, c]\nrows {\n  [1, 2]\n  [3, 5]\n}\n",
+                            freeze, &c),
+                  "~name,~server.tls.on,~items[1],~rows[1][1]");
+
+        // In each block: removed and changed keys in old order, then added
+        // keys in new order
+        CHECK_STR(diff_text(DIFF_BASE,
+                            "extra 1\nport!int 80\n"
+                            "server {\n  host b\n  tls {\n    on true\n  }\n"
+                            "  new {\n    k v\n  }\n}\n"
+                            "items [a, b]\nrows {\n  [1, 2]\n  [3, 4]\n}\nlast 2\n",
+                            freeze, &c),
+                  "-name,~server.host,-server.tls.cert,+server.new,-items[2],+extra,+last");
+        CHECK_STR(diff_text("items [a]\n", "items [a, b, c]\n", freeze, &c), "+items[1],+items[2]");
+    }
+}
+
+// A changed annotation or kind of value is one change at its key
+static void test_reported_once(void) {
+    changes_t c;
+    CHECK_STR(diff_text("port!int 80\n", "port!float 80\n", false, &c), "~port");
+    CHECK_STR(diff_text("port 80\n", "port!int 80\n", false, &c), "~port");
+    CHECK_STR(diff_text("b!x {\n  k 1\n}\n", "b!y {\n  k 2\n}\n", false, &c), "~b");
+    CHECK_STR(diff_text("v {\n  k 1\n}\n", "v [k, 1]\n", false, &c), "~v");
+    CHECK_STR(diff_text("v text\n", "v {\n  k 1\n}\n", false, &c), "~v");
+    CHECK_STR(diff_text("l [[a, b]]\n", "l [a]\n", false, &c), "~l[0]");
+    CHECK(c.calls == 1);
+}
+
+// Reordered keys match by name, through the owner's index, a scratch
+// index, or a scan, depending on size
+static void test_reordered(void) {
+    changes_t c;
+    CHECK_STR(diff_text("a 1\nb 2\nc 3\n", "c 3\na 1\nb 2\n", false, &c), "");
+
+    int sizes[] = {5, 12, 40};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int n = sizes[s];
+        char a[4096], b[4096];
+        size_t ua = (size_t)snprintf(a, sizeof(a), "blk {\n");
+        size_t ub = (size_t)snprintf(b, sizeof(b), "blk {\n");
+        size_t ta = 0, tb = 0;
+        char top_a[2048], top_b[2048];
+        for (int i = 0; i < n; i++) {
+            int j = n - 1 - i;
+            ua += (size_t)snprintf(a + ua, sizeof(a) - ua, "  k%d %d\n", i, i);
+            ub += (size_t)snprintf(b + ub, sizeof(b) - ub, "  k%d %d\n", j, j == 3 ? 99 : j);
+            ta += (size_t)snprintf(top_a + ta, sizeof(top_a) - ta, "t%d %d\n", i, i);
+            tb += (size_t)snprintf(top_b + tb, sizeof(top_b) - tb, "t%d %d\n", j, j == 1 ? 99 : j);
+        }
+        snprintf(a + ua, sizeof(a) - ua, "}\n%s", top_a);
+        snprintf(b + ub, sizeof(b) - ub, "}\n%s", top_b);
+        CHECK_STR(diff_text(a, b, false, &c), "~blk.k3,~t1");
+        CHECK_STR(diff_text(a, b, true, &c), "~blk.k3,~t1");
+    }
+}
+
+// Shared subtrees are skipped without being walked, and frozen ones with
+// equal cached hashes too
+static void test_shared(void) {
+    up_document_t *doc = test_parse(DIFF_BASE);
+    if (!doc) {
+        return;
+    }
+    up_document_t *clone = up_document_clone(doc);
+    changes_t c = {"", 0};
+    CHECK(clone && up_diff(doc, clone, record, &c) && c.calls == 0);
+
+    up_value_t *server = clone ? up_document_mutable(clone, "server") : NULL;
+    up_value_t *tls = server ? up_block_mutable(&server->as.block, "tls") : NULL;
+    CHECK(tls != NULL);
+    if (tls) {
+        up_block_set(&tls->as.block, "cert", up_value_new_string("y.pem"));
+        CHECK(up_diff(doc, clone, record, &c));
+        CHECK_STR(c.text, "~server.tls.cert");
+        c.text[0] = '\0';
+        CHECK(up_diff(clone, doc, record, &c));
+        CHECK_STR(c.text, "~server.tls.cert");
+    }
+    CHECK(up_diff(doc, doc, record, &c) && c.calls == 2);
+
+    CHECK(!up_diff(NULL, doc, record, &c));
+    CHECK(up_last_error()->code == UP_ERROR_ARGUMENT);
+    CHECK(!up_diff(doc, clone, NULL, NULL));
+    up_document_free(clone);
+    up_document_free(doc);
+}
+
+int main(void) {
+    RUN(test_paths);
+    RUN(test_reported_once);
+    RUN(test_reordered);
+    RUN(test_shared);
+    return test_report(__FILE__);
+}
@@ -0,0 +1,114 @@
+/**
+ * Duplicate key tests: each parser policy at the top level and inside
+ * blocks, and the repeats recorded by UP_DUPLICATES_COLLECT
+ */
+
+#include "test.h"
+
+static const char *DUPLICATE_INPUT =
+    "name first\n"
+    "server {\n  port 1\n  port!int 2\n}\n"
+    "name second\n";
+
+static up_document_t *parse_with(up_parser_t *parser, up_duplicate_policy_t policy, const char *text) {
+    parser->duplicate_policy = policy;
+    return up_parser_parse_document(parser, text);
+}
+
+static void test_policies(void) {
+    up_parser_t *parser = up_parser_new();
+    if (!parser) {
+        CHECK(parser != NULL);
+        return;
+    }
+
+    up_document_t *doc = parse_with(parser, UP_DUPLICATES_LAST_WINS, DUPLICATE_INPUT);
+    CHECK(doc && doc->count == 2);
+    if (doc) {
+        CHECK_STR(test_string(doc, "name"), "second");
+        up_block_t *server = &up_document_get(doc, "server")->value->as.block;
+        CHECK(server->count == 1);
+        CHECK_STR(up_block_get(server, "port")->as.string.data, "2");
+        CHECK_STR(up_block_get_type(server, "port"), "int");
+        up_document_free(doc);
+    }
+    CHECK(parser->duplicate_count == 0);
+
+    doc = parse_with(parser, UP_DUPLICATES_FIRST_WINS, DUPLICATE_INPUT);
+    CHECK(doc && doc->count == 2);
+    if (doc) {
+        CHECK_STR(test_string(doc, "name"), "first");
+        up_block_t *server = &up_document_get(doc, "server")->value->as.block;
+        CHECK_STR(up_block_get(server, "port")->as.string.data, "1");
+        CHECK(up_block_get_type(server, "port") == NULL);
+        up_document_free(doc);
+    }
+
+    // The first repeat is inside the block, on line 4
+    doc = parse_with(parser, UP_DUPLICATES_ERROR, DUPLICATE_INPUT);
+    CHECK(doc == NULL);
+    const up_error_t *error = up_parser_get_error(parser);
+    CHECK(error->code == UP_ERROR_DUPLICATE_KEY && error->line == 4);
+    CHECK(strstr(error->message, "'port'") != NULL);
+    CHECK(up_last_error()->code == UP_ERROR_DUPLICATE_KEY);
+
+    // Documents without repeats parse under every policy
+    doc = parse_with(parser, UP_DUPLICATES_ERROR, "a 1\nb {\n  a 2\n}\n");
+    CHECK(doc && doc->count == 2);
+    CHECK(up_parser_get_error(parser)->code == UP_OK);
+    up_document_free(doc);
+    up_parser_free(parser);
+}
+
+static void test_collect(void) {
+    up_parser_t *parser = up_parser_new();
+    if (!parser) {
+        CHECK(parser != NULL);
+        return;
+    }
+    up_document_t *doc = parse_with(parser, UP_DUPLICATES_COLLECT, DUPLICATE_INPUT);
+    CHECK(doc && parser->duplicate_count == 2);
+    if (doc && parser->duplicate_count == 2) {
+        CHECK_STR(test_string(doc, "name"), "second");
+        CHECK_STR(parser->duplicates[0].key, "port");
+        CHECK(parser->duplicates[0].line == 4);
+        CHECK_STR(parser->duplicates[1].key, "name");
+        CHECK(parser->duplicates[1].line == 6);
+    }
+    up_document_free(doc);
+
+    // Each parse starts a fresh list
+    doc = parse_with(parser, UP_DUPLICATES_COLLECT, "a 1\na 2\na 3\n");
+    CHECK(doc && parser->duplicate_count == 2);
+    CHECK_STR(doc ? test_string(doc, "a") : NULL, "3");
+    up_document_free(doc);
+    doc = parse_with(parser, UP_DUPLICATES_COLLECT, "a 1\n");
+    CHECK(doc && parser->duplicate_count == 0);
+    up_document_free(doc);
+    up_parser_free(parser);
+}
+
+static void test_sorted_blocks(void) {
+    up_parser_t *parser = up_parser_new();
+    if (!parser) {
+        CHECK(parser != NULL);
+        return;
+    }
+    parser->sorted_blocks = true;
+    up_document_t *doc = parse_with(parser, UP_DUPLICATES_FIRST_WINS, "b {\n  z 1\n  a 1\n  z 2\n}\n");
+    CHECK(doc != NULL);
+    if (doc) {
+        up_block_t *b = &up_document_get(doc, "b")->value->as.block;
+        CHECK(b->count == 2 && b->sorted);
+        CHECK_STR(up_block_get(b, "z")->as.string.data, "1");
+        up_document_free(doc);
+    }
+    up_parser_free(parser);
+}
+
+int main(void) {
+    RUN(test_policies);
+    RUN(test_collect);
+    RUN(test_sorted_blocks);
+    return test_report(__FILE__);
+}
@@ -0,0 +1,160 @@
+/**
+ * Error reporting tests: codes, positions and messages, parser-owned
+ * copies, long messages, and per-thread isolation under concurrent
+ * failures
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "test.h"
+#include <pthread.h>
+
+// Text whose only error is a stray "}" on `line`
+static void stray_brace(char *out, size_t size, size_t line) {
+    size_t used = 0;
+    out[0] = '\0';
+    for (size_t i = 1; i < line; i++) {
+        used += (size_t)snprintf(out + used, size - used, "k%zu v\n", i);
+    }
+    snprintf(out + used, size - used, "}\n");
+}
+
+static void test_positions(void) {
+    CHECK(up_parse_string("a 1\nb {\n  c 2\n") == NULL);
+    const up_error_t *error = up_last_error();
+    CHECK(error->code == UP_ERROR_SYNTAX && error->line == 2 && error->column == 1);
+    CHECK(error->offset == 4);
+    CHECK_STR(error->message, "unterminated block");
+    CHECK_STR(up_get_error(), "Line 2, column 1: unterminated block");
+
+    CHECK(up_parse_string("a 1\nb 2\nc {\n  d [\n") == NULL);
+    CHECK(error->line == 4 && error->column == 3 && error->offset == 14);
+
+    // Errors without a position have no prefix
+    CHECK(up_parse(NULL) == NULL);
+    CHECK(error->code == UP_ERROR_ARGUMENT && error->line == 0);
+    CHECK_STR(up_get_error(), error->message);
+
+    // A successful call leaves the last error alone
+    up_document_t *doc = up_parse_string("a 1\n");
+    CHECK(doc != NULL && error->code == UP_ERROR_ARGUMENT);
+    up_document_free(doc);
+}
+
+// The parser keeps its own copy, which later failures on the thread do
+// not overwrite, and a successful parse resets it
+static void test_parser_copy(void) {
+    up_parser_t *parser = up_parser_new();
+    if (!parser) {
+        CHECK(parser != NULL);
+        return;
+    }
+    CHECK(up_parser_parse_document(parser, "a 1\n}\n") == NULL);
+    CHECK(up_parse_string("x [\n") == NULL);
+    const up_error_t *kept = up_parser_get_error(parser);
+    CHECK(kept->code == UP_ERROR_SYNTAX && kept->line == 2);
+    CHECK_STR(kept->message, "expected key");
+    CHECK(kept->message != up_last_error()->message);
+
+    up_document_t *doc = up_parser_parse_document(parser, "a 1\n");
+    CHECK(doc && up_parser_get_error(parser)->code == UP_OK);
+    CHECK(up_parser_get_error(parser)->message != NULL);
+    up_document_free(doc);
+    up_parser_free(parser);
+    CHECK(up_parser_get_error(NULL) == NULL);
+}
+
+// Messages past the inline buffer move to the heap whole, and trimming
+// the thread's caches drops them without leaving a NULL message
+static void test_long_messages(void) {
+    char path[600];
+    memset(path, 'p', sizeof(path) - 1);
+    memcpy(path, "/nonexistent/", 13);
+    path[sizeof(path) - 1] = '\0';
+    CHECK(up_parse_file(path) == NULL);
+    const up_error_t *error = up_last_error();
+    CHECK(error->code == UP_ERROR_IO);
+    CHECK(strstr(error->message, path) != NULL);
+    CHECK(strlen(up_get_error()) > sizeof(path));
+
+    up_pool_trim();
+    CHECK(up_last_error()->message != NULL && up_get_error() != NULL);
+
+    // Short messages work again afterwards
+    CHECK(up_parse_string("}\n") == NULL);
+    CHECK_STR(up_get_error(), "Line 1, column 1: expected key");
+}
+
+typedef struct {
+    size_t id;
+    size_t wrong;
+} error_job_t;
+
+// Each thread fails over and over at its own line, alternating with long
+// heap messages, and must only ever see its own errors
+static void *error_thread(void *arg) {
+    error_job_t *job = arg;
+    char text[4096], expected[64], path[400];
+    size_t line = job->id + 1;
+    stray_brace(text, sizeof(text), line);
+    snprintf(expected, sizeof(expected), "Line %zu, column 1: expected key", line);
+    snprintf(path, sizeof(path), "/nonexistent/thread-%zu-%0300d", job->id, 0);
+
+    for (int i = 0; i < 500; i++) {
+        if (up_parse_string(text) != NULL || strcmp(up_get_error(), expected) != 0 ||
+            up_last_error()->line != line) {
+            job->wrong++;
+        }
+        if (i % 10 == 0 &&
+            (up_parse_file(path) != NULL || !strstr(up_last_error()->message, path))) {
+            job->wrong++;
+        }
+    }
+    up_pool_trim();
+    return NULL;
+}
+
+static void test_threads(void) {
+    CHECK(up_parse_string("main 1\n}\n") == NULL);
+
+    enum { THREADS = 8 };
+    pthread_t threads[THREADS];
+    error_job_t jobs[THREADS];
+    for (size_t i = 0; i < THREADS; i++) {
+        jobs[i].id = i + 1;
+        jobs[i].wrong = 0;
+        CHECK(pthread_create(&threads[i], NULL, error_thread, &jobs[i]) == 0);
+    }
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK(jobs[i].wrong == 0);
+    }
+
+    // The main thread's error is untouched by all of that
+    CHECK_STR(up_get_error(), "Line 2, column 1: expected key");
+}
+
+static void *fresh_thread(void *arg) {
+    const up_error_t *error = up_last_error();
+    *(bool *)arg = error->code == UP_OK && error->message != NULL;
+    up_pool_trim();
+    return NULL;
+}
+
+// A thread that never failed starts clean, whatever other threads did
+static void test_fresh_thread(void) {
+    CHECK(up_parse_string("}\n") == NULL);
+    bool clean = false;
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, fresh_thread, &clean) == 0);
+    pthread_join(thread, NULL);
+    CHECK(clean);
+}
+
+int main(void) {
+    RUN(test_positions);
+    RUN(test_parser_copy);
+    RUN(test_long_messages);
+    RUN(test_threads);
+    RUN(test_fresh_thread);
+    return test_report(__FILE__);
+}
@@ -0,0 +1,193 @@
+/**
+ * Freeze tests: mutators refuse frozen containers, concurrent readers, and
+ * clones or merges that outlive the frozen document they came from
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "test.h"
+#include <pthread.h>
+
+static const char *FREEZE_INPUT =
+    "name app\n"
+    "server {\n  host localhost\n  tls {\n    on true\n  }\n}\n"
+    "items [a, b]\n";
+
+static up_value_t *block_at(up_value_t *block, const char *key) {
+    return up_block_get(&block->as.block, key);
+}
+
+static void test_mutators_refuse(void) {
+    up_document_t *doc = test_parse(FREEZE_INPUT);
+    if (!doc) {
+        return;
+    }
+    CHECK(!up_document_is_frozen(doc));
+    up_document_freeze(doc);
+    up_document_freeze(doc);
+    CHECK(up_document_is_frozen(doc));
+
+    CHECK(up_document_mutable(doc, "server") == NULL);
+    CHECK(up_last_error()->code == UP_ERROR_FROZEN);
+
+    up_value_t *server = up_document_get(doc, "server")->value;
+    CHECK(server->as.block.frozen);
+    up_block_set(&server->as.block, "host", up_value_new_string("changed"));
+    CHECK(up_last_error()->code == UP_ERROR_FROZEN);
+    CHECK_STR(block_at(server, "host")->as.string.data, "localhost");
+    CHECK(up_block_mutable(&server->as.block, "tls") == NULL);
+
+    up_value_t *items = up_document_get(doc, "items")->value;
+    up_list_append(&items->as.list, up_value_new_string("c"));
+    CHECK(up_last_error()->code == UP_ERROR_FROZEN);
+    CHECK(items->as.list.count == 2);
+
+    // Nested containers are frozen too
+    CHECK(block_at(server, "tls")->as.block.frozen);
+    up_document_free(doc);
+}
+
+// The reported case: the clone keeps the only reference to frozen values
+// once the original is gone, and must still be able to change them
+static void test_clone_outlives_frozen(void) {
+    up_document_t *doc = test_parse(FREEZE_INPUT);
+    if (!doc) {
+        return;
+    }
+    up_document_freeze(doc);
+    up_document_t *clone = up_document_clone(doc);
+    CHECK(!up_document_is_frozen(clone));
+    up_document_free(doc);
+
+    uint64_t before = up_document_hash(clone, 0);
+    up_value_t *server = up_document_mutable(clone, "server");
+    CHECK(server && !server->as.block.frozen);
+    if (!server) {
+        up_document_free(clone);
+        return;
+    }
+    up_block_set(&server->as.block, "host", up_value_new_string("example.org"));
+    CHECK_STR(block_at(server, "host")->as.string.data, "example.org");
+    CHECK(up_document_hash(clone, 0) != before);
+
+    up_value_t *tls = up_block_mutable(&server->as.block, "tls");
+    CHECK(tls && !tls->as.block.frozen);
+    if (tls) {
+        up_block_set(&tls->as.block, "on", up_value_new_string("false"));
+        CHECK_STR(block_at(tls, "on")->as.string.data, "false");
+    }
+
+    up_value_t *items = up_document_mutable(clone, "items");
+    if (items) {
+        up_list_append(&items->as.list, up_value_new_string("c"));
+    }
+    CHECK(items && items->as.list.count == 3);
+    up_document_free(clone);
+}
+
+// While the frozen original is alive, the clone gets copies instead
+static void test_clone_of_live_frozen(void) {
+    up_document_t *doc = test_parse(FREEZE_INPUT);
+    if (!doc) {
+        return;
+    }
+    up_document_freeze(doc);
+    up_document_t *clone = up_document_clone(doc);
+    up_value_t *server = up_document_mutable(clone, "server");
+    CHECK(server && !server->as.block.frozen);
+    if (server) {
+        up_block_set(&server->as.block, "host", up_value_new_string("example.org"));
+    }
+    up_value_t *original = up_document_get(doc, "server")->value;
+    CHECK(original->as.block.frozen && original != server);
+    CHECK_STR(block_at(original, "host")->as.string.data, "localhost");
+    up_document_free(clone);
+    up_document_free(doc);
+}
+
+static void test_merge_outlives_frozen(void) {
+    up_document_t *base = test_parse(FREEZE_INPUT);
+    up_document_t *overlay = test_parse("extra 1\n");
+    if (!base || !overlay) {
+        up_document_free(base);
+        up_document_free(overlay);
+        return;
+    }
+    up_document_freeze(base);
+    up_document_t *merged = up_document_merge(base, overlay, UP_MERGE_LIST_REPLACE);
+    up_document_free(base);
+    up_document_free(overlay);
+    CHECK(merged != NULL);
+    if (!merged) {
+        return;
+    }
+
+    up_value_t *server = up_document_mutable(merged, "server");
+    CHECK(server && !server->as.block.frozen);
+    if (server) {
+        up_block_set(&server->as.block, "port", up_value_new_string("443"));
+        CHECK_STR(block_at(server, "port")->as.string.data, "443");
+    }
+    CHECK_STR(test_string(merged, "extra"), "1");
+    up_document_free(merged);
+}
+
+typedef struct {
+    up_document_t *doc;
+    uint64_t hash;
+    int mismatches;
+} reader_t;
+
+static void *read_frozen(void *arg) {
+    reader_t *reader = arg;
+    char key[16];
+    for (int round = 0; round < 200; round++) {
+        for (int i = 0; i < 64; i++) {
+            snprintf(key, sizeof(key), "key%d", i);
+            up_node_t *node = up_document_get(reader->doc, key);
+            if (!node || node->value->as.string.length == 0) {
+                reader->mismatches++;
+            }
+        }
+        if (up_document_hash(reader->doc, 0) != reader->hash) {
+            reader->mismatches++;
+        }
+    }
+    up_pool_trim();
+    return NULL;
+}
+
+static void test_concurrent_readers(void) {
+    char text[2048];
+    size_t used = 0;
+    for (int i = 0; i < 64; i++) {
+        used += (size_t)snprintf(text + used, sizeof(text) - used, "key%d value%d\n", i, i);
+    }
+    up_document_t *doc = test_parse(text);
+    if (!doc) {
+        return;
+    }
+    uint64_t hash = up_document_hash(doc, 0);
+    up_document_freeze(doc);
+
+    enum { READERS = 4 };
+    pthread_t threads[READERS];
+    reader_t readers[READERS];
+    for (int i = 0; i < READERS; i++) {
+        readers[i] = (reader_t){doc, hash, 0};
+        CHECK(pthread_create(&threads[i], NULL, read_frozen, &readers[i]) == 0);
+    }
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK(readers[i].mismatches == 0);
+    }
+    up_document_free(doc);
+}
+
+int main(void) {
+    RUN(test_mutators_refuse);
+    RUN(test_clone_outlives_frozen);
+    RUN(test_clone_of_live_frozen);
+    RUN(test_merge_outlives_frozen);
+    RUN(test_concurrent_readers);
+    return test_report(__FILE__);
+}
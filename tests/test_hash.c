@@ -0,0 +1,164 @@
+/**
+ * Structural hash tests: what counts and what does not, unordered
+ * hashing, and the hash cache of frozen documents
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "test.h"
+#include <pthread.h>
+
+static uint64_t text_hash(const char *text, unsigned flags) {
+    up_document_t *doc = test_parse(text);
+    uint64_t hash = up_document_hash(doc, flags);
+    up_document_free(doc);
+    return hash;
+}
+
+static void test_what_counts(void) {
+    const char *base = "a 1\nb {\n  c x\n}\nl [p, q]\n";
+    uint64_t hash = text_hash(base, 0);
+    CHECK(hash != 0);
+
+    // Layout and comments do not
+    CHECK(text_hash("# comment\na    1\n\nb {\n  # inner\n    c x\n}\nl [\np\nq\n]\n", 0) == hash);
+
+    // Keys, annotations, values, order and the kind of value do
+    const char *changed[] = {
+        "a 2\nb {\n  c x\n}\nl [p, q]\n",
+        "A 1\nb {\n  c x\n}\nl [p, q]\n",
+        "a!int 1\nb {\n  c x\n}\nl [p, q]\n",
+        "a 1\nb!cfg {\n  c x\n}\nl [p, q]\n",
+        "a 1\nb {\n  c y\n}\nl [p, q]\n",
+        "a 1\nb {\n  c x\n}\nl [q, p]\n",
+        "a 1\nb {\n  c x\n}\nl [p, q, q]\n",
+        "a 1\nb {\n  c x\n}\nl [[p, q]]\n",
+        "a 1\nb {\n  c x\n}\nl p\n",
+        "b {\n  c x\n}\na 1\nl [p, q]\n",
+        "a 1\nb {\n  c x\n}\n",
+    };
+    for (size_t i = 0; i < sizeof(changed) / sizeof(changed[0]); i++) {
+        if (text_hash(changed[i], 0) == hash) {
+            fprintf(stderr, "same hash for:\n%s", changed[i]);
+            test_failures++;
+        }
+    }
+
+    // Strings split differently between key and value, or between items
+    CHECK(text_hash("ab c\n", 0) != text_hash("a bc\n", 0));
+    CHECK(text_hash("l [ab, c]\n", 0) != text_hash("l [a, bc]\n", 0));
+    CHECK(text_hash("e\n", 0) != text_hash("e {\n}\n", 0));
+    CHECK(text_hash("e {\n}\n", 0) != text_hash("e [\n]\n", 0));
+    CHECK(text_hash("", 0) != 0);
+    CHECK(up_document_hash(NULL, 0) == 0);
+    CHECK(up_value_hash(NULL, 0) == 0);
+}
+
+static void test_unordered(void) {
+    const char *a = "x 1\ny {\n  p 1\n  q 2\n}\nl [a, b]\n";
+    const char *b = "y {\n  q 2\n  p 1\n}\nx 1\nl [a, b]\n";
+    CHECK(text_hash(a, 0) != text_hash(b, 0));
+    CHECK(text_hash(a, UP_HASH_UNORDERED) == text_hash(b, UP_HASH_UNORDERED));
+    CHECK(text_hash(a, UP_HASH_UNORDERED) != text_hash(a, 0));
+
+    // Lists keep their order, and entries still pair keys with values
+    CHECK(text_hash("l [a, b]\n", UP_HASH_UNORDERED) != text_hash("l [b, a]\n", UP_HASH_UNORDERED));
+    CHECK(text_hash("p 1\nq 2\n", UP_HASH_UNORDERED) != text_hash("p 2\nq 1\n", UP_HASH_UNORDERED));
+}
+
+// A document hashes like a block with the same entries
+static void test_document_as_block(void) {
+    up_document_t *doc = test_parse("k!int 1\ninner {\n  k!int 1\n  s x\n}\ns x\n");
+    if (!doc) {
+        return;
+    }
+    up_document_t *flat = test_parse("k!int 1\ns x\n");
+    const up_value_t *inner = up_document_get(doc, "inner")->value;
+    CHECK(flat && up_value_hash(inner, 0) == up_document_hash(flat, 0));
+    CHECK(flat && up_value_hash(inner, UP_HASH_UNORDERED) ==
+                       up_document_hash(flat, UP_HASH_UNORDERED));
+    up_document_free(flat);
+    up_document_free(doc);
+}
+
+static void test_frozen_cache(void) {
+    up_document_t *doc =
+        test_parse("server {\n  host a\n  tls {\n    on true\n  }\n}\nitems [x]\n");
+    if (!doc) {
+        return;
+    }
+    uint64_t hash = up_document_hash(doc, 0);
+    uint64_t unordered = up_document_hash(doc, UP_HASH_UNORDERED);
+    up_value_t *server = up_document_get(doc, "server")->value;
+    CHECK(server->hash_cache[0] == 0 && doc->hash_cache[0] == 0);
+
+    up_document_freeze(doc);
+    CHECK(up_document_hash(doc, 0) == hash);
+    CHECK(doc->hash_cache[0] == hash && server->hash_cache[0] != 0);
+    CHECK(doc->hash_cache[1] == 0);
+    CHECK(up_document_hash(doc, UP_HASH_UNORDERED) == unordered && doc->hash_cache[1] == unordered);
+    CHECK(up_document_hash(doc, 0) == hash);
+
+    // A clone that thaws shared values must not keep their cached hashes
+    up_document_t *clone = up_document_clone(doc);
+    up_document_free(doc);
+    CHECK(clone && up_document_hash(clone, 0) == hash);
+    up_value_t *copy = clone ? up_document_mutable(clone, "server") : NULL;
+    CHECK(copy != NULL);
+    if (copy) {
+        up_block_set(&copy->as.block, "host", up_value_new_string("b"));
+        CHECK(up_document_hash(clone, 0) != hash);
+        up_block_set(&copy->as.block, "host", up_value_new_string("a"));
+        CHECK(up_document_hash(clone, 0) == hash);
+    }
+    up_document_free(clone);
+}
+
+typedef struct {
+    up_document_t *doc;
+    uint64_t hash;
+} hash_job_t;
+
+static void *hash_thread(void *arg) {
+    hash_job_t *job = arg;
+    job->hash = up_document_hash(job->doc, 0);
+    up_pool_trim();
+    return NULL;
+}
+
+// Readers racing to fill the cache of one frozen document all agree
+static void test_concurrent_cache(void) {
+    char text[8192];
+    size_t used = 0;
+    for (int i = 0; i < 200; i++) {
+        used += (size_t)snprintf(text + used, sizeof(text) - used, "k%d {\n  v %d\n}\n", i, i);
+    }
+    up_document_t *doc = test_parse(text);
+    if (!doc) {
+        return;
+    }
+    uint64_t expected = up_document_hash(doc, 0);
+    up_document_freeze(doc);
+
+    enum { THREADS = 8 };
+    pthread_t threads[THREADS];
+    hash_job_t jobs[THREADS];
+    for (int i = 0; i < THREADS; i++) {
+        jobs[i].doc = doc;
+        jobs[i].hash = 0;
+        CHECK(pthread_create(&threads[i], NULL, hash_thread, &jobs[i]) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK(jobs[i].hash == expected);
+    }
+    up_document_free(doc);
+}
+
+int main(void) {
+    RUN(test_what_counts);
+    RUN(test_unordered);
+    RUN(test_document_as_block);
+    RUN(test_frozen_cache);
+    RUN(test_concurrent_cache);
+    return test_report(__FILE__);
+}
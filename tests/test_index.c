@@ -0,0 +1,261 @@
+/**
+ * Key index tests: Swiss-table probing and collisions, and document and
+ * block lookups as their indexes are built and grown
+ */
+
+#include "test.h"
+#include "up_internal.h"
+
+static const char *key_at(const void *owner, size_t position) {
+    return ((const char *const *)owner)[position];
+}
+
+// Keys key0, key1, ... in one buffer, with a pointer array over them
+typedef struct {
+    char **keys;
+    char *text;
+    size_t count;
+} keys_t;
+
+static bool keys_make(keys_t *k, size_t count) {
+    k->count = count;
+    k->keys = malloc(count * sizeof(char *));
+    k->text = malloc(count * 24);
+    if (!k->keys || !k->text) {
+        free(k->keys);
+        free(k->text);
+        CHECK(!"out of memory");
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        k->keys[i] = k->text + i * 24;
+        snprintf(k->keys[i], 24, "key%zu", i);
+    }
+    return true;
+}
+
+static void keys_free(keys_t *k) {
+    free(k->keys);
+    free(k->text);
+}
+
+static void test_sync_and_lookup(void) {
+    keys_t k;
+    if (!keys_make(&k, 5000)) {
+        return;
+    }
+    up_index_t *index = NULL;
+
+    // Grow the covered range in steps, as documents do when keys are added
+    size_t steps[] = {0, 1, 100, 101, 3000, 5000};
+    for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); s++) {
+        CHECK(up_index_sync(&index, steps[s], key_at, k.keys));
+        CHECK(index && index->covered == steps[s] && index->count == steps[s]);
+    }
+    CHECK(index->count < index->capacity - index->capacity / 8 + 1);
+
+    size_t misses = 0;
+    for (size_t i = 0; i < k.count; i++) {
+        size_t position = k.count;
+        if (!up_index_lookup(index, k.keys[i], up_hash_string(k.keys[i]), key_at, k.keys, &position) ||
+            position != i) {
+            misses++;
+        }
+    }
+    CHECK(misses == 0);
+
+    size_t position;
+    CHECK(!up_index_lookup(index, "absent", up_hash_string("absent"), key_at, k.keys, &position));
+    CHECK(!up_index_lookup(index, "key5000", up_hash_string("key5000"), key_at, k.keys, &position));
+
+    // Shrinking the owner rebuilds the index from scratch
+    CHECK(up_index_sync(&index, 10, key_at, k.keys));
+    CHECK(index->count == 10);
+    CHECK(!up_index_lookup(index, "key10", up_hash_string("key10"), key_at, k.keys, &position));
+    CHECK(up_index_bytes(index) > 0 && up_index_bytes(NULL) == 0);
+
+    up_index_free(index);
+    keys_free(&k);
+}
+
+// Every key gets the same hash: lookups have to tell them apart by key,
+// across groups once the home group fills up
+static void test_forced_collisions(void) {
+    keys_t k;
+    if (!keys_make(&k, 28)) {
+        return;
+    }
+    up_index_t *index = NULL;
+    CHECK(up_index_sync(&index, 20, key_at, k.keys));
+    if (!index) {
+        keys_free(&k);
+        return;
+    }
+    CHECK(index->capacity == 32);
+
+    const uint64_t hash = 0x05;     // Home group 0, tag 5
+    for (size_t i = 20; i < k.count; i++) {
+        CHECK(up_index_add(index, hash, i, key_at, k.keys));
+    }
+    CHECK(index->capacity == 32 && index->count == 28);
+
+    for (size_t i = 20; i < k.count; i++) {
+        size_t position = k.count;
+        CHECK(up_index_lookup(index, k.keys[i], hash, key_at, k.keys, &position) && position == i);
+    }
+    size_t position;
+    CHECK(!up_index_lookup(index, "absent", hash, key_at, k.keys, &position));
+    for (size_t i = 0; i < 20; i++) {
+        CHECK(up_index_lookup(index, k.keys[i], up_hash_string(k.keys[i]), key_at, k.keys, &position) &&
+              position == i);
+    }
+
+    up_index_free(index);
+    keys_free(&k);
+}
+
+static void test_hash_scan(void) {
+    keys_t k;
+    if (!keys_make(&k, 11)) {
+        return;
+    }
+    uint32_t hashes[11];
+    for (size_t i = 0; i < k.count; i++) {
+        hashes[i] = (uint32_t)up_hash_string(k.keys[i]);
+    }
+    // Odd counts cover both the vector groups and the scalar tail
+    for (size_t i = 0; i < k.count; i++) {
+        CHECK(up_hash_scan(hashes, k.count, hashes[i], k.keys[i], key_at, k.keys) == i);
+    }
+    CHECK(up_hash_scan(hashes, k.count, hashes[3], "absent", key_at, k.keys) == k.count);
+
+    // Equal prefixes fall through to the key comparison
+    for (size_t i = 0; i < k.count; i++) {
+        hashes[i] = 7;
+    }
+    CHECK(up_hash_scan(hashes, k.count, 7, "key9", key_at, k.keys) == 9);
+    keys_free(&k);
+}
+
+static void test_document_lookups(void) {
+    // Below the index threshold, at it, and well past it
+    size_t sizes[] = {3, UP_INDEX_MIN_KEYS, 1000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t count = sizes[s];
+        char *text = malloc(count * 32);
+        if (!text) {
+            CHECK(!"out of memory");
+            return;
+        }
+        size_t used = 0;
+        for (size_t i = 0; i < count; i++) {
+            used += (size_t)snprintf(text + used, count * 32 - used, "key%zu value%zu\n", i, i);
+        }
+        up_document_t *doc = test_parse(text);
+        free(text);
+        if (!doc) {
+            return;
+        }
+
+        char key[32], value[32];
+        size_t wrong = 0;
+        for (size_t i = 0; i < count; i++) {
+            snprintf(key, sizeof(key), "key%zu", i);
+            snprintf(value, sizeof(value), "value%zu", i);
+            const char *found = test_string(doc, key);
+            if (!found || strcmp(found, value) != 0) {
+                wrong++;
+            }
+        }
+        CHECK(wrong == 0);
+        CHECK(up_document_get(doc, "missing") == NULL);
+        CHECK(up_document_get(doc, "key") == NULL);
+
+        // Keys added after the index was built are found as well
+        CHECK(up_document_put(doc, "late", NULL, up_value_new_string("yes")));
+        CHECK_STR(test_string(doc, "late"), "yes");
+        CHECK(up_document_put(doc, "key0", NULL, up_value_new_string("replaced")));
+        CHECK_STR(test_string(doc, "key0"), "replaced");
+        CHECK(doc->count == count + 1);
+        up_document_free(doc);
+    }
+}
+
+static void test_block_lookups(void) {
+    up_value_t *value = up_value_new_block();
+    if (!value) {
+        CHECK(value != NULL);
+        return;
+    }
+    up_block_t *block = &value->as.block;
+    char key[32], text[32];
+
+    // Hash-prefix scanning below the threshold, the index above it
+    for (size_t i = 0; i < 300; i++) {
+        snprintf(key, sizeof(key), "field%zu", i);
+        snprintf(text, sizeof(text), "%zu", i);
+        up_block_set(block, key, up_value_new_string(text));
+        if (i + 1 == UP_BLOCK_INDEX_MIN_KEYS - 1) {
+            CHECK(block->index == NULL);
+        }
+    }
+    CHECK(block->count == 300 && block->index != NULL);
+
+    size_t wrong = 0;
+    for (size_t i = 0; i < 300; i++) {
+        snprintf(key, sizeof(key), "field%zu", i);
+        snprintf(text, sizeof(text), "%zu", i);
+        up_value_t *found = up_block_get(block, key);
+        if (!found || strcmp(found->as.string.data, text) != 0 ||
+            up_block_find(block, key, up_hash_string(key)) != i) {
+            wrong++;
+        }
+    }
+    CHECK(wrong == 0);
+    CHECK(up_block_get(block, "field300") == NULL);
+    CHECK(up_block_get(block, "") == NULL);
+
+    // Replacing keeps the position; typed entries are found the same way
+    up_block_set(block, "field7", up_value_new_string("seven"));
+    up_block_set_typed(block, "late", "int", up_value_new_string("1"));
+    CHECK(block->count == 301);
+    CHECK_STR(up_block_get(block, "field7")->as.string.data, "seven");
+    CHECK(up_block_find(block, "field7", up_hash_string("field7")) == 7);
+    CHECK_STR(up_block_get_type(block, "late"), "int");
+    CHECK(up_block_get_type(block, "field7") == NULL);
+    up_value_free(value);
+}
+
+static void test_parsed_block_lookups(void) {
+    char text[4096];
+    size_t used = (size_t)snprintf(text, sizeof(text), "config {\n");
+    for (int i = 0; i < 100; i++) {
+        used += (size_t)snprintf(text + used, sizeof(text) - used, "  opt%d v%d\n", i, i);
+    }
+    snprintf(text + used, sizeof(text) - used, "}\n");
+    up_document_t *doc = test_parse(text);
+    if (!doc) {
+        return;
+    }
+    up_value_t *config = up_document_get(doc, "config")->value;
+    CHECK(config->as.block.count == 100);
+    CHECK_STR(up_block_get(&config->as.block, "opt0")->as.string.data, "v0");
+    CHECK_STR(up_block_get(&config->as.block, "opt99")->as.string.data, "v99");
+    CHECK(up_block_get(&config->as.block, "opt100") == NULL);
+
+    // Frozen blocks answer from the index built at freeze time
+    up_document_freeze(doc);
+    CHECK(config->as.block.index && config->as.block.index->covered == 100);
+    CHECK_STR(up_block_get(&config->as.block, "opt50")->as.string.data, "v50");
+    up_document_free(doc);
+}
+
+int main(void) {
+    RUN(test_sync_and_lookup);
+    RUN(test_forced_collisions);
+    RUN(test_hash_scan);
+    RUN(test_document_lookups);
+    RUN(test_block_lookups);
+    RUN(test_parsed_block_lookups);
+    return test_report(__FILE__);
+}
@@ -0,0 +1,253 @@
+/**
+ * JSON tests: export layouts, typed scalars and escaping, and import of
+ * typed scalars, keys and malformed input. Every layout ends the output
+ * with a newline.
+ */
+
+#include "test.h"
+#include "up_internal.h"
+
+// Sink collecting output into a growing buffer
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    size_t calls;
+    size_t fail_after;      // Refuse the write after this many calls; 0 never
+} buffer_t;
+
+static bool buffer_write(void *context, const char *data, size_t length) {
+    buffer_t *b = context;
+    if (b->fail_after && b->calls >= b->fail_after) {
+        return false;
+    }
+    b->calls++;
+    if (b->length + length + 1 > b->capacity) {
+        size_t capacity = (b->length + length + 1) * 2;
+        char *grown = realloc(b->data, capacity);
+        if (!grown) {
+            return false;
+        }
+        b->data = grown;
+        b->capacity = capacity;
+    }
+    memcpy(b->data + b->length, data, length);
+    b->length += length;
+    b->data[b->length] = '\0';
+    return true;
+}
+
+// JSON for `text` with `opts`; the caller frees the result
+static char *to_json(const char *text, const up_json_options_t *opts) {
+    up_document_t *doc = test_parse(text);
+    if (!doc) {
+        return NULL;
+    }
+    buffer_t b = {0};
+    up_sink_t sink = {buffer_write, &b};
+    CHECK(up_document_to_json(doc, sink, opts));
+    up_document_free(doc);
+    return b.data;
+}
+
+static const char *EXPORT_INPUT =
+    "name app\nport!int 8080\non!bool true\nratio!float 0.5\nnone!null\nbad!int 08\n"
+    "ports!int [1, 2]\nserver {\n  host x\n  empty {\n  }\n}\nitems [\n]\nrows {\n  [a, b]\n}\n";
+
+static void test_compact_typed(void) {
+    char *json = to_json(EXPORT_INPUT, NULL);
+    CHECK_STR(json, "{\"name\":\"app\",\"port\":8080,\"on\":true,\"ratio\":0.5,\"none\":null,"
+                    "\"bad\":\"08\",\"ports\":[1,2],\"server\":{\"host\":\"x\",\"empty\":{}},"
+                    "\"items\":[],\"rows\":[[\"a\",\"b\"]]}\n");
+    free(json);
+
+    // Only valid JSON literals lose their quotes
+    json = to_json("a!int -0\nb!int 1e3\nc!float .5\nd!float 1.\ne!bool True\nf!float -2.5E-3\n"
+                   "g!null x\nh!int +1\n", NULL);
+    CHECK_STR(json, "{\"a\":-0,\"b\":\"1e3\",\"c\":\".5\",\"d\":\"1.\",\"e\":\"True\","
+                    "\"f\":-2.5E-3,\"g\":\"x\",\"h\":\"+1\"}\n");
+    free(json);
+
+    json = to_json("", NULL);
+    CHECK_STR(json, "{}\n");
+    free(json);
+}
+
+static void test_layouts(void) {
+    up_json_options_t pretty = {true, false, false};
+    char *json = to_json("a!int 1\nb {\n  c [x, y]\n  d {\n  }\n}\n", &pretty);
+    CHECK_STR(json, "{\n  \"a\": 1,\n  \"b\": {\n    \"c\": [\n      \"x\",\n      \"y\"\n    ],\n"
+                    "    \"d\": {}\n  }\n}\n");
+    free(json);
+
+    up_json_options_t plain = {false, true, false};
+    json = to_json("a!int 1\nb!bool false\n", &plain);
+    CHECK_STR(json, "{\"a\":\"1\",\"b\":\"false\"}\n");
+    free(json);
+
+    // Stream mode: one object per line, each handed over on its own
+    up_json_options_t stream = {true, false, true};
+    up_document_t *doc = test_parse("a!int 1\nb {\n  c 2\n}\nd [x]\n");
+    if (doc) {
+        buffer_t b = {0};
+        up_sink_t sink = {buffer_write, &b};
+        CHECK(up_document_to_json(doc, sink, &stream));
+        CHECK_STR(b.data, "{\"a\":1}\n{\"b\":{\"c\":\"2\"}}\n{\"d\":[\"x\"]}\n");
+        CHECK(b.calls == 3);
+        free(b.data);
+        up_document_free(doc);
+    }
+}
+
+static void test_escaping(void) {
+    up_document_t *doc = test_parse("");
+    if (!doc) {
+        return;
+    }
+    // Long enough to cover the 16-byte scan and the scalar tail, with
+    // special bytes in both
+    CHECK(up_document_put(doc, "s", NULL,
+                          up_value_new_string("clean run of plain text \"quoted\" back\\slash\ttab"
+                                              "\x01\x1f end\n")));
+    buffer_t b = {0};
+    up_sink_t sink = {buffer_write, &b};
+    CHECK(up_document_to_json(doc, sink, NULL));
+    CHECK_STR(b.data, "{\"s\":\"clean run of plain text \\\"quoted\\\" back\\\\slash\\ttab"
+                      "\\u0001\\u001f end\\n\"}\n");
+    free(b.data);
+    up_document_free(doc);
+
+    // Multi-byte UTF-8 passes through untouched
+    char *json = to_json("k h\xc3\xa9llo \xe2\x82\xac\n", NULL);
+    CHECK_STR(json, "{\"k\":\"h\xc3\xa9llo \xe2\x82\xac\"}\n");
+    free(json);
+}
+
+static void test_sink_failure(void) {
+    char big[20000];
+    size_t used = 0;
+    for (int i = 0; i < 1000; i++) {
+        used += (size_t)snprintf(big + used, sizeof(big) - used, "key%d value%d\n", i, i);
+    }
+    up_document_t *doc = test_parse(big);
+    if (!doc) {
+        return;
+    }
+    buffer_t b = {0};
+    b.fail_after = 1;
+    up_sink_t sink = {buffer_write, &b};
+    CHECK(!up_document_to_json(doc, sink, NULL));
+    CHECK(up_last_error()->code == UP_ERROR_IO);
+    CHECK(b.calls == 1);
+    free(b.data);
+
+    up_sink_t none = {NULL, NULL};
+    CHECK(!up_document_to_json(doc, none, NULL));
+    CHECK(!up_document_to_json(NULL, sink, NULL));
+    up_document_free(doc);
+}
+
+static up_document_t *from_json(const char *json) {
+    return up_document_from_json(json, strlen(json));
+}
+
+static const char *node_type(up_document_t *doc, const char *key) {
+    up_node_t *node = up_document_get(doc, key);
+    return node ? node->type_annotation : NULL;
+}
+
+static void test_import_types(void) {
+    up_document_t *doc = from_json("\xef\xbb\xbf{\"name\":\"app\",\"port\":8080,\"ratio\":-0.5e1,"
+                                   "\"on\":true,\"none\":null,\"mixed\":[1,2.5],\"ints\":[1,2],"
+                                   "\"words\":[\"a\",1],\"empty\":[],"
+                                   "\"server\":{\"tls-mode\":\"x\",\"_port\":1}}");
+    CHECK(doc != NULL);
+    if (!doc) {
+        return;
+    }
+    CHECK_STR(test_string(doc, "name"), "app");
+    CHECK(node_type(doc, "name") == NULL);
+    CHECK_STR(test_string(doc, "port"), "8080");
+    CHECK_STR(node_type(doc, "port"), "int");
+    CHECK_STR(test_string(doc, "ratio"), "-0.5e1");
+    CHECK_STR(node_type(doc, "ratio"), "float");
+    CHECK_STR(node_type(doc, "on"), "bool");
+    CHECK_STR(test_string(doc, "none"), "");
+    CHECK_STR(node_type(doc, "none"), "null");
+    CHECK_STR(node_type(doc, "mixed"), "float");
+    CHECK_STR(node_type(doc, "ints"), "int");
+    CHECK(node_type(doc, "words") == NULL);
+    CHECK(node_type(doc, "empty") == NULL);
+    up_block_t *server = &up_document_get(doc, "server")->value->as.block;
+    CHECK_STR(up_block_get(server, "tls-mode")->as.string.data, "x");
+    CHECK_STR(up_block_get_type(server, "_port"), "int");
+
+    // Everything imported can be written back as UP and exported again
+    char *text = up_document_to_string(doc, NULL);
+    CHECK(text != NULL);
+    up_document_t *again = text ? test_parse(text) : NULL;
+    if (again) {
+        CHECK(up_document_hash(again, 0) == up_document_hash(doc, 0));
+        up_document_free(again);
+    }
+    free(text);
+    up_document_free(doc);
+
+    // Escapes decode to the bytes they stand for
+    doc = from_json("{\"s\":\"a\\n\\t\\\"\\u00e9\\ud83d\\ude00\"}");
+    CHECK_STR(doc ? test_string(doc, "s") : NULL, "a\n\t\"\xc3\xa9\xf0\x9f\x98\x80");
+    up_document_free(doc);
+}
+
+// A failed import reports UP_ERROR_SYNTAX at `line` and `column`
+static void check_syntax_error(const char *json, size_t line, size_t column) {
+    up_document_t *doc = from_json(json);
+    CHECK(doc == NULL);
+    up_document_free(doc);
+    const up_error_t *error = up_last_error();
+    if (error->code != UP_ERROR_SYNTAX || error->line != line || error->column != column) {
+        fprintf(stderr, "%s: error %d at %zu:%zu (%s), expected syntax error at %zu:%zu\n", json,
+                (int)error->code, error->line, error->column, error->message, line, column);
+        test_failures++;
+    }
+}
+
+static void test_import_errors(void) {
+    check_syntax_error("", 1, 1);
+    check_syntax_error("[1]", 1, 1);
+    check_syntax_error("{\"a\":1,}", 1, 8);
+    check_syntax_error("{\n  \"a\": tru\n}", 2, 8);
+    check_syntax_error("{\"a\":01}", 1, 7);
+    check_syntax_error("{\"a\":\"x}", 1, 9);
+    check_syntax_error("{\"a\":1} x", 1, 9);
+
+    // Keys UP could not write back are refused at the key, not escaped
+    check_syntax_error("{\"a b\":1}", 1, 2);
+    check_syntax_error("{\"ok\":{\n\"x.y\":1}}", 2, 1);
+    check_syntax_error("{\"1k\":1}", 1, 2);
+    check_syntax_error("{\"-k\":1}", 1, 2);
+    check_syntax_error("{\"\":1}", 1, 2);
+    check_syntax_error("{\"a\\u0000b\":1}", 1, 2);
+    check_syntax_error("{\"k\\u00e9\":1}", 1, 2);
+
+    // Nesting stops at a fixed depth instead of exhausting the stack
+    char deep[2100];
+    size_t used = (size_t)snprintf(deep, sizeof(deep), "{\"a\":");
+    for (int i = 0; i < 1000; i++) {
+        deep[used++] = '[';
+    }
+    deep[used] = '\0';
+    up_document_t *doc = from_json(deep);
+    CHECK(doc == NULL && up_last_error()->code == UP_ERROR_SYNTAX);
+    CHECK(up_document_from_json(NULL, 0) == NULL && up_last_error()->code == UP_ERROR_ARGUMENT);
+}
+
+int main(void) {
+    RUN(test_compact_typed);
+    RUN(test_layouts);
+    RUN(test_escaping);
+    RUN(test_sink_failure);
+    RUN(test_import_types);
+    RUN(test_import_errors);
+    return test_report(__FILE__);
+}
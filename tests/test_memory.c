@@ -0,0 +1,74 @@
+/**
+ * Memory accounting tests (up_document_memory_stats)
+ */
+
+#include "test.h"
+
+static void test_counts(void) {
+    up_document_t *doc = test_parse("name abc\nserver {\n  host h\n  port!int 80\n}\nlist [x, y, z]\n");
+    if (!doc) {
+        return;
+    }
+    up_memory_stats_t stats;
+    up_document_memory_stats(doc, &stats);
+
+    CHECK(stats.node_count == 3);
+    CHECK(stats.value_counts[UP_TYPE_STRING] == 6);
+    CHECK(stats.value_counts[UP_TYPE_BLOCK] == 1);
+    CHECK(stats.value_counts[UP_TYPE_LIST] == 1);
+    CHECK(stats.value_bytes == 8 * sizeof(up_value_t));
+
+    // Keys and annotations: name server list host port int, each with NUL
+    CHECK(stats.key_bytes == 5 + 7 + 5 + 5 + 5 + 4);
+    // String payloads: abc h 80 x y z, each with NUL
+    CHECK(stats.string_bytes == 4 + 2 + 3 + 2 + 2 + 2);
+
+    CHECK(stats.total_bytes == stats.node_bytes + stats.value_bytes + stats.key_bytes +
+                               stats.string_bytes + stats.array_bytes + stats.slack_bytes +
+                               stats.index_bytes);
+    up_document_free(doc);
+}
+
+static void test_empty_and_null(void) {
+    up_document_t *doc = test_parse("");
+    if (!doc) {
+        return;
+    }
+    up_memory_stats_t stats;
+    up_document_memory_stats(doc, &stats);
+    CHECK(stats.node_count == 0);
+    CHECK(stats.value_bytes == 0 && stats.string_bytes == 0);
+    CHECK(stats.total_bytes == stats.node_bytes + stats.slack_bytes + stats.index_bytes);
+    up_document_free(doc);
+
+    // NULL documents report zeros instead of crashing
+    memset(&stats, 0xff, sizeof(stats));
+    up_document_memory_stats(NULL, &stats);
+    CHECK(stats.total_bytes == 0 && stats.node_count == 0);
+}
+
+static void test_indexes_are_counted(void) {
+    // A block past the hashed-scan threshold carries a key index
+    char text[1024] = "b {\n";
+    for (int i = 0; i < 40; i++) {
+        size_t used = strlen(text);
+        snprintf(text + used, sizeof(text) - used, "  k%d v\n", i);
+    }
+    strcat(text, "}\n");
+    up_document_t *doc = test_parse(text);
+    if (!doc) {
+        return;
+    }
+    up_memory_stats_t stats;
+    up_document_memory_stats(doc, &stats);
+    CHECK(stats.value_counts[UP_TYPE_STRING] == 40);
+    CHECK(stats.index_bytes > 0);
+    up_document_free(doc);
+}
+
+int main(void) {
+    RUN(test_counts);
+    RUN(test_empty_and_null);
+    RUN(test_indexes_are_counted);
+    return test_report(__FILE__);
+}
@@ -0,0 +1,178 @@
+/**
+ * Layered merge tests: overrides, annotations and key order, each list
+ * policy, structural sharing with both inputs, and overlays that must
+ * only be read
+ */
+
+#include "test.h"
+#include "up_internal.h"
+
+static up_document_t *merge_text(const char *base, const char *overlay, up_merge_policy_t policy) {
+    up_document_t *a = test_parse(base);
+    up_document_t *b = test_parse(overlay);
+    up_document_t *merged = a && b ? up_document_merge(a, b, policy) : NULL;
+    CHECK(merged != NULL);
+    up_document_free(a);
+    up_document_free(b);
+    return merged;
+}
+
+// The merge written back as UP text; the caller frees the result
+static char *merge_written(const char *base, const char *overlay, up_merge_policy_t policy) {
+    up_document_t *merged = merge_text(base, overlay, policy);
+    char *text = merged ? up_document_to_string(merged, NULL) : NULL;
+    up_document_free(merged);
+    return text;
+}
+
+static void test_overrides(void) {
+    char *text = merge_written("name app\nport!int 80\n"
+                               "server {\n  host a\n  tls {\n    on true\n  }\n}\nmode x\n",
+                               "extra 1\nport 8080\n"
+                               "server {\n  tls {\n    cert c.pem\n  }\n  host b\n}\n"
+                               "mode {\n  k v\n}\n",
+                               UP_MERGE_LIST_REPLACE);
+    // Base keys keep their order and overlay-only keys follow; an overlay
+    // without an annotation keeps the base one
+    CHECK_STR(text, "name app\nport!int 8080\nserver {\n  host b\n  tls {\n    on true\n"
+                    "    cert c.pem\n  }\n}\nmode {\n  k v\n}\nextra 1\n");
+    free(text);
+
+    text = merge_written("a!int 1\nb {\n  c!int 2\n}\n", "a!float 1.5\nb!cfg {\n  c!float 2.5\n}\n",
+                         UP_MERGE_LIST_REPLACE);
+    CHECK_STR(text, "a!float 1.5\nb!cfg {\n  c!float 2.5\n}\n");
+    free(text);
+
+    // A scalar or list over a block replaces it outright
+    text = merge_written("b {\n  c 1\n}\nl [x]\n", "b 2\nl {\n  k v\n}\n", UP_MERGE_LIST_APPEND);
+    CHECK_STR(text, "b 2\nl {\n  k v\n}\n");
+    free(text);
+
+    text = merge_written("", "a 1\n", UP_MERGE_LIST_REPLACE);
+    CHECK_STR(text, "a 1\n");
+    free(text);
+    text = merge_written("a 1\n", "", UP_MERGE_LIST_REPLACE);
+    CHECK_STR(text, "a 1\n");
+    free(text);
+}
+
+static void test_list_policies(void) {
+    const char *base = "l [a, b, c]\nrows [\n{\n  k 1\n  j 1\n}\n]\n";
+    const char *overlay = "l [x]\nrows [\n{\n  k 2\n}\n{\n  n 3\n}\n]\n";
+
+    char *text = merge_written(base, overlay, UP_MERGE_LIST_REPLACE);
+    CHECK_STR(text, "l [x]\nrows [\n  {\n    k 2\n  }\n  {\n    n 3\n  }\n]\n");
+    free(text);
+
+    text = merge_written(base, overlay, UP_MERGE_LIST_APPEND);
+    CHECK_STR(text, "l [a, b, c, x]\nrows [\n  {\n    k 1\n    j 1\n  }\n  {\n    k 2\n  }\n"
+                    "  {\n    n 3\n  }\n]\n");
+    free(text);
+
+    // Items merge by position, and the longer list keeps its tail
+    text = merge_written(base, overlay, UP_MERGE_LIST_BY_INDEX);
+    CHECK_STR(text, "l [x, b, c]\nrows [\n  {\n    k 2\n    j 1\n  }\n  {\n    n 3\n  }\n]\n");
+    free(text);
+}
+
+// Subtrees one side supplies unchanged are shared, and the result stays
+// valid and independent once both inputs are gone
+static void test_sharing(void) {
+    up_document_t *base = test_parse("keep {\n  a 1\n}\nboth {\n  x 1\n  y {\n    z 1\n  }\n}\n");
+    up_document_t *overlay = test_parse("both {\n  x 2\n}\nnew {\n  b 2\n}\n");
+    if (!base || !overlay) {
+        up_document_free(base);
+        up_document_free(overlay);
+        return;
+    }
+    up_document_t *merged = up_document_merge(base, overlay, UP_MERGE_LIST_REPLACE);
+    CHECK(merged != NULL);
+    if (!merged) {
+        up_document_free(base);
+        up_document_free(overlay);
+        return;
+    }
+    CHECK(up_document_get(merged, "keep") == up_document_get(base, "keep"));
+    CHECK(up_document_get(merged, "new") == up_document_get(overlay, "new"));
+    up_value_t *both = up_document_get(merged, "both")->value;
+    up_value_t *base_both = up_document_get(base, "both")->value;
+    CHECK(both != base_both);
+    CHECK(up_block_get(&both->as.block, "y") == up_block_get(&base_both->as.block, "y"));
+
+    // Editing the result leaves the base alone
+    up_value_t *keep = up_document_mutable(merged, "keep");
+    CHECK(keep != NULL);
+    if (keep) {
+        up_block_set(&keep->as.block, "a", up_value_new_string("changed"));
+    }
+    up_value_t *base_keep = up_document_get(base, "keep")->value;
+    CHECK_STR(up_block_get(&base_keep->as.block, "a")->as.string.data, "1");
+
+    up_document_free(base);
+    up_document_free(overlay);
+    char *text = up_document_to_string(merged, NULL);
+    CHECK_STR(text, "keep {\n  a changed\n}\nboth {\n  x 2\n  y {\n    z 1\n  }\n}\n"
+                    "new {\n  b 2\n}\n");
+    free(text);
+    up_document_free(merged);
+}
+
+// Lookups into the overlay never build or refresh its index, so a const
+// overlay is left exactly as it was
+static void test_overlay_read_only(void) {
+    char base_text[2048], overlay_text[2048];
+    size_t ub = 0, uo = 0;
+    for (int i = 0; i < 40; i++) {
+        ub += (size_t)snprintf(base_text + ub, sizeof(base_text) - ub, "k%d base\n", i);
+        if (i % 2) {
+            uo += (size_t)snprintf(overlay_text + uo, sizeof(overlay_text) - uo, "k%d over\n",
+                                   39 - i);
+        }
+    }
+    snprintf(overlay_text + uo, sizeof(overlay_text) - uo, "extra 1\n");
+
+    for (int freeze = 0; freeze < 2; freeze++) {
+        up_document_t *base = test_parse(base_text);
+        up_document_t *overlay = test_parse(overlay_text);
+        if (!base || !overlay) {
+            up_document_free(base);
+            up_document_free(overlay);
+            return;
+        }
+        if (freeze) {
+            up_document_freeze(overlay);
+        }
+        up_index_t *index = overlay->index;
+        size_t covered = index ? index->covered : 0;
+
+        up_document_t *merged = up_document_merge(base, overlay, UP_MERGE_LIST_REPLACE);
+        CHECK(merged && merged->count == 41);
+        CHECK(overlay->index == index && (!index || index->covered == covered));
+        if (merged) {
+            size_t wrong = 0;
+            char key[16];
+            for (int i = 0; i < 40; i++) {
+                snprintf(key, sizeof(key), "k%d", i);
+                if (strcmp(test_string(merged, key), i % 2 ? "base" : "over") != 0) {
+                    wrong++;
+                }
+            }
+            CHECK(wrong == 0);
+            CHECK_STR(merged->nodes[40]->key, "extra");
+        }
+        up_document_free(merged);
+        up_document_free(base);
+        up_document_free(overlay);
+    }
+
+    CHECK(up_document_merge(NULL, NULL, UP_MERGE_LIST_REPLACE) == NULL);
+    CHECK(up_last_error()->code == UP_ERROR_ARGUMENT);
+}
+
+int main(void) {
+    RUN(test_overrides);
+    RUN(test_list_policies);
+    RUN(test_sharing);
+    RUN(test_overlay_read_only);
+    return test_report(__FILE__);
+}
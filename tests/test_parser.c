@@ -0,0 +1,132 @@
+/**
+ * Parser tests: syntax, and reuse of one parser across many inputs
+ */
+
+#include "test.h"
+
+static void test_scalars_and_types(void) {
+    up_document_t *doc = test_parse("name John Doe\nage!int 30\n\n# comment\nempty\n");
+    if (!doc) {
+        return;
+    }
+    CHECK(doc->count == 3);
+    CHECK_STR(test_string(doc, "name"), "John Doe");
+    CHECK_STR(test_string(doc, "age"), "30");
+    CHECK_STR(up_document_get(doc, "age")->type_annotation, "int");
+    CHECK_STR(test_string(doc, "empty"), "");
+    CHECK(up_document_get(doc, "missing") == NULL);
+    up_document_free(doc);
+}
+
+static void test_nested_values(void) {
+    up_document_t *doc = test_parse("server {\n  host localhost\n  tls {\n    on!bool true\n  }\n}\n"
+                                    "items [\napple\n[1, 2]\n]\ninline [a, [b, c]]\n"
+                                    "text ```\nline one\n  line two\n```\n"
+                                    "rows {\n  [a, b]\n  [c, d]\n}\n");
+    if (!doc) {
+        return;
+    }
+    up_value_t *server = up_document_get(doc, "server")->value;
+    CHECK(server->type == UP_TYPE_BLOCK);
+    CHECK_STR(up_block_get(&server->as.block, "host")->as.string.data, "localhost");
+    up_value_t *tls = up_block_get(&server->as.block, "tls");
+    CHECK(tls && tls->type == UP_TYPE_BLOCK);
+    CHECK_STR(up_block_get_type(&tls->as.block, "on"), "bool");
+
+    up_value_t *items = up_document_get(doc, "items")->value;
+    CHECK(items->type == UP_TYPE_LIST && items->as.list.count == 2);
+    CHECK(items->as.list.items[1]->type == UP_TYPE_LIST);
+
+    up_value_t *inline_list = up_document_get(doc, "inline")->value;
+    CHECK(inline_list->as.list.count == 2);
+    CHECK(inline_list->as.list.items[1]->as.list.count == 2);
+
+    CHECK_STR(test_string(doc, "text"), "line one\n  line two\n");
+
+    up_value_t *rows = up_document_get(doc, "rows")->value;
+    CHECK(rows->type == UP_TYPE_LIST && rows->as.list.count == 2);
+    up_document_free(doc);
+}
+
+static void test_syntax_errors(void) {
+    const char *bad[] = {
+        "server {\n  host x\n",
+        "items [\na\n",
+        "text ```\nno fence\n",
+        "1abc value\n",
+        "key! value\n",
+        "ke@y value\n",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        up_document_t *doc = up_parse_string(bad[i]);
+        CHECK(doc == NULL);
+        CHECK(up_last_error()->code == UP_ERROR_SYNTAX);
+        up_document_free(doc);
+    }
+}
+
+static void test_parser_reuse(void) {
+    up_parser_t *parser = up_parser_new();
+    if (!parser) {
+        CHECK(parser != NULL);
+        return;
+    }
+
+    // A large input, then smaller ones: every result must only reflect its
+    // own input even though the buffers are recycled
+    char big[8192];
+    size_t used = 0;
+    for (int i = 0; i < 200; i++) {
+        used += (size_t)snprintf(big + used, sizeof(big) - used, "key%d value%d\n", i, i);
+    }
+    up_document_t *first = up_parser_parse_document(parser, big);
+    CHECK(first && first->count == 200);
+    size_t lines_capacity = parser->lines_capacity;
+    size_t buffer_capacity = parser->buffer_capacity;
+
+    up_document_t *second = up_parser_parse_document(parser, "a 1\nb ```\nx\n```\n");
+    CHECK(second && second->count == 2);
+    CHECK_STR(test_string(second, "b"), "x\n");
+    CHECK(parser->lines_capacity == lines_capacity);
+    CHECK(parser->buffer_capacity == buffer_capacity);
+
+    // Documents outlive the parser buffers they were parsed from
+    up_document_t *third = up_parser_parse_document(parser, "c 3\n");
+    CHECK_STR(test_string(first, "key199"), "value199");
+    CHECK_STR(test_string(second, "a"), "1");
+    CHECK(third && third->count == 1 && up_document_get(third, "a") == NULL);
+
+    // A failed parse leaves the parser usable
+    CHECK(up_parser_parse_document(parser, "x {\n") == NULL);
+    up_document_t *fourth = up_parser_parse_document(parser, "d 4\n");
+    CHECK_STR(test_string(fourth, "d"), "4");
+
+    up_parser_reset(parser);
+    CHECK(parser->line_count == 0);
+
+    up_document_free(first);
+    up_document_free(second);
+    up_document_free(third);
+    up_document_free(fourth);
+    up_parser_free(parser);
+}
+
+static void test_crlf_input(void) {
+    up_document_t *doc = test_parse("a 1\r\nb {\r\n  c 2\r\n}\r\n");
+    if (!doc) {
+        return;
+    }
+    CHECK_STR(test_string(doc, "a"), "1");
+    up_value_t *b = up_document_get(doc, "b")->value;
+    CHECK_STR(up_block_get(&b->as.block, "c")->as.string.data, "2");
+    up_document_free(doc);
+}
+
+int main(void) {
+    RUN(test_scalars_and_types);
+    RUN(test_nested_values);
+    RUN(test_syntax_errors);
+    RUN(test_parser_reuse);
+    RUN(test_crlf_input);
+    return test_report(__FILE__);
+}
@@ -0,0 +1,117 @@
+/**
+ * Compiled path tests: resolution, list indexes, the cached positions and
+ * syntax errors
+ */
+
+#include "test.h"
+
+static const char *PATH_INPUT =
+    "name app\n"
+    "server {\n  host localhost\n  tls {\n    cert a.pem\n  }\n}\n"
+    "upstreams [\n{\n  host one\n}\n{\n  host two\n}\n]\n"
+    "matrix [[1, 2], [3, 4]]\n";
+
+static const char *path_string(up_document_t *doc, const char *text) {
+    up_path_t *path = up_path_compile(text);
+    if (!path) {
+        fprintf(stderr, "compile '%s' failed: %s\n", text, up_get_error());
+        test_failures++;
+        return NULL;
+    }
+    up_value_t *value = up_path_get(doc, path);
+    up_path_free(path);
+    return value && value->type == UP_TYPE_STRING ? value->as.string.data : NULL;
+}
+
+static void test_resolve(void) {
+    up_document_t *doc = test_parse(PATH_INPUT);
+    if (!doc) {
+        return;
+    }
+    CHECK_STR(path_string(doc, "name"), "app");
+    CHECK_STR(path_string(doc, "server.host"), "localhost");
+    CHECK_STR(path_string(doc, "server.tls.cert"), "a.pem");
+    CHECK_STR(path_string(doc, "upstreams[1].host"), "two");
+    CHECK_STR(path_string(doc, "matrix[1][0]"), "3");
+
+    // Missing keys, indexes past the end and the wrong shape give NULL
+    CHECK(path_string(doc, "server.port") == NULL);
+    CHECK(path_string(doc, "upstreams[2].host") == NULL);
+    CHECK(path_string(doc, "name.first") == NULL);
+    CHECK(path_string(doc, "server[0]") == NULL);
+    CHECK(path_string(doc, "missing") == NULL);
+    CHECK(path_string(doc, "matrix[99999999999999999999]") == NULL);
+    up_document_free(doc);
+}
+
+// A compiled path is reused across documents whose keys sit at different
+// positions; the cached slot must be confirmed, never trusted
+static void test_cached_positions(void) {
+    up_document_t *first = test_parse("a 1\nb {\n  x 1\n  y 2\n}\n");
+    up_document_t *second = test_parse("b {\n  y 20\n  x 10\n}\na 10\n");
+    up_document_t *third = test_parse("c 1\n");
+    up_path_t *path = up_path_compile("b.y");
+    if (!first || !second || !third || !path) {
+        CHECK(path != NULL);
+        up_document_free(first);
+        up_document_free(second);
+        up_document_free(third);
+        up_path_free(path);
+        return;
+    }
+
+    for (int round = 0; round < 3; round++) {
+        up_value_t *value = up_path_get(first, path);
+        CHECK_STR(value ? value->as.string.data : NULL, "2");
+        value = up_path_get(second, path);
+        CHECK_STR(value ? value->as.string.data : NULL, "20");
+        CHECK(up_path_get(third, path) == NULL);
+    }
+
+    CHECK(up_path_get(NULL, path) == NULL);
+    CHECK(up_path_get(first, NULL) == NULL);
+    up_path_free(path);
+    up_document_free(first);
+    up_document_free(second);
+    up_document_free(third);
+}
+
+static void test_syntax_errors(void) {
+    const struct {
+        const char *path;
+        size_t column;
+    } bad[] = {
+        {"", 1},
+        {"a.", 3},
+        {".a", 1},
+        {"a..b", 3},
+        {"a[", 2},
+        {"a[]", 2},
+        {"a[-1]", 2},
+        {"a[+1]", 2},
+        {"a[1", 2},
+        {"a[1]b", 5},
+        {"a b", 2},
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        up_path_t *path = up_path_compile(bad[i].path);
+        CHECK(path == NULL);
+        const up_error_t *error = up_last_error();
+        if (error->code != UP_ERROR_SYNTAX || error->column != bad[i].column) {
+            fprintf(stderr, "'%s': code %d, column %zu\n", bad[i].path, (int)error->code, error->column);
+            test_failures++;
+        }
+        up_path_free(path);
+    }
+
+    CHECK(up_path_compile(NULL) == NULL);
+    CHECK(up_last_error()->code == UP_ERROR_ARGUMENT);
+    up_path_free(NULL);
+}
+
+int main(void) {
+    RUN(test_resolve);
+    RUN(test_cached_positions);
+    RUN(test_syntax_errors);
+    return test_report(__FILE__);
+}
@@ -0,0 +1,99 @@
+/**
+ * Freelist pool tests
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "test.h"
+#include "up_internal.h"
+
+#if defined(UP_POOL_DEBUG) && defined(__unix__)
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+static void test_reuse_same_size(void) {
+    void *a = up_pool_alloc(sizeof(up_value_t));
+    CHECK(a != NULL);
+    up_pool_free(a, sizeof(up_value_t));
+    void *b = up_pool_alloc(sizeof(up_value_t));
+#ifndef UP_NO_POOL
+    CHECK(a == b);
+#endif
+    up_pool_free(b, sizeof(up_value_t));
+    up_pool_trim();
+}
+
+static void test_calloc_clears_recycled(void) {
+    unsigned char *a = up_pool_alloc(16 * sizeof(void *));
+    memset(a, 0xab, 16 * sizeof(void *));
+    up_pool_free(a, 16 * sizeof(void *));
+    unsigned char *b = up_pool_calloc(16 * sizeof(void *));
+    bool zero = true;
+    for (size_t i = 0; i < 16 * sizeof(void *); i++) {
+        zero = zero && b[i] == 0;
+    }
+    CHECK(zero);
+    up_pool_free(b, 16 * sizeof(void *));
+}
+
+static void test_realloc_across_classes(void) {
+    // Pooled class to pooled class, then out to plain malloc and back
+    size_t sizes[] = {8 * sizeof(void *), 32 * sizeof(void *), 1000, 3000, 64 * sizeof(void *)};
+    size_t old_size = 8 * sizeof(void *);
+    unsigned char *block = up_pool_alloc(old_size);
+    memset(block, 7, old_size);
+    for (size_t i = 1; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        block = up_pool_realloc(block, old_size, sizes[i]);
+        CHECK(block != NULL);
+        size_t kept = old_size < sizes[i] ? old_size : sizes[i];
+        CHECK(block[0] == 7 && block[kept - 1] == 7);
+        memset(block, 7, sizes[i]);
+        old_size = sizes[i];
+    }
+    up_pool_free(block, old_size);
+}
+
+static void test_document_churn(void) {
+    // Many build/free cycles must keep reusing blocks without corrupting them
+    for (int round = 0; round < 50; round++) {
+        up_document_t *doc = test_parse("a {\n  b [1, 2, 3]\n  c {\n    d e\n  }\n}\nf g\n");
+        if (!doc) {
+            return;
+        }
+        up_value_t *a = up_document_get(doc, "a")->value;
+        CHECK_STR(up_block_get(&a->as.block, "b")->as.list.items[2]->as.string.data, "3");
+        up_document_free(doc);
+    }
+    up_pool_trim();
+}
+
+#if defined(UP_POOL_DEBUG) && defined(__unix__)
+// Debug builds abort on a free with the wrong size instead of corrupting
+// the freelists
+static void test_debug_catches_wrong_size(void) {
+    fflush(NULL);
+    pid_t child = fork();
+    if (child == 0) {
+        freopen("/dev/null", "w", stderr);
+        void *block = up_pool_alloc(16 * sizeof(void *));
+        up_pool_free(block, 8 * sizeof(void *));
+        _exit(0);
+    }
+    int status = 0;
+    CHECK(child > 0 && waitpid(child, &status, 0) == child);
+    CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+}
+#endif
+
+int main(void) {
+    RUN(test_reuse_same_size);
+    RUN(test_calloc_clears_recycled);
+    RUN(test_realloc_across_classes);
+    RUN(test_document_churn);
+#if defined(UP_POOL_DEBUG) && defined(__unix__)
+    RUN(test_debug_catches_wrong_size);
+#endif
+    return test_report(__FILE__);
+}
@@ -0,0 +1,135 @@
+/**
+ * Selector query tests: wildcards, filters, indexes and slices, including
+ * bounds at the edge of the long range
+ */
+
+#include "test.h"
+
+static const char *QUERY_INPUT =
+    "services [\n"
+    "{\n  name api\n  region eu\n  port 80\n}\n"
+    "{\n  name web\n  region us\n  port 81\n}\n"
+    "{\n  name db\n  region eu\n}\n"
+    "]\n"
+    "ports [1, 2, 3, 4, 5]\n"
+    "a {\n  tls on\n}\n"
+    "b {\n  tls off\n}\n"
+    "c plain\n";
+
+// Run `text` and join the string results with ',' into `out`
+static const char *query_join(up_document_t *doc, const char *text, char *out, size_t size) {
+    up_query_t *query = up_query_compile(text);
+    if (!query) {
+        fprintf(stderr, "compile '%s' failed: %s\n", text, up_get_error());
+        test_failures++;
+        return NULL;
+    }
+    up_query_result_t result = {0};
+    if (!up_query_run(query, doc, &result)) {
+        test_failures++;
+    }
+
+    size_t used = 0;
+    out[0] = '\0';
+    for (size_t i = 0; i < result.count && used < size; i++) {
+        const up_value_t *value = result.items[i];
+        used += (size_t)snprintf(out + used, size - used, "%s%s", i ? "," : "",
+                                 value->type == UP_TYPE_STRING ? value->as.string.data : "?");
+    }
+    up_query_result_free(&result);
+    up_query_free(query);
+    return out;
+}
+
+static void test_selectors(void) {
+    up_document_t *doc = test_parse(QUERY_INPUT);
+    if (!doc) {
+        return;
+    }
+    char out[256];
+    CHECK_STR(query_join(doc, "services[*].name", out, sizeof(out)), "api,web,db");
+    CHECK_STR(query_join(doc, "services[?(region == \"eu\")].name", out, sizeof(out)), "api,db");
+    CHECK_STR(query_join(doc, "services[?(region != eu)].port", out, sizeof(out)), "81");
+    CHECK_STR(query_join(doc, "services[?(missing == x)].name", out, sizeof(out)), "");
+    CHECK_STR(query_join(doc, "services.*.port", out, sizeof(out)), "80,81");
+    CHECK_STR(query_join(doc, "*.tls", out, sizeof(out)), "on,off");
+    CHECK_STR(query_join(doc, "c", out, sizeof(out)), "plain");
+    CHECK_STR(query_join(doc, "nothing.here", out, sizeof(out)), "");
+    CHECK_STR(query_join(doc, "c[0]", out, sizeof(out)), "");
+    up_document_free(doc);
+}
+
+static void test_indexes_and_slices(void) {
+    up_document_t *doc = test_parse(QUERY_INPUT);
+    if (!doc) {
+        return;
+    }
+    char out[256];
+    CHECK_STR(query_join(doc, "ports[0]", out, sizeof(out)), "1");
+    CHECK_STR(query_join(doc, "ports[-1]", out, sizeof(out)), "5");
+    CHECK_STR(query_join(doc, "ports[-5]", out, sizeof(out)), "1");
+    CHECK_STR(query_join(doc, "ports[-6]", out, sizeof(out)), "");
+    CHECK_STR(query_join(doc, "ports[5]", out, sizeof(out)), "");
+    CHECK_STR(query_join(doc, "ports[1:3]", out, sizeof(out)), "2,3");
+    CHECK_STR(query_join(doc, "ports[:2]", out, sizeof(out)), "1,2");
+    CHECK_STR(query_join(doc, "ports[-2:]", out, sizeof(out)), "4,5");
+    CHECK_STR(query_join(doc, "ports[:]", out, sizeof(out)), "1,2,3,4,5");
+    CHECK_STR(query_join(doc, "ports[3:1]", out, sizeof(out)), "");
+
+    // strtol saturates out-of-range numbers to LONG_MIN / LONG_MAX
+    CHECK_STR(query_join(doc, "ports[-9223372036854775808]", out, sizeof(out)), "");
+    CHECK_STR(query_join(doc, "ports[-99999999999999999999999]", out, sizeof(out)), "");
+    CHECK_STR(query_join(doc, "ports[99999999999999999999999]", out, sizeof(out)), "");
+    CHECK_STR(query_join(doc, "ports[-99999999999999999999999:2]", out, sizeof(out)), "1,2");
+    CHECK_STR(query_join(doc, "ports[3:99999999999999999999999]", out, sizeof(out)), "4,5");
+    up_document_free(doc);
+}
+
+static void test_result_reuse(void) {
+    up_document_t *doc = test_parse(QUERY_INPUT);
+    up_query_t *wide = up_query_compile("services[*].name");
+    up_query_t *narrow = up_query_compile("ports[0]");
+    if (!doc || !wide || !narrow) {
+        CHECK(wide && narrow);
+        up_document_free(doc);
+        up_query_free(wide);
+        up_query_free(narrow);
+        return;
+    }
+    up_query_result_t result = {0};
+    CHECK(up_query_run(wide, doc, &result) && result.count == 3);
+    CHECK(up_query_run(narrow, doc, &result) && result.count == 1);
+    CHECK_STR(result.items[0]->as.string.data, "1");
+    CHECK(up_query_run(wide, doc, &result) && result.count == 3);
+
+    CHECK(!up_query_run(NULL, doc, &result));
+    CHECK(up_last_error()->code == UP_ERROR_ARGUMENT);
+    up_query_result_free(&result);
+    up_query_free(wide);
+    up_query_free(narrow);
+    up_document_free(doc);
+}
+
+static void test_syntax_errors(void) {
+    const char *bad[] = {
+        "", ".a", "a.", "a[", "a[]", "a[1", "a[x]", "a[?x]", "a[?(k)]", "a[?(k == )]",
+        "a[?(k == \"open)]", "a[?(k == v]", "a b",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        up_query_t *query = up_query_compile(bad[i]);
+        if (query || up_last_error()->code != UP_ERROR_SYNTAX) {
+            fprintf(stderr, "'%s' was not a syntax error\n", bad[i]);
+            test_failures++;
+        }
+        up_query_free(query);
+    }
+    CHECK(up_query_compile(NULL) == NULL);
+}
+
+int main(void) {
+    RUN(test_selectors);
+    RUN(test_indexes_and_slices);
+    RUN(test_result_reuse);
+    RUN(test_syntax_errors);
+    return test_report(__FILE__);
+}
@@ -0,0 +1,174 @@
+/**
+ * Serializer round trips: parse -> write -> parse must give back the same
+ * tree, and writing that again the same text
+ */
+
+#include "test.h"
+#include "up_internal.h"
+
+// Write `doc`, parse the text back and compare structure and annotations
+// through the ordered hash. Returns the text for further checks, or NULL
+// if writing failed.
+static char *round_trip(const up_document_t *doc) {
+    size_t length = 0;
+    char *text = up_document_to_string(doc, &length);
+    if (!text) {
+        return NULL;
+    }
+    CHECK(strlen(text) == length);
+    up_document_t *again = up_parse_string(text);
+    if (!again) {
+        fprintf(stderr, "written text does not parse (%s):\n%s\n", up_get_error(), text);
+        test_failures++;
+        return text;
+    }
+    if (up_document_hash(again, 0) != up_document_hash(doc, 0)) {
+        fprintf(stderr, "round trip changed the document:\n%s\n", text);
+        test_failures++;
+    }
+
+    char *second = up_document_to_string(again, NULL);
+    CHECK(second && strcmp(second, text) == 0);
+    free(second);
+    up_document_free(again);
+    return text;
+}
+
+static void test_parsed_documents(void) {
+    const char *inputs[] = {
+        "name John Doe\nage!int 30\nempty\n",
+        "server {\n  host localhost\n  tls!cfg {\n    on!bool true\n  }\n  empty {\n  }\n}\n",
+        "items [\napple\n{\n  a 1\n}\n[1, 2]\n]\ninline [a, [b, c], []]\nnone []\n",
+        "rows {\n  [a, b]\n  [c, d]\n}\n",
+        "text ```\nline one\n  indented\n\n# not a comment\n```\n",
+        "deep {\n  a {\n    b {\n      c [\n      ```\n      x\n      ```\n      ]\n    }\n  }\n}\n",
+        "odd #hash value\nbrackets a[1]\ncomma a, b\n",
+        "",
+    };
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        up_document_t *doc = test_parse(inputs[i]);
+        if (!doc) {
+            continue;
+        }
+        free(round_trip(doc));
+        up_document_free(doc);
+    }
+}
+
+// Strings the plain form cannot hold must come back through a fence or a
+// multi-line list, byte for byte
+static void test_awkward_strings(void) {
+    const char *values[] = {
+        " leading\n", "trailing \n", "{\n", "[x]\n", "```x\n", "two\nlines\n", "\n", "\n\n",
+        "#\n", "]\n", "a,b", "x[1", "  ```  not a fence\n", "{x", "",
+    };
+    size_t count = sizeof(values) / sizeof(values[0]);
+    up_document_t *doc = test_parse("list [\n]\nblock {\n}\n");
+    if (!doc) {
+        return;
+    }
+    up_list_t *list = &up_document_get(doc, "list")->value->as.list;
+    up_block_t *block = &up_document_get(doc, "block")->value->as.block;
+    char key[16];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(key, sizeof(key), "k%zu", i);
+        up_block_set(block, key, up_value_new_string(values[i]));
+        CHECK(up_document_put(doc, key, NULL, up_value_new_string(values[i])));
+        if (*values[i]) {
+            up_list_append(list, up_value_new_string(values[i]));
+        }
+    }
+    char *text = round_trip(doc);
+    CHECK(text != NULL);
+    free(text);
+    up_document_free(doc);
+}
+
+static void test_unwritable(void) {
+    // Content with its own fence line, a CR before a newline, or text that
+    // needs a fence but would come back with a newline added
+    const char *bad[] = {"a\n```\nb\n", "a\r\nb\n", "a\r", " leading", "{", "[", "[x]", "two\nlines", "\t"};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        up_document_t *doc = test_parse("");
+        if (!doc) {
+            return;
+        }
+        CHECK(up_document_put(doc, "k", NULL, up_value_new_string(bad[i])));
+        CHECK(up_document_to_string(doc, NULL) == NULL);
+        CHECK(up_last_error()->code == UP_ERROR_FORMAT);
+        up_document_free(doc);
+    }
+
+    up_document_t *doc = test_parse("");
+    if (!doc) {
+        return;
+    }
+    CHECK(up_document_put(doc, "k", NULL, up_value_new_string_n("a\0b\nc", 5)));
+    CHECK(up_document_to_string(doc, NULL) == NULL);
+    up_document_free(doc);
+
+    // Keys and annotations outside the UP syntax
+    const char *keys[] = {"a b", "1k", "x.y", "-a"};
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        doc = test_parse("");
+        if (!doc) {
+            return;
+        }
+        CHECK(up_document_put(doc, keys[i], NULL, up_value_new_string("v")));
+        CHECK(up_document_to_string(doc, NULL) == NULL);
+        CHECK(up_last_error()->code == UP_ERROR_FORMAT);
+        up_document_free(doc);
+    }
+    doc = test_parse("");
+    if (doc) {
+        CHECK(up_document_put(doc, "k", "bad type", up_value_new_string("v")));
+        CHECK(up_document_to_string(doc, NULL) == NULL);
+        up_document_free(doc);
+    }
+}
+
+// Random strings over the characters the layout rules care about: every
+// one either round-trips exactly or is refused with UP_ERROR_FORMAT
+static void test_random_strings(void) {
+    static const char alphabet[] = "aabb #[]{},`\n\t";
+    unsigned state = 12345;
+    size_t refused = 0;
+    for (int round = 0; round < 2000; round++) {
+        char value[24];
+        state = state * 1103515245u + 12345u;
+        size_t length = (state >> 16) % (sizeof(value) - 1);
+        for (size_t i = 0; i < length; i++) {
+            state = state * 1103515245u + 12345u;
+            value[i] = alphabet[(state >> 16) % (sizeof(alphabet) - 1)];
+        }
+        if (length && round % 2) {
+            value[length - 1] = '\n';
+        }
+        value[length] = '\0';
+
+        up_document_t *doc = test_parse("list [\n]\n");
+        if (!doc) {
+            return;
+        }
+        CHECK(up_document_put(doc, "k", NULL, up_value_new_string(value)));
+        if (length) {
+            up_list_append(&up_document_get(doc, "list")->value->as.list, up_value_new_string(value));
+        }
+        char *text = round_trip(doc);
+        if (!text) {
+            CHECK(up_last_error()->code == UP_ERROR_FORMAT);
+            refused++;
+        }
+        free(text);
+        up_document_free(doc);
+    }
+    CHECK(refused < 1000);
+}
+
+int main(void) {
+    RUN(test_parsed_documents);
+    RUN(test_awkward_strings);
+    RUN(test_unwritable);
+    RUN(test_random_strings);
+    return test_report(__FILE__);
+}
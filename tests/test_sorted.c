@@ -0,0 +1,118 @@
+/**
+ * Sorted block tests: ordering, lookups and inserts in sorted mode, the
+ * parser option, and up_block_merge
+ */
+
+#include "test.h"
+
+static bool in_order(const up_block_t *block) {
+    for (size_t i = 1; i < block->count; i++) {
+        if (strcmp(block->keys[i - 1], block->keys[i]) >= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_sort_and_insert(void) {
+    up_document_t *doc = test_parse("b {\n  pear 1\n  apple!int 2\n  zoo 3\n  Mango 4\n  fig 5\n}\n");
+    if (!doc) {
+        return;
+    }
+    up_block_t *block = &up_document_get(doc, "b")->value->as.block;
+    CHECK(!block->sorted);
+    CHECK(up_block_sort(block));
+    CHECK(block->sorted && block->index == NULL && in_order(block));
+    CHECK_STR(block->keys[0], "Mango");
+    CHECK_STR(up_block_get(block, "apple")->as.string.data, "2");
+    CHECK_STR(up_block_get_type(block, "apple"), "int");
+    CHECK(up_block_get_type(block, "pear") == NULL);
+
+    // Inserts land in order; replacing keeps the count
+    up_block_set(block, "banana", up_value_new_string("6"));
+    up_block_set(block, "aaa", up_value_new_string("7"));
+    up_block_set(block, "zzz", up_value_new_string("8"));
+    up_block_set_typed(block, "fig", "float", up_value_new_string("5.5"));
+    CHECK(block->count == 8 && in_order(block));
+    CHECK_STR(up_block_get(block, "fig")->as.string.data, "5.5");
+    CHECK_STR(up_block_get_type(block, "fig"), "float");
+    CHECK_STR(up_block_get_type(block, "apple"), "int");
+    CHECK(up_block_get(block, "figs") == NULL);
+    CHECK(up_block_get(block, "") == NULL);
+
+    // Past the index threshold a sorted block still uses binary search
+    char key[16];
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "n%03d", 99 - i);
+        up_block_set(block, key, up_value_new_string(key));
+    }
+    CHECK(block->count == 108 && in_order(block) && block->index == NULL);
+    CHECK_STR(up_block_get(block, "n042")->as.string.data, "n042");
+    up_document_free(doc);
+}
+
+static void test_parser_option(void) {
+    up_parser_t *parser = up_parser_new();
+    if (!parser) {
+        CHECK(parser != NULL);
+        return;
+    }
+    parser->sorted_blocks = true;
+    up_document_t *doc = up_parser_parse_document(parser, "b {\n  c 1\n  a 2\n  inner {\n    z 1\n    y 2\n  }\n}\n");
+    CHECK(doc != NULL);
+    if (doc) {
+        up_value_t *b = up_document_get(doc, "b")->value;
+        CHECK(b->as.block.sorted && in_order(&b->as.block));
+        up_value_t *inner = up_block_get(&b->as.block, "inner");
+        CHECK(inner && inner->as.block.sorted && in_order(&inner->as.block));
+        up_document_free(doc);
+    }
+    up_parser_free(parser);
+}
+
+typedef struct {
+    char keys[256];
+    char sides[64];
+} visits_t;
+
+static void record(const char *key, up_value_t *a, up_value_t *b, void *context) {
+    visits_t *v = context;
+    size_t used = strlen(v->keys);
+    snprintf(v->keys + used, sizeof(v->keys) - used, "%s%s", used ? "," : "", key);
+    used = strlen(v->sides);
+    snprintf(v->sides + used, sizeof(v->sides) - used, "%c", a && b ? 'B' : a ? 'A' : 'b');
+}
+
+static void test_merge_walk(void) {
+    up_document_t *doc = test_parse("a {\n  k2 1\n  k1 1\n  k5 1\n}\nb {\n  k3 2\n  k1 2\n  k6 2\n  k5 2\n}\n"
+                                    "empty {\n}\n");
+    if (!doc) {
+        return;
+    }
+    up_block_t *a = &up_document_get(doc, "a")->value->as.block;
+    up_block_t *b = &up_document_get(doc, "b")->value->as.block;
+    up_block_t *empty = &up_document_get(doc, "empty")->value->as.block;
+
+    visits_t v = {"", ""};
+    CHECK(!up_block_merge(a, b, record, &v));
+    CHECK(up_last_error()->code == UP_ERROR_ARGUMENT);
+    CHECK(up_block_sort(a) && up_block_sort(b) && up_block_sort(empty));
+
+    CHECK(up_block_merge(a, b, record, &v));
+    CHECK_STR(v.keys, "k1,k2,k3,k5,k6");
+    CHECK_STR(v.sides, "BAbBb");
+
+    visits_t w = {"", ""};
+    CHECK(up_block_merge(empty, a, record, &w));
+    CHECK_STR(w.keys, "k1,k2,k5");
+    CHECK_STR(w.sides, "bbb");
+    CHECK(!up_block_merge(a, b, NULL, NULL));
+    up_document_free(doc);
+}
+
+int main(void) {
+    RUN(test_sort_and_insert);
+    RUN(test_parser_option);
+    RUN(test_merge_walk);
+    return test_report(__FILE__);
+}
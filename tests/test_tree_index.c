@@ -0,0 +1,218 @@
+/**
+ * Whole-tree index tests: reverse value lookups over every string scalar,
+ * and path prefix queries
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include "test.h"
+#include <pthread.h>
+
+static const char *TREE_INPUT =
+    "region eu\n"
+    "services {\n  web {\n    region eu\n    host web.local\n  }\n  db {\n    region us\n  }\n}\n"
+    "upstreams [\neu\n{\n  region eu\n}\n[us, eu]\n]\n"
+    "empty\n";
+
+// Paths for `value` joined with ','; for values with a single path
+static const char *find_joined(up_document_t *doc, const char *value, char *out, size_t size) {
+    const char *const *paths = NULL;
+    size_t count = up_document_find_value(doc, value, &paths);
+    size_t used = 0;
+    out[0] = '\0';
+    for (size_t i = 0; i < count && used < size; i++) {
+        used += (size_t)snprintf(out + used, size - used, "%s%s", i ? "," : "", paths[i]);
+    }
+    return out;
+}
+
+static bool has_path(up_document_t *doc, const char *value, const char *path) {
+    const char *const *paths = NULL;
+    size_t count = up_document_find_value(doc, value, &paths);
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(paths[i], path) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void test_requires_frozen(void) {
+    up_document_t *doc = test_parse(TREE_INPUT);
+    if (!doc) {
+        return;
+    }
+    CHECK(!up_document_index_values(doc));
+    CHECK(up_last_error()->code == UP_ERROR_ARGUMENT);
+    const char *const *paths = NULL;
+    CHECK(up_document_find_value(doc, "eu", &paths) == 0);
+    up_document_free(doc);
+}
+
+static void test_find_value(void) {
+    up_document_t *doc = test_parse(TREE_INPUT);
+    if (!doc) {
+        return;
+    }
+    up_document_freeze(doc);
+    CHECK(up_document_index_values(doc));
+    CHECK(up_document_index_values(doc));
+
+    const char *const *paths = NULL;
+    CHECK(up_document_find_value(doc, "eu", &paths) == 5);
+    CHECK(has_path(doc, "eu", "region"));
+    CHECK(has_path(doc, "eu", "services.web.region"));
+    CHECK(has_path(doc, "eu", "upstreams[0]"));
+    CHECK(has_path(doc, "eu", "upstreams[1].region"));
+    CHECK(has_path(doc, "eu", "upstreams[2][1]"));
+
+    char out[256];
+    CHECK(up_document_find_value(doc, "us", &paths) == 2);
+    CHECK_STR(find_joined(doc, "web.local", out, sizeof(out)), "services.web.host");
+    CHECK_STR(find_joined(doc, "", out, sizeof(out)), "empty");
+    CHECK(up_document_find_value(doc, "e", &paths) == 0);
+    CHECK(up_document_find_value(doc, "eux", &paths) == 0);
+    CHECK(up_document_find_value(doc, NULL, &paths) == 0);
+
+    // The index is part of the document's memory
+    up_memory_stats_t stats;
+    up_document_memory_stats(doc, &stats);
+    CHECK(stats.index_bytes > 0);
+    up_document_free(doc);
+}
+
+// Many distinct values: every one resolves to exactly its own path
+static void test_many_values(void) {
+    char text[16384];
+    size_t used = (size_t)snprintf(text, sizeof(text), "items [\n");
+    for (int i = 0; i < 500; i++) {
+        used += (size_t)snprintf(text + used, sizeof(text) - used, "value%d\n", i);
+    }
+    snprintf(text + used, sizeof(text) - used, "]\n");
+    up_document_t *doc = test_parse(text);
+    if (!doc) {
+        return;
+    }
+    up_document_freeze(doc);
+    CHECK(up_document_index_values(doc));
+
+    size_t wrong = 0;
+    char value[32], path[32];
+    for (int i = 0; i < 500; i++) {
+        snprintf(value, sizeof(value), "value%d", i);
+        snprintf(path, sizeof(path), "items[%d]", i);
+        const char *const *paths = NULL;
+        if (up_document_find_value(doc, value, &paths) != 1 || strcmp(paths[0], path) != 0) {
+            wrong++;
+        }
+    }
+    CHECK(wrong == 0);
+    up_document_free(doc);
+}
+
+static const char *PREFIX_INPUT =
+    "server {\n  tls {\n    cert a.pem\n  }\n  tlsx 1\n  tls-mode strict\n  TLS old\n}\n"
+    "servers [x, y]\n"
+    "server2 z\n";
+
+// Paths under `prefix` joined with ','
+static const char *prefix_joined(up_document_t *doc, const char *prefix, char *out, size_t size) {
+    const char *const *paths = NULL;
+    const up_value_t *const *values = NULL;
+    size_t count = up_document_find_prefix(doc, prefix, &paths, &values);
+    size_t used = 0;
+    out[0] = '\0';
+    for (size_t i = 0; i < count && used < size; i++) {
+        used += (size_t)snprintf(out + used, size - used, "%s%s", i ? "," : "", paths[i]);
+    }
+    return out;
+}
+
+static void test_find_prefix(void) {
+    up_document_t *doc = test_parse(PREFIX_INPUT);
+    if (!doc) {
+        return;
+    }
+    CHECK(!up_document_index_paths(doc));
+    up_document_freeze(doc);
+    CHECK(up_document_index_paths(doc));
+
+    // A prefix stops at key boundaries: "tls" is not a prefix of "tlsx",
+    // "tls-mode" or (bytewise) anything that sorts in between
+    char out[512];
+    CHECK_STR(prefix_joined(doc, "server.tls", out, sizeof(out)), "server.tls,server.tls.cert");
+    CHECK_STR(prefix_joined(doc, "server.tls.", out, sizeof(out)), "server.tls.cert");
+    CHECK_STR(prefix_joined(doc, "server.tls.cert", out, sizeof(out)), "server.tls.cert");
+    CHECK_STR(prefix_joined(doc, "servers", out, sizeof(out)), "servers,servers[0],servers[1]");
+    CHECK_STR(prefix_joined(doc, "servers[", out, sizeof(out)), "servers[0],servers[1]");
+    CHECK_STR(prefix_joined(doc, "server", out, sizeof(out)),
+              "server,server.TLS,server.tls,server.tls.cert,server.tls-mode,server.tlsx");
+    CHECK_STR(prefix_joined(doc, "server.tl", out, sizeof(out)), "");
+    CHECK_STR(prefix_joined(doc, "nothing", out, sizeof(out)), "");
+
+    // The empty prefix lists everything, each path before those under it
+    CHECK_STR(prefix_joined(doc, "", out, sizeof(out)),
+              "server,server.TLS,server.tls,server.tls.cert,server.tls-mode,server.tlsx,"
+              "server2,servers,servers[0],servers[1]");
+
+    const char *const *paths = NULL;
+    const up_value_t *const *values = NULL;
+    CHECK(up_document_find_prefix(doc, "server.tls", &paths, &values) == 2);
+    CHECK(values[0]->type == UP_TYPE_BLOCK);
+    CHECK(values[1]->type == UP_TYPE_STRING && strcmp(values[1]->as.string.data, "a.pem") == 0);
+    CHECK(up_document_find_prefix(doc, "server", &paths, NULL) == 6);
+    CHECK(up_document_find_prefix(doc, NULL, &paths, NULL) == 0);
+    up_document_free(doc);
+}
+
+typedef struct {
+    up_document_t *doc;
+    size_t found;
+} build_job_t;
+
+static void *build_thread(void *arg) {
+    build_job_t *job = arg;
+    const char *const *paths = NULL;
+    if (up_document_index_values(job->doc)) {
+        job->found = up_document_find_value(job->doc, "eu", &paths);
+    }
+    if (up_document_index_paths(job->doc)) {
+        job->found += up_document_find_prefix(job->doc, "services", &paths, NULL);
+    }
+    up_pool_trim();
+    return NULL;
+}
+
+// Threads racing to build the indexes of one shared frozen document all
+// end up using the same finished ones, and nothing leaks
+static void test_concurrent_build(void) {
+    for (int round = 0; round < 20; round++) {
+        up_document_t *doc = test_parse(TREE_INPUT);
+        if (!doc) {
+            return;
+        }
+        up_document_freeze(doc);
+
+        enum { THREADS = 8 };
+        pthread_t threads[THREADS];
+        build_job_t jobs[THREADS];
+        for (int i = 0; i < THREADS; i++) {
+            jobs[i].doc = doc;
+            jobs[i].found = 0;
+            CHECK(pthread_create(&threads[i], NULL, build_thread, &jobs[i]) == 0);
+        }
+        for (int i = 0; i < THREADS; i++) {
+            pthread_join(threads[i], NULL);
+            CHECK(jobs[i].found == 5 + 6);
+        }
+        up_document_free(doc);
+    }
+}
+
+int main(void) {
+    RUN(test_requires_frozen);
+    RUN(test_find_value);
+    RUN(test_many_values);
+    RUN(test_find_prefix);
+    RUN(test_concurrent_build);
+    return test_report(__FILE__);
+}
@@ -0,0 +1,253 @@
+/**
+ * Streaming writer tests: the text each call produces, its agreement with
+ * up_document_write, misuse and unwritable values, and sink failures
+ */
+
+#include "test.h"
+
+// Sink collecting output into a growing buffer
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    size_t calls;
+    bool fail;              // Refuse every write
+} buffer_t;
+
+static bool buffer_write(void *context, const char *data, size_t length) {
+    buffer_t *b = context;
+    if (b->fail) {
+        return false;
+    }
+    b->calls++;
+    if (b->length + length + 1 > b->capacity) {
+        size_t capacity = (b->length + length + 1) * 2;
+        char *grown = realloc(b->data, capacity);
+        if (!grown) {
+            return false;
+        }
+        b->data = grown;
+        b->capacity = capacity;
+    }
+    memcpy(b->data + b->length, data, length);
+    b->length += length;
+    b->data[b->length] = '\0';
+    return true;
+}
+
+static void test_output(void) {
+    buffer_t b = {0};
+    up_sink_t sink = {buffer_write, &b};
+    up_writer_t *w = up_writer_new(sink);
+    if (!w) {
+        CHECK(w != NULL);
+        return;
+    }
+    const char *row1[] = {"a", "b"};
+    const char *row2[] = {"c", "d"};
+    CHECK(up_writer_key(w, "name", NULL) && up_writer_scalar(w, "app"));
+    CHECK(up_writer_key(w, "port", "int") && up_writer_scalar(w, "8080"));
+    CHECK(up_writer_key(w, "empty", NULL) && up_writer_scalar(w, ""));
+    CHECK(up_writer_key(w, "server", NULL) && up_writer_begin_block(w));
+    CHECK(up_writer_key(w, "host", NULL) && up_writer_scalar(w, " padded\n"));
+    CHECK(up_writer_end_block(w));
+    CHECK(up_writer_key(w, "items", NULL) && up_writer_begin_list(w));
+    CHECK(up_writer_scalar(w, "x") && up_writer_scalar(w, "#hash\n"));
+    CHECK(up_writer_begin_block(w) && up_writer_key(w, "k", NULL) && up_writer_scalar(w, "v"));
+    CHECK(up_writer_end_block(w) && up_writer_end_list(w));
+    CHECK(up_writer_key(w, "rows", NULL) && up_writer_begin_table(w));
+    CHECK(up_writer_table_row(w, row1, 2) && up_writer_table_row(w, row2, 2));
+    CHECK(up_writer_end_table(w));
+    CHECK(up_writer_key(w, "none", NULL) && up_writer_begin_table(w) && up_writer_end_table(w));
+    CHECK(up_writer_key(w, "text", NULL) && up_writer_multiline(w, "one\ntwo"));
+    CHECK(up_writer_close(w));
+
+    CHECK_STR(b.data, "name app\nport!int 8080\nempty\nserver {\n  host ```\n padded\n  ```\n}\n"
+                      "items [\n  x\n  ```\n#hash\n  ```\n  {\n    k v\n  }\n]\n"
+                      "rows {\n  [a, b]\n  [c, d]\n}\nnone []\ntext ```\none\ntwo\n```\n");
+
+    // The same text as up_document_write gives for what it parses to
+    up_document_t *doc = b.data ? test_parse(b.data) : NULL;
+    if (doc) {
+        char *again = up_document_to_string(doc, NULL);
+        CHECK_STR(again, b.data);
+        up_block_t *server = &up_document_get(doc, "server")->value->as.block;
+        CHECK_STR(up_block_get(server, "host")->as.string.data, " padded\n");
+        CHECK_STR(test_string(doc, "text"), "one\ntwo\n");
+        free(again);
+        up_document_free(doc);
+    }
+    free(b.data);
+}
+
+// Deep nesting grows the frame stack
+static void test_nesting(void) {
+    buffer_t b = {0};
+    up_sink_t sink = {buffer_write, &b};
+    up_writer_t *w = up_writer_new(sink);
+    if (!w) {
+        CHECK(w != NULL);
+        return;
+    }
+    for (int i = 0; i < 40; i++) {
+        CHECK(up_writer_key(w, "a", NULL) && up_writer_begin_block(w));
+    }
+    CHECK(up_writer_key(w, "leaf", NULL) && up_writer_scalar(w, "1"));
+    for (int i = 0; i < 40; i++) {
+        CHECK(up_writer_end_block(w));
+    }
+    CHECK(up_writer_close(w));
+    up_document_t *doc = b.data ? test_parse(b.data) : NULL;
+    if (doc) {
+        up_value_t *value = up_document_get(doc, "a")->value;
+        for (int i = 1; i < 40 && value; i++) {
+            value = up_block_get(&value->as.block, "a");
+        }
+        CHECK(value && strcmp(up_block_get(&value->as.block, "leaf")->as.string.data, "1") == 0);
+        up_document_free(doc);
+    }
+    free(b.data);
+}
+
+typedef bool (*misuse_fn)(up_writer_t *w);
+
+static bool value_without_key(up_writer_t *w) {
+    return up_writer_scalar(w, "x");
+}
+
+static bool key_twice(up_writer_t *w) {
+    return up_writer_key(w, "a", NULL) && up_writer_key(w, "b", NULL);
+}
+
+static bool key_in_list(up_writer_t *w) {
+    return up_writer_key(w, "a", NULL) && up_writer_begin_list(w) && up_writer_key(w, "b", NULL);
+}
+
+static bool wrong_end(up_writer_t *w) {
+    return up_writer_key(w, "a", NULL) && up_writer_begin_list(w) && up_writer_end_block(w);
+}
+
+static bool end_at_top(up_writer_t *w) {
+    return up_writer_end_block(w);
+}
+
+static bool row_outside_table(up_writer_t *w) {
+    const char *cells[] = {"a"};
+    return up_writer_key(w, "a", NULL) && up_writer_begin_list(w) &&
+           up_writer_table_row(w, cells, 1);
+}
+
+static bool value_in_table(up_writer_t *w) {
+    return up_writer_key(w, "a", NULL) && up_writer_begin_table(w) && up_writer_scalar(w, "x");
+}
+
+static void test_misuse(void) {
+    misuse_fn cases[] = {value_without_key, key_twice, key_in_list, wrong_end, end_at_top,
+                         row_outside_table, value_in_table};
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        buffer_t b = {0};
+        up_sink_t sink = {buffer_write, &b};
+        up_writer_t *w = up_writer_new(sink);
+        if (!w) {
+            CHECK(w != NULL);
+            return;
+        }
+        CHECK(!cases[i](w));
+        CHECK(up_last_error()->code == UP_ERROR_ARGUMENT);
+        // The failure latches
+        CHECK(!up_writer_key(w, "z", NULL));
+        CHECK(!up_writer_close(w));
+        free(b.data);
+    }
+
+    // Left open at close
+    buffer_t b = {0};
+    up_sink_t sink = {buffer_write, &b};
+    up_writer_t *w = up_writer_new(sink);
+    CHECK(w && up_writer_key(w, "a", NULL) && up_writer_begin_block(w));
+    CHECK(!up_writer_close(w));
+    CHECK(up_last_error()->code == UP_ERROR_ARGUMENT);
+    w = up_writer_new(sink);
+    CHECK(w && up_writer_key(w, "a", NULL));
+    CHECK(!up_writer_close(w));
+    free(b.data);
+
+    up_sink_t none = {NULL, NULL};
+    CHECK(up_writer_new(none) == NULL);
+    CHECK(!up_writer_key(NULL, "a", NULL));
+    CHECK(!up_writer_close(NULL));
+}
+
+// Values UP text cannot hold fail with UP_ERROR_FORMAT before anything of
+// them is written
+static void test_unwritable(void) {
+    const char *scalars[] = {"two\nlines", " leading", "{", "[x]", "a\r\nb\n", "a\n```\nb\n"};
+    for (size_t i = 0; i < sizeof(scalars) / sizeof(scalars[0]); i++) {
+        buffer_t b = {0};
+        up_sink_t sink = {buffer_write, &b};
+        up_writer_t *w = up_writer_new(sink);
+        if (!w) {
+            CHECK(w != NULL);
+            return;
+        }
+        CHECK(up_writer_key(w, "k", NULL) && up_writer_flush(w));
+        CHECK(!up_writer_scalar(w, scalars[i]));
+        CHECK(up_last_error()->code == UP_ERROR_FORMAT);
+        CHECK(!up_writer_close(w));
+        CHECK_STR(b.data, "k");
+        free(b.data);
+    }
+
+    // An empty list item has no plain or fenced form
+    buffer_t b = {0};
+    up_sink_t sink = {buffer_write, &b};
+    up_writer_t *w = up_writer_new(sink);
+    CHECK(w && up_writer_key(w, "l", NULL) && up_writer_begin_list(w));
+    CHECK(!up_writer_scalar(w, "") && up_last_error()->code == UP_ERROR_FORMAT);
+    up_writer_close(w);
+
+    const char *keys[] = {"a b", "1k", "x.y", ""};
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        w = up_writer_new(sink);
+        CHECK(w && !up_writer_key(w, keys[i], NULL));
+        CHECK(up_last_error()->code == UP_ERROR_FORMAT);
+        up_writer_close(w);
+    }
+    w = up_writer_new(sink);
+    CHECK(w && !up_writer_key(w, "k", "bad type"));
+    up_writer_close(w);
+
+    const char *cells[] = {"a", "b,c"};
+    w = up_writer_new(sink);
+    CHECK(w && up_writer_key(w, "t", NULL) && up_writer_begin_table(w));
+    CHECK(!up_writer_table_row(w, cells, 2) && up_last_error()->code == UP_ERROR_FORMAT);
+    up_writer_close(w);
+    CHECK(!up_writer_multiline(NULL, "x"));
+    free(b.data);
+}
+
+static void test_sink_failure(void) {
+    buffer_t b = {0};
+    b.fail = true;
+    up_sink_t sink = {buffer_write, &b};
+    up_writer_t *w = up_writer_new(sink);
+    if (!w) {
+        CHECK(w != NULL);
+        return;
+    }
+    CHECK(up_writer_key(w, "a", NULL) && up_writer_scalar(w, "1"));
+    CHECK(!up_writer_flush(w));
+    CHECK(up_last_error()->code == UP_ERROR_IO);
+    CHECK(!up_writer_key(w, "b", NULL));
+    CHECK(!up_writer_close(w));
+    CHECK(b.calls == 0);
+}
+
+int main(void) {
+    RUN(test_output);
+    RUN(test_nesting);
+    RUN(test_misuse);
+    RUN(test_unwritable);
+    RUN(test_sink_failure);
+    return test_report(__FILE__);
+}
@@ -8,12 +8,18 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 // Forward declarations
 typedef struct up_value up_value_t;
 typedef struct up_node up_node_t;
 typedef struct up_document up_document_t;
 typedef struct up_parser up_parser_t;
+typedef struct up_index up_index_t;
+typedef struct up_value_index up_value_index_t;
+typedef struct up_path_index up_path_index_t;
+typedef struct up_path up_path_t;
+typedef struct up_query up_query_t;
 
 // Value types
 typedef enum {
@@ -22,6 +28,8 @@ typedef enum {
     UP_TYPE_LIST
 } up_value_type_t;
 
+#define UP_VALUE_TYPE_COUNT (UP_TYPE_LIST + 1)
+
 // String value
 typedef struct {
     char *data;
@@ -29,11 +37,20 @@ typedef struct {
 } up_string_t;
 
 // Block value (key-value map)
+// The arrays in blocks and lists belong to the library: they come from
+// per-thread pools that must get them back at their exact capacity, so
+// read them freely but change them only through the up_* calls, never
+// with realloc or free.
 typedef struct {
     char **keys;
     up_value_t **values;
+    uint32_t *hashes;       // Per-key hash prefixes, parallel to keys (internal)
+    char **types;           // Per-key type annotations; NULL until one is set
     size_t count;
     size_t capacity;
+    bool frozen;            // Set by up_document_freeze
+    bool sorted;            // Keys kept in strcmp order (up_block_sort)
+    up_index_t *index;      // Key index once the block is large (internal)
 } up_block_t;
 
 // List value
@@ -41,11 +58,17 @@ typedef struct {
     up_value_t **items;
     size_t count;
     size_t capacity;
+    bool frozen;            // Set by up_document_freeze
 } up_list_t;
 
 // Value (tagged union)
+// Subtrees can be shared between documents; `refs` counts the owners
+// beyond the first, so a value is only mutable while it is zero.
 struct up_value {
     up_value_type_t type;
+    size_t refs;
+    uint64_t hash_cache[2];     // Frozen containers' up_value_hash results,
+                                // 0 until computed (internal)
     union {
         up_string_t string;
         up_block_t block;
@@ -58,6 +81,7 @@ struct up_node {
     char *key;
     char *type_annotation;  // NULL if no type
     up_value_t *value;
+    size_t refs;            // Owners beyond the first (see up_value_t)
 };
 
 // Document (collection of nodes)
@@ -65,33 +89,209 @@ struct up_document {
     up_node_t **nodes;
     size_t count;
     size_t capacity;
+    bool frozen;            // Set by up_document_freeze
+    up_index_t *index;      // Key index, built on demand (internal)
+    up_value_index_t *value_index;  // See up_document_index_values
+    up_path_index_t *path_index;    // See up_document_index_paths
+    uint64_t hash_cache[2];         // As in up_value_t, once frozen
 };
 
+// Memory accounting (requested sizes, excluding allocator overhead)
+typedef struct {
+    size_t node_bytes;      // up_node_t structs and the document node array
+    size_t value_bytes;     // up_value_t structs
+    size_t key_bytes;       // Node/block keys and type annotations
+    size_t string_bytes;    // String payloads, including terminators
+    size_t array_bytes;     // Used slots of block and list arrays
+    size_t slack_bytes;     // Unused (capacity - count) slots in all arrays
+    size_t index_bytes;     // Lookup indexes
+    size_t total_bytes;
+    size_t node_count;
+    size_t value_counts[UP_VALUE_TYPE_COUNT];  // Indexed by up_value_type_t
+} up_memory_stats_t;
+
+// Query results: borrowed pointers into the queried document. Zero-init
+// before first use; reuse across runs, then release the buffers with
+// up_query_result_free.
+typedef struct {
+    up_value_t **items;
+    size_t count;
+    size_t capacity;
+    up_value_t **scratch;   // Second frontier buffer (internal)
+    size_t scratch_capacity;
+} up_query_result_t;
+
+// What the parser does when a document or block repeats a key
+typedef enum {
+    UP_DUPLICATES_LAST_WINS,    // Later values replace earlier ones (default)
+    UP_DUPLICATES_FIRST_WINS,   // Later values are dropped
+    UP_DUPLICATES_ERROR,        // Parsing fails at the first repeat
+    UP_DUPLICATES_COLLECT       // Last wins, and every repeat is recorded
+} up_duplicate_policy_t;
+
+// A repeated key recorded under UP_DUPLICATES_COLLECT
+typedef struct {
+    char *key;
+    size_t line;            // Line of the repeat
+} up_duplicate_t;
+
+// Errors. Every failing call records an up_error_t for the calling
+// thread, so concurrent parses never see each other's errors. Positions
+// are 1-based; line is 0 for errors not tied to any input text.
+typedef enum {
+    UP_OK,
+    UP_ERROR_MEMORY,            // Allocation failed
+    UP_ERROR_ARGUMENT,          // NULL or inconsistent arguments, misuse
+    UP_ERROR_FROZEN,            // Mutation of a frozen document
+    UP_ERROR_SYNTAX,            // Malformed UP, JSON, path or query text
+    UP_ERROR_DUPLICATE_KEY,     // Repeated key under UP_DUPLICATES_ERROR
+    UP_ERROR_IO,                // A file or sink failed
+    UP_ERROR_FORMAT             // Invalid binary image, or data the output
+                                // format cannot represent
+} up_error_code_t;
+
+typedef struct up_error {
+    up_error_code_t code;
+    size_t line;
+    size_t column;          // In bytes
+    size_t offset;          // Bytes from the start of the input
+    const char *message;    // Without the position; never NULL
+} up_error_t;
+
 // Parser state
+// The line table and buffers are scratch space owned by the parser; they
+// keep their capacity across parses so a reused parser stops allocating
+// once it has seen its largest input.
 struct up_parser {
     const char **lines;
     size_t line_count;
     size_t current_line;
+    size_t lines_capacity;
+    char *buffer;            // Mutable copy of the input, split into lines
+    size_t buffer_capacity;
+    char *scratch;           // Multiline content accumulator
+    size_t scratch_length;
+    size_t scratch_capacity;
+    bool sorted_blocks;      // Option: parse every block with up_block_sort
+    up_duplicate_policy_t duplicate_policy;  // Option: repeated keys
+    up_duplicate_t *duplicates;              // Repeats seen by the last parse
+    size_t duplicate_count;
+    size_t duplicate_capacity;
+    up_error_t error;        // Outcome of the last parse (up_parser_get_error)
+    char *error_text;        // Owns error.message
+    size_t error_capacity;
 };
 
 // API functions
 up_parser_t *up_parser_new(void);
 void up_parser_free(up_parser_t *parser);
+void up_parser_reset(up_parser_t *parser);
 
 up_document_t *up_parse(const char *input);
 up_document_t *up_parse_string(const char *input);
 up_document_t *up_parser_parse_document(up_parser_t *parser, const char *input);
+up_document_t *up_parse_file(const char *path);
 
+// The calling thread's last error. up_get_error gives its message with
+// the position in front ("Line 3, column 5: expected key"). Both stay
+// valid until the thread's next failing call.
+const up_error_t *up_last_error(void);
 const char *up_get_error(void);
+
+// Error of the last parse through `parser`, kept until its next parse;
+// code is UP_OK if that parse succeeded
+const up_error_t *up_parser_get_error(const up_parser_t *parser);
+
 up_node_t *up_document_get(up_document_t *doc, const char *key);
+size_t up_document_get_many(up_document_t *doc, const char *const *keys, size_t n, up_node_t **out);
 
 void up_document_free(up_document_t *doc);
 bool up_document_is_empty(const up_document_t *doc);
 size_t up_document_size(const up_document_t *doc);
+void up_document_memory_stats(const up_document_t *doc, up_memory_stats_t *stats);
+
+// Make a document permanently read-only. Once frozen, every read call
+// (up_document_get, up_block_get, walking nodes/keys/items) is safe from
+// any number of threads without locking, and mutators refuse to run.
+void up_document_freeze(up_document_t *doc);
+bool up_document_is_frozen(const up_document_t *doc);
+
+// Reverse lookup: which key paths hold a given string. The index is built
+// once per frozen document and freed with it. Building it while other
+// threads read the document is safe: racing builds keep one index, and
+// lookups see either none or a finished one.
+bool up_document_index_values(up_document_t *doc);
+size_t up_document_find_value(const up_document_t *doc, const char *value, const char *const **paths);
+
+// Prefix queries over full key paths: "server.tls" finds that path and the
+// paths under it, but not "server.tlsx". Like the value index, built once
+// per frozen document and safe to build while the document is shared.
+bool up_document_index_paths(up_document_t *doc);
+size_t up_document_find_prefix(const up_document_t *doc, const char *prefix,
+                               const char *const **paths, const up_value_t *const **values);
 
 void up_node_free(up_node_t *node);
 void up_value_free(up_value_t *value);
 
+// Structural hashes over the parsed tree, so formatting and comments never
+// matter. Keys, annotations and values count, and so does key order unless
+// UP_HASH_UNORDERED is passed. Frozen documents cache the hash of every
+// container after the first call, so later calls on unchanged subtrees
+// cost O(1).
+enum {
+    UP_HASH_UNORDERED = 1   // Blocks with the same entries in any order match
+};
+
+uint64_t up_value_hash(const up_value_t *value, unsigned flags);
+uint64_t up_document_hash(const up_document_t *doc, unsigned flags);
+
+// Structural diff from `a` to `b`. `visit` gets one call per differing
+// leaf path ("server.port", "upstreams[2]"), with NULL for the side a
+// path is missing from; a key whose annotation or kind of value changed
+// is reported once, without descending. Freeze both documents to skip
+// unchanged subtrees by their cached hashes.
+typedef enum {
+    UP_DIFF_ADDED,
+    UP_DIFF_REMOVED,
+    UP_DIFF_CHANGED
+} up_diff_kind_t;
+
+typedef void (*up_diff_fn)(up_diff_kind_t kind, const char *path, const up_value_t *old_value,
+                           const up_value_t *new_value, void *context);
+bool up_diff(const up_document_t *a, const up_document_t *b, up_diff_fn visit, void *context);
+
+// Copy-on-write sharing. Clones share every node and value with the
+// original; the *_mutable calls unshare one level at a time, so editing a
+// key copies only the path leading to it. Reference counts are not atomic:
+// do not clone or free documents sharing subtrees from several threads.
+up_value_t *up_value_retain(up_value_t *value);
+up_document_t *up_document_clone(const up_document_t *doc);
+up_value_t *up_document_mutable(up_document_t *doc, const char *key);
+up_value_t *up_block_mutable(up_block_t *block, const char *key);
+
+// Layered merge. up_document_merge lays `overlay` over `base` in a new
+// document: blocks merge key by key, lists follow the policy, and any
+// other overlay value (or annotation) replaces the base one. The result
+// shares every subtree it takes unchanged from either input, so both
+// sharing rules above apply to it. Lookups never build or change the
+// overlay's key index, but sharing bumps the non-atomic reference counts
+// of both inputs even though they are const, frozen or not: merges that
+// share a base or overlay must run on one thread at a time.
+typedef enum {
+    UP_MERGE_LIST_REPLACE,  // The overlay list replaces the base list
+    UP_MERGE_LIST_APPEND,   // Base items, then overlay items
+    UP_MERGE_LIST_BY_INDEX  // Items merge by position; the longer list's tail is kept
+} up_merge_policy_t;
+
+up_document_t *up_document_merge(const up_document_t *base, const up_document_t *overlay,
+                                 up_merge_policy_t policy);
+
+// Values, nodes and small arrays are recycled through per-thread freelists.
+// Nothing releases them when a thread exits: call this before then to hand
+// its cached blocks (and a long last error message) back to malloc, or
+// they leak.
+void up_pool_trim(void);
+
 // Value constructors
 up_value_t *up_value_new_string(const char *str);
 up_value_t *up_value_new_block(void);
@@ -99,9 +299,146 @@ up_value_t *up_value_new_list(void);
 
 // Block operations
 void up_block_set(up_block_t *block, const char *key, up_value_t *value);
+void up_block_set_typed(up_block_t *block, const char *key, const char *type, up_value_t *value);
 up_value_t *up_block_get(const up_block_t *block, const char *key);
+const char *up_block_get_type(const up_block_t *block, const char *key);
+size_t up_block_get_many(const up_block_t *block, const char *const *keys, size_t n, up_value_t **out);
+
+// Sorted blocks trade the hash index for binary search and deterministic
+// key order. up_block_merge visits the union of two sorted blocks in one
+// linear pass, passing NULL for the side missing a key.
+typedef void (*up_block_merge_fn)(const char *key, up_value_t *a, up_value_t *b, void *context);
+bool up_block_sort(up_block_t *block);
+bool up_block_merge(const up_block_t *a, const up_block_t *b, up_block_merge_fn visit, void *context);
 
 // List operations
 void up_list_append(up_list_t *list, up_value_t *value);
 
+// Compiled paths ("server.tls.cert", "upstreams[3].host"). A compiled path
+// caches where each key matched last, so it must not be shared between
+// threads; compile one per thread for concurrent readers.
+up_path_t *up_path_compile(const char *path);
+up_value_t *up_path_get(up_document_t *doc, up_path_t *path);
+void up_path_free(up_path_t *path);
+
+// Selector queries: "upstreams[*].host", "servers[1:3]",
+// "services[?(region == \"eu\")].port". Compiled queries are read-only,
+// so several threads can run one over a frozen document, each with its
+// own result.
+up_query_t *up_query_compile(const char *query);
+bool up_query_run(const up_query_t *query, up_document_t *doc, up_query_result_t *result);
+void up_query_result_free(up_query_result_t *result);
+void up_query_free(up_query_t *query);
+
+// Output goes through a sink: `write` receives the text in consecutive
+// chunks and returns false to abort. up_sink_file writes to the FILE *
+// passed as context.
+typedef struct {
+    bool (*write)(void *context, const char *data, size_t length);
+    void *context;
+} up_sink_t;
+
+bool up_sink_file(void *context, const char *data, size_t length);
+
+// Write a document as canonical UP text: two-space indentation, inline
+// lists where every item allows it, tables for lists of rows and fenced
+// multiline strings for text that cannot stay on one line. Parsing the
+// output yields the same document (comments are not kept). Fenced text
+// always reads back ending in a newline, so a string that needs a fence
+// but lacks one fails with UP_ERROR_FORMAT. The string variant returns a
+// malloc'd NUL-terminated copy.
+bool up_document_write(const up_document_t *doc, up_sink_t sink);
+char *up_document_to_string(const up_document_t *doc, size_t *length);
+
+// Streaming writer: emits UP text value by value, without building a
+// document. In a block (or at the top level) write a key, then its value;
+// in a list write values directly. Output is buffered and passed to the
+// sink in large chunks. up_writer_scalar picks the layout the way
+// up_document_write does, so a string that needs a fence but does not end
+// in a newline fails with UP_ERROR_FORMAT; up_writer_multiline always
+// fences and ends the text with a newline. After any failure every call
+// returns false, and up_writer_close reports whether the whole output was
+// written.
+typedef struct up_writer up_writer_t;
+
+up_writer_t *up_writer_new(up_sink_t sink);
+bool up_writer_key(up_writer_t *writer, const char *key, const char *type);
+bool up_writer_scalar(up_writer_t *writer, const char *value);
+bool up_writer_multiline(up_writer_t *writer, const char *text);
+bool up_writer_begin_block(up_writer_t *writer);
+bool up_writer_end_block(up_writer_t *writer);
+bool up_writer_begin_list(up_writer_t *writer);
+bool up_writer_end_list(up_writer_t *writer);
+bool up_writer_begin_table(up_writer_t *writer);
+bool up_writer_table_row(up_writer_t *writer, const char *const *cells, size_t count);
+bool up_writer_end_table(up_writer_t *writer);
+bool up_writer_flush(up_writer_t *writer);
+bool up_writer_close(up_writer_t *writer);
+
+// JSON export. Scalars annotated !int, !float or !bool become JSON numbers
+// and booleans when their text is a valid JSON literal, and empty !null
+// scalars become null; list items take the annotation of their list.
+// Pass NULL for compact, typed output.
+typedef struct {
+    bool pretty;            // Two-space indentation instead of compact output
+    bool plain_scalars;     // Keep typed scalars as JSON strings
+    bool stream;            // One {"key":value} line per top-level entry,
+                            // each passed to the sink when complete
+} up_json_options_t;
+
+bool up_document_to_json(const up_document_t *doc, up_sink_t sink, const up_json_options_t *opts);
+
+// Build a document from a JSON object. Numbers, booleans and null become
+// scalars annotated !int, !float, !bool and !null (null as an empty
+// string); an array whose items share one of these types passes it to the
+// key holding it, with ints widening to float. Keys must be valid UP keys
+// (a letter or '_', then letters, digits, '_' or '-') so the document can
+// be written back as UP; any other key fails with UP_ERROR_SYNTAX at its
+// position rather than being escaped.
+up_document_t *up_document_from_json(const char *buf, size_t len);
+
+// Binary documents (UPB). up_document_save_binary writes a compact image
+// with interned keys, pre-parsed !int/!float/!bool scalars and a hash
+// index per block; up_document_open_binary maps it read-only and serves
+// every read straight from the mapping, with no parsing or allocation.
+// Values are handles into the image whose offset is 0 when missing.
+// up_bvalue_type fails for a missing value or a damaged record, and
+// strings and names that overrun the image or lack their NUL read as
+// missing, so a corrupt image cannot be read past its end.
+typedef struct up_binary up_binary_t;
+
+typedef struct {
+    const up_binary_t *binary;
+    uint32_t offset;
+} up_bvalue_t;
+
+bool up_document_save_binary(const up_document_t *doc, const char *path);
+const up_binary_t *up_document_open_binary(const char *path);
+void up_binary_close(const up_binary_t *binary);
+up_bvalue_t up_binary_root(const up_binary_t *binary);
+up_bvalue_t up_binary_get(const up_binary_t *binary, const char *key);
+
+bool up_bvalue_type(up_bvalue_t value, up_value_type_t *type);
+const char *up_bvalue_string(up_bvalue_t value, size_t *length);
+bool up_bvalue_int(up_bvalue_t value, int64_t *out);
+bool up_bvalue_float(up_bvalue_t value, double *out);
+bool up_bvalue_bool(up_bvalue_t value, bool *out);
+size_t up_bvalue_count(up_bvalue_t value);
+up_bvalue_t up_bvalue_at(up_bvalue_t value, size_t i);
+const char *up_bvalue_key_at(up_bvalue_t value, size_t i);
+const char *up_bvalue_type_at(up_bvalue_t value, size_t i);
+up_bvalue_t up_bvalue_get(up_bvalue_t value, const char *key);
+
+// Opt-in compiled cache for UP files. The first load of a given text
+// parses it and saves a UPB image keyed by a hash of the text and the
+// format version; later loads of unchanged text map that image instead of
+// parsing. Only images owned by the current user and not writable by
+// group or others are used; the cache directory is created 0700. Release
+// the result with up_binary_close.
+typedef struct {
+    const char *cache_dir;  // NULL keeps a "<file>.upb" sidecar instead
+} up_cache_options_t;
+
+const up_binary_t *up_load_cached(const char *path, const up_cache_options_t *opts);
+
 #endif // UP_H
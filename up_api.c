@@ -1,112 +1,1950 @@
 /**
  * UP API implementation
- * Stub implementations for missing functions
+ * Line-based parser and value helpers
  */
 
 #include "up.h"
+#include "up_internal.h"
+#include <errno.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Global error message
-static char error_message[256] = "";
+// Last error of each thread. Messages that fit are formatted into `inline`
+// so failing calls need no allocation; longer ones move to `heap`, which
+// stays allocated for the thread's next error. `text` is what
+// up_get_error returns: the message behind its "Line N, column M: "
+// prefix, if any.
+typedef struct {
+    up_error_t error;
+    const char *text;
+    char *heap;
+    size_t heap_capacity;
+    char inline_text[256];
+} up_error_state_t;
+
+static _Thread_local up_error_state_t last_error;
 
 // Stub lexer function (required by yacc/bison)
 int yylex(void) {
     return 0; // EOF
 }
 
-// Parse a string and return a document
-up_document_t *up_parse_string(const char *input) {
-    (void)input; // Unused for now
+static void error_record(up_error_code_t code, size_t line, size_t column, size_t offset,
+                         const char *format, va_list args) {
+    char prefix[64];
+    int prefix_length = line ? snprintf(prefix, sizeof(prefix), "Line %zu, column %zu: ", line, column) : 0;
+
+    va_list measure;
+    va_copy(measure, args);
+    int message_length = vsnprintf(NULL, 0, format, measure);
+    va_end(measure);
+
+    size_t needed = (size_t)prefix_length + (size_t)(message_length > 0 ? message_length : 0) + 1;
+    char *text = last_error.inline_text;
+    size_t capacity = sizeof(last_error.inline_text);
+    if (needed > capacity) {
+        if (needed > last_error.heap_capacity) {
+            char *heap = realloc(last_error.heap, needed);
+            if (heap) {
+                last_error.heap = heap;
+                last_error.heap_capacity = needed;
+            }
+        }
+        // Without room on the heap the message is truncated instead
+        if (needed <= last_error.heap_capacity) {
+            text = last_error.heap;
+            capacity = last_error.heap_capacity;
+        }
+    }
+
+    memcpy(text, prefix, (size_t)prefix_length);
+    vsnprintf(text + prefix_length, capacity - (size_t)prefix_length, format, args);
+
+    last_error.error.code = code;
+    last_error.error.line = line;
+    last_error.error.column = column;
+    last_error.error.offset = offset;
+    last_error.error.message = text + prefix_length;
+    last_error.text = text;
+}
+
+void up_set_error(up_error_code_t code, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    error_record(code, 0, 0, 0, format, args);
+    va_end(args);
+}
+
+void up_set_error_at(up_error_code_t code, size_t line, size_t column, size_t offset,
+                     const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    error_record(code, line, column, offset, format, args);
+    va_end(args);
+}
+
+void up_error_release(void) {
+    free(last_error.heap);
+    last_error.heap = NULL;
+    last_error.heap_capacity = 0;
+    if (last_error.text && last_error.text != last_error.inline_text) {
+        last_error.text = NULL;
+        last_error.error.message = NULL;
+    }
+}
+
+static char *up_strndup(const char *str, size_t length) {
+    char *copy = malloc(length + 1);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// Grow `array` so it holds at least `needed` elements of `size` bytes.
+// Returns the (possibly moved) array, or NULL with the original untouched.
+static void *grow_array(void *array, size_t *capacity, size_t needed, size_t size) {
+    if (needed <= *capacity) {
+        return array;
+    }
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 8;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+
+    void *grown = up_pool_realloc(array, *capacity * size, new_capacity * size);
+    if (grown) {
+        *capacity = new_capacity;
+    }
+    return grown;
+}
+
+/* ---- Parser ---- */
+
+up_parser_t *up_parser_new(void) {
+    up_parser_t *parser = calloc(1, sizeof(up_parser_t));
+    if (!parser) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+    parser->error.message = "";
+    return parser;
+}
+
+void up_parser_free(up_parser_t *parser) {
+    if (!parser) {
+        return;
+    }
+
+    up_pool_free((void *)parser->lines, parser->lines_capacity * sizeof(*parser->lines));
+    free(parser->buffer);
+    up_pool_free(parser->scratch, parser->scratch_capacity);
+    up_parser_reset(parser);
+    up_pool_free(parser->duplicates, parser->duplicate_capacity * sizeof(*parser->duplicates));
+    free(parser->error_text);
+    free(parser);
+}
+
+// Forget the previous input but keep every scratch allocation
+void up_parser_reset(up_parser_t *parser) {
+    if (!parser) {
+        return;
+    }
+
+    parser->line_count = 0;
+    parser->current_line = 0;
+    parser->scratch_length = 0;
+    for (size_t i = 0; i < parser->duplicate_count; i++) {
+        free(parser->duplicates[i].key);
+    }
+    parser->duplicate_count = 0;
+}
+
+// Record a parse error at `at`, a position within input line
+// `line_number`, or at the line's first non-blank character if NULL
+static void parser_error(const up_parser_t *parser, up_error_code_t code, size_t line_number,
+                         const char *at, const char *format, ...) {
+    size_t column = 1, offset = 0;
+    if (line_number && line_number <= parser->line_count) {
+        const char *line = parser->lines[line_number - 1];
+        if (!at) {
+            at = line;
+            while (*at == ' ' || *at == '\t') {
+                at++;
+            }
+        }
+        column = (size_t)(at - line) + 1;
+        offset = (size_t)(at - parser->buffer);
+    }
+
+    va_list args;
+    va_start(args, format);
+    error_record(code, line_number, column, offset, format, args);
+    va_end(args);
+}
+
+// Apply the parser's duplicate-key policy to `key`, seen again on `line`.
+// Returns false if parsing must stop; *replace says whether the new value
+// takes the place of the earlier one.
+static bool handle_duplicate(up_parser_t *parser, const char *key, size_t line, bool *replace) {
+    switch (parser->duplicate_policy) {
+        case UP_DUPLICATES_ERROR:
+            parser_error(parser, UP_ERROR_DUPLICATE_KEY, line, NULL, "duplicate key '%s'", key);
+            return false;
+        case UP_DUPLICATES_FIRST_WINS:
+            *replace = false;
+            return true;
+        case UP_DUPLICATES_COLLECT: {
+            up_duplicate_t *duplicates = grow_array(parser->duplicates, &parser->duplicate_capacity,
+                                                    parser->duplicate_count + 1, sizeof(*duplicates));
+            char *copy = duplicates ? up_strndup(key, strlen(key)) : NULL;
+            if (!copy) {
+                if (duplicates) {
+                    parser->duplicates = duplicates;
+                }
+                up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+                return false;
+            }
+            parser->duplicates = duplicates;
+            parser->duplicates[parser->duplicate_count].key = copy;
+            parser->duplicates[parser->duplicate_count].line = line;
+            parser->duplicate_count++;
+            *replace = true;
+            return true;
+        }
+        case UP_DUPLICATES_LAST_WINS:
+        default:
+            *replace = true;
+            return true;
+    }
+}
+
+// Copy the input into the parser buffer and split it into lines in place
+static bool parser_load(up_parser_t *parser, const char *input) {
+    size_t length = strlen(input);
+    if (length + 1 > parser->buffer_capacity) {
+        char *buffer = realloc(parser->buffer, length + 1);
+        if (!buffer) {
+            return false;
+        }
+        parser->buffer = buffer;
+        parser->buffer_capacity = length + 1;
+    }
+    memcpy(parser->buffer, input, length + 1);
+
+    char *cursor = parser->buffer;
+    while (*cursor) {
+        if (parser->line_count == parser->lines_capacity) {
+            const char **lines = grow_array((void *)parser->lines, &parser->lines_capacity,
+                                            parser->line_count + 1, sizeof(*lines));
+            if (!lines) {
+                return false;
+            }
+            parser->lines = lines;
+        }
+        parser->lines[parser->line_count++] = cursor;
+
+        char *newline = strchr(cursor, '\n');
+        char *end = newline ? newline : cursor + strlen(cursor);
+        if (end > cursor && end[-1] == '\r') {
+            end[-1] = '\0';
+        }
+        if (!newline) {
+            break;
+        }
+        *newline = '\0';
+        cursor = newline + 1;
+    }
+
+    return true;
+}
+
+static bool scratch_append(up_parser_t *parser, const char *data, size_t length) {
+    size_t needed = parser->scratch_length + length + 1;
+    char *scratch = grow_array(parser->scratch, &parser->scratch_capacity, needed, 1);
+    if (!scratch) {
+        return false;
+    }
+    parser->scratch = scratch;
+    memcpy(parser->scratch + parser->scratch_length, data, length);
+    parser->scratch_length += length;
+    return true;
+}
+
+static const char *skip_space(const char *str) {
+    while (*str == ' ' || *str == '\t') {
+        str++;
+    }
+    return str;
+}
+
+static size_t trimmed_length(const char *str, size_t length) {
+    while (length && (str[length - 1] == ' ' || str[length - 1] == '\t')) {
+        length--;
+    }
+    return length;
+}
+
+// True if the line is exactly `token`, ignoring surrounding whitespace
+static bool line_is(const char *line, const char *token) {
+    line = skip_space(line);
+    size_t length = strlen(token);
+    return strncmp(line, token, length) == 0 && *skip_space(line + length) == '\0';
+}
+
+static bool is_blank_or_comment(const char *line) {
+    line = skip_space(line);
+    return *line == '\0' || *line == '#';
+}
+
+static bool is_key_start(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static bool is_key_char(char c) {
+    return is_key_start(c) || (c >= '0' && c <= '9') || c == '-';
+}
+
+up_value_t *up_value_new_string_n(const char *str, size_t length) {
+    up_value_t *value = up_pool_alloc(sizeof(up_value_t));
+    if (!value) {
+        return NULL;
+    }
+    value->type = UP_TYPE_STRING;
+    value->refs = 0;
+    value->hash_cache[0] = value->hash_cache[1] = 0;
+    value->as.string.data = up_strndup(str, length);
+    value->as.string.length = length;
+    if (!value->as.string.data) {
+        up_pool_free(value, sizeof(up_value_t));
+        return NULL;
+    }
+    return value;
+}
+
+static up_value_t *parse_value(up_parser_t *parser, const char *text, size_t length);
+static void block_index_sync(up_block_t *block);
+
+// Parse the inside of "[a, b, [c, d]]" (without the outer brackets)
+static up_value_t *parse_inline_list(const char *text, size_t length) {
+    up_value_t *list = up_value_new_list();
+    if (!list) {
+        return NULL;
+    }
+
+    const char *start = skip_space(text);
+    const char *end = text + length;
+    if (start >= end) {
+        return list;
+    }
+
+    int depth = 0;
+    const char *item = start;
+    for (const char *cursor = start; cursor <= end; cursor++) {
+        if (cursor < end && *cursor == '[') {
+            depth++;
+        } else if (cursor < end && *cursor == ']') {
+            depth--;
+        } else if (cursor == end || (*cursor == ',' && depth == 0)) {
+            item = skip_space(item);
+            size_t item_length = trimmed_length(item, (size_t)(cursor - item));
+            up_value_t *value;
+            if (item_length >= 2 && item[0] == '[' && item[item_length - 1] == ']') {
+                value = parse_inline_list(item + 1, item_length - 2);
+            } else {
+                value = up_value_new_string_n(item, item_length);
+            }
+            if (!value) {
+                up_value_free(list);
+                return NULL;
+            }
+            up_list_append(&list->as.list, value);
+            item = cursor + 1;
+        }
+    }
+
+    return list;
+}
+
+// Multiline content runs until a line holding only the closing fence
+static up_value_t *parse_multiline(up_parser_t *parser) {
+    size_t start_line = parser->current_line;
+    parser->scratch_length = 0;
+
+    while (parser->current_line < parser->line_count) {
+        const char *line = parser->lines[parser->current_line++];
+        if (line_is(line, "```")) {
+            return up_value_new_string_n(parser->scratch ? parser->scratch : "", parser->scratch_length);
+        }
+        if (!scratch_append(parser, line, strlen(line)) || !scratch_append(parser, "\n", 1)) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            return NULL;
+        }
+    }
+
+    parser_error(parser, UP_ERROR_SYNTAX, start_line, NULL, "unterminated multiline block");
+    return NULL;
+}
+
+// Parse "key[!type] value" from a single line; the caller owns the results
+static bool parse_statement(up_parser_t *parser, const char *line,
+                            char **key, char **type, up_value_t **value) {
+    size_t line_number = parser->current_line;
+    const char *cursor = skip_space(line);
+
+    if (!is_key_start(*cursor)) {
+        parser_error(parser, UP_ERROR_SYNTAX, line_number, cursor, "expected key");
+        return false;
+    }
+    const char *key_start = cursor;
+    while (is_key_char(*cursor)) {
+        cursor++;
+    }
+    size_t key_length = (size_t)(cursor - key_start);
+
+    const char *type_start = NULL;
+    size_t type_length = 0;
+    if (*cursor == '!') {
+        type_start = ++cursor;
+        while (is_key_char(*cursor)) {
+            cursor++;
+        }
+        type_length = (size_t)(cursor - type_start);
+        if (type_length == 0) {
+            parser_error(parser, UP_ERROR_SYNTAX, line_number, cursor, "expected type after '!'");
+            return false;
+        }
+    }
+
+    if (*cursor && *cursor != ' ' && *cursor != '\t') {
+        parser_error(parser, UP_ERROR_SYNTAX, line_number, cursor, "unexpected character '%c' in key", *cursor);
+        return false;
+    }
+
+    *key = up_strndup(key_start, key_length);
+    *type = type_start ? up_strndup(type_start, type_length) : NULL;
+    if (!*key || (type_start && !*type)) {
+        free(*key);
+        free(*type);
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return false;
+    }
+
+    const char *text = skip_space(cursor);
+    *value = parse_value(parser, text, trimmed_length(text, strlen(text)));
+    if (!*value) {
+        free(*key);
+        free(*type);
+        return false;
+    }
+
+    return true;
+}
+
+// Table rows are a block body made of bracketed lines with no keys
+static up_value_t *parse_rows(up_parser_t *parser, size_t start_line) {
+    up_value_t *rows = up_value_new_list();
+    if (!rows) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+
+    while (parser->current_line < parser->line_count) {
+        const char *line = skip_space(parser->lines[parser->current_line++]);
+        if (is_blank_or_comment(line)) {
+            continue;
+        }
+        if (line_is(line, "}")) {
+            return rows;
+        }
+
+        size_t length = trimmed_length(line, strlen(line));
+        if (length < 2 || line[0] != '[' || line[length - 1] != ']') {
+            parser_error(parser, UP_ERROR_SYNTAX, parser->current_line, line, "expected table row");
+            up_value_free(rows);
+            return NULL;
+        }
+        up_value_t *row = parse_inline_list(line + 1, length - 2);
+        if (!row) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            up_value_free(rows);
+            return NULL;
+        }
+        up_list_append(&rows->as.list, row);
+    }
+
+    parser_error(parser, UP_ERROR_SYNTAX, start_line, NULL, "unterminated block");
+    up_value_free(rows);
+    return NULL;
+}
+
+static up_value_t *parse_block(up_parser_t *parser) {
+    size_t start_line = parser->current_line;
+
+    for (size_t i = parser->current_line; i < parser->line_count; i++) {
+        if (!is_blank_or_comment(parser->lines[i])) {
+            if (*skip_space(parser->lines[i]) == '[') {
+                return parse_rows(parser, start_line);
+            }
+            break;
+        }
+    }
+
+    up_value_t *block = up_value_new_block();
+    if (!block) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+
+    while (parser->current_line < parser->line_count) {
+        const char *line = parser->lines[parser->current_line++];
+        if (is_blank_or_comment(line)) {
+            continue;
+        }
+        if (line_is(line, "}")) {
+            if (parser->sorted_blocks && !up_block_sort(&block->as.block)) {
+                up_value_free(block);
+                return NULL;
+            }
+            return block;
+        }
+
+        char *key, *type;
+        up_value_t *value;
+        size_t line_number = parser->current_line;
+        if (!parse_statement(parser, line, &key, &type, &value)) {
+            up_value_free(block);
+            return NULL;
+        }
+
+        bool replace = true;
+        up_block_t *entries = &block->as.block;
+        if (up_block_find(entries, key, up_hash_string(key)) < entries->count &&
+            !handle_duplicate(parser, key, line_number, &replace)) {
+            free(key);
+            free(type);
+            up_value_free(value);
+            up_value_free(block);
+            return NULL;
+        }
+        if (replace) {
+            up_block_set_typed(entries, key, type, value);
+        } else {
+            up_value_free(value);
+        }
+        free(key);
+        free(type);
+    }
+
+    parser_error(parser, UP_ERROR_SYNTAX, start_line, NULL, "unterminated block");
+    up_value_free(block);
+    return NULL;
+}
+
+static up_value_t *parse_list(up_parser_t *parser) {
+    size_t start_line = parser->current_line;
+
+    up_value_t *list = up_value_new_list();
+    if (!list) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+
+    while (parser->current_line < parser->line_count) {
+        const char *line = skip_space(parser->lines[parser->current_line++]);
+        if (is_blank_or_comment(line)) {
+            continue;
+        }
+        if (line_is(line, "]")) {
+            return list;
+        }
+
+        up_value_t *item = parse_value(parser, line, trimmed_length(line, strlen(line)));
+        if (!item) {
+            up_value_free(list);
+            return NULL;
+        }
+        up_list_append(&list->as.list, item);
+    }
+
+    parser_error(parser, UP_ERROR_SYNTAX, start_line, NULL, "unterminated list");
+    up_value_free(list);
+    return NULL;
+}
+
+// Parse the value text following a key (or a list item), consuming
+// further lines for blocks, lists and multiline strings
+static up_value_t *parse_value(up_parser_t *parser, const char *text, size_t length) {
+    up_value_t *value;
+
+    if (length == 1 && text[0] == '{') {
+        return parse_block(parser);
+    }
+    if (length == 1 && text[0] == '[') {
+        return parse_list(parser);
+    }
+    if (length >= 3 && strncmp(text, "```", 3) == 0) {
+        return parse_multiline(parser);
+    }
+    if (length >= 2 && text[0] == '[' && text[length - 1] == ']') {
+        value = parse_inline_list(text + 1, length - 2);
+    } else {
+        value = up_value_new_string_n(text, length);
+    }
+
+    if (!value) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+    }
+    return value;
+}
+
+static bool document_append(up_document_t *doc, up_node_t *node) {
+    up_node_t **nodes = grow_array(doc->nodes, &doc->capacity, doc->count + 1, sizeof(*nodes));
+    if (!nodes) {
+        return false;
+    }
+    doc->nodes = nodes;
+    doc->nodes[doc->count++] = node;
+    return true;
+}
+
+static up_document_t *parse_document(up_parser_t *parser, const char *input) {
+    up_parser_reset(parser);
+    if (!parser_load(parser, input)) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+
+    up_document_t *doc = calloc(1, sizeof(up_document_t));
+    if (!doc) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+
+    while (parser->current_line < parser->line_count) {
+        const char *line = parser->lines[parser->current_line++];
+        if (is_blank_or_comment(line)) {
+            continue;
+        }
+
+        up_node_t *node = up_pool_alloc(sizeof(up_node_t));
+        if (!node) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            up_document_free(doc);
+            return NULL;
+        }
+        node->refs = 0;
+        size_t line_number = parser->current_line;
+        if (!parse_statement(parser, line, &node->key, &node->type_annotation, &node->value)) {
+            up_pool_free(node, sizeof(up_node_t));
+            up_document_free(doc);
+            return NULL;
+        }
+
+        size_t position = up_document_find(doc, node->key, up_hash_string(node->key));
+        if (position < doc->count) {
+            bool replace;
+            if (!handle_duplicate(parser, node->key, line_number, &replace)) {
+                up_node_free(node);
+                up_document_free(doc);
+                return NULL;
+            }
+            // The earlier node keeps its position; only its contents change
+            if (replace) {
+                up_node_t *existing = doc->nodes[position];
+                up_value_free(existing->value);
+                free(existing->type_annotation);
+                existing->value = node->value;
+                existing->type_annotation = node->type_annotation;
+                node->value = NULL;
+                node->type_annotation = NULL;
+            }
+            up_node_free(node);
+            continue;
+        }
+        if (!document_append(doc, node)) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            up_node_free(node);
+            up_document_free(doc);
+            return NULL;
+        }
+    }
+
+    return doc;
+}
+
+// Keep a copy of the thread's last error (or success) in the parser, so
+// it outlives later failing calls on the same thread
+static void parser_keep_error(up_parser_t *parser, bool failed) {
+    if (!failed) {
+        parser->error = (up_error_t){UP_OK, 0, 0, 0, ""};
+        return;
+    }
+
+    const up_error_t *error = up_last_error();
+    size_t length = strlen(error->message);
+    if (length + 1 > parser->error_capacity) {
+        char *text = realloc(parser->error_text, length + 1);
+        if (!text) {
+            parser->error = *error;
+            parser->error.message = "Memory allocation failed";
+            return;
+        }
+        parser->error_text = text;
+        parser->error_capacity = length + 1;
+    }
+    memcpy(parser->error_text, error->message, length + 1);
+    parser->error = *error;
+    parser->error.message = parser->error_text;
+}
+
+// Parse a document, reusing the parser's scratch buffers from earlier calls
+up_document_t *up_parser_parse_document(up_parser_t *parser, const char *input) {
+    if (!parser || !input) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return NULL;
+    }
+
+    up_document_t *doc = parse_document(parser, input);
+    parser_keep_error(parser, !doc);
+    return doc;
+}
+
+// Parse a string and return a document
+up_document_t *up_parse_string(const char *input) {
+    up_parser_t *parser = up_parser_new();
+    if (!parser) {
+        return NULL;
+    }
+
+    up_document_t *doc = up_parser_parse_document(parser, input);
+    up_parser_free(parser);
+    return doc;
+}
+
+up_document_t *up_parse(const char *input) {
+    return up_parse_string(input);
+}
+
+// Read a whole file into a malloc'd, NUL-terminated buffer
+char *up_read_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        up_set_error(UP_ERROR_IO, "Cannot open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    char *data = NULL;
+    size_t used = 0, capacity = 0;
+    bool failed = false;
+    for (;;) {
+        if (capacity - used < 2) {
+            size_t grown = capacity ? capacity * 2 : 65536;
+            char *bigger = realloc(data, grown);
+            if (!bigger) {
+                up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+                failed = true;
+                break;
+            }
+            data = bigger;
+            capacity = grown;
+        }
+        size_t read = fread(data + used, 1, capacity - used - 1, file);
+        used += read;
+        if (read == 0) {
+            if (ferror(file)) {
+                up_set_error(UP_ERROR_IO, "Cannot read %s", path);
+                failed = true;
+            }
+            break;
+        }
+    }
+    fclose(file);
+
+    if (failed) {
+        free(data);
+        return NULL;
+    }
+    data[used] = '\0';
+    if (length) {
+        *length = used;
+    }
+    return data;
+}
+
+up_document_t *up_parse_file(const char *path) {
+    if (!path) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return NULL;
+    }
+
+    char *input = up_read_file(path, NULL);
+    if (!input) {
+        return NULL;
+    }
+    up_document_t *doc = up_parse_string(input);
+    free(input);
+    return doc;
+}
+
+const up_error_t *up_last_error(void) {
+    if (!last_error.error.message) {
+        last_error.error.message = "Unknown error";
+    }
+    return &last_error.error;
+}
+
+// Get the last error message, with its position
+const char *up_get_error(void) {
+    return last_error.text ? last_error.text : "Unknown error";
+}
+
+const up_error_t *up_parser_get_error(const up_parser_t *parser) {
+    return parser ? &parser->error : NULL;
+}
+
+static const char *document_key_at(const void *owner, size_t position) {
+    return ((const up_document_t *)owner)->nodes[position]->key;
+}
+
+// Position of `key` among the document nodes, or doc->count if absent.
+// Larger documents build a hash index on first use (or at freeze); the
+// first node with a key wins.
+size_t up_document_find(up_document_t *doc, const char *key, uint64_t hash) {
+    if (doc->count >= UP_INDEX_MIN_KEYS &&
+        (doc->frozen || up_index_sync(&doc->index, doc->count, document_key_at, doc)) &&
+        doc->index) {
+        size_t position;
+        if (up_index_lookup(doc->index, key, hash, document_key_at, doc, &position)) {
+            return position;
+        }
+        return doc->count;
+    }
+
+    for (size_t i = 0; i < doc->count; i++) {
+        if (doc->nodes[i] && doc->nodes[i]->key &&
+            strcmp(doc->nodes[i]->key, key) == 0) {
+            return i;
+        }
+    }
+
+    return doc->count;
+}
+
+// Get a node from the document by key
+up_node_t *up_document_get(up_document_t *doc, const char *key) {
+    if (!doc || !key) {
+        return NULL;
+    }
+
+    size_t position = up_document_find(doc, key, up_hash_string(key));
+    return position < doc->count ? doc->nodes[position] : NULL;
+}
+
+// Set a top-level key, taking ownership of `value`; `key` and `type` are
+// copied. An existing node keeps its position and gets the new contents.
+bool up_document_put(up_document_t *doc, const char *key, const char *type, up_value_t *value) {
+    if (doc->frozen) {
+        up_set_error(UP_ERROR_FROZEN, "Cannot modify a frozen document");
+        up_value_free(value);
+        return false;
+    }
+
+    char *type_copy = NULL;
+    if (type && !(type_copy = up_strndup(type, strlen(type)))) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        up_value_free(value);
+        return false;
+    }
+
+    size_t position = up_document_find(doc, key, up_hash_string(key));
+    if (position < doc->count) {
+        up_node_t *existing = doc->nodes[position];
+        up_value_free(existing->value);
+        free(existing->type_annotation);
+        existing->value = value;
+        existing->type_annotation = type_copy;
+        return true;
+    }
+
+    up_node_t *node = up_pool_alloc(sizeof(up_node_t));
+    char *key_copy = up_strndup(key, strlen(key));
+    if (!node || !key_copy) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        up_pool_free(node, sizeof(up_node_t));
+        free(key_copy);
+        free(type_copy);
+        up_value_free(value);
+        return false;
+    }
+    node->key = key_copy;
+    node->type_annotation = type_copy;
+    node->value = value;
+    node->refs = 0;
+    if (!document_append(doc, node)) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        up_node_free(node);
+        return false;
+    }
+    return true;
+}
+
+// Resolve `n` keys against an owner's `count` keys in one pass: the
+// requested keys go into a small hash table, then each owner key is
+// hashed (or its stored prefix read) and probed once. positions[i] gets
+// the first matching position, or `count` when the key is absent.
+static bool resolve_many(const char *const *keys, size_t n, size_t count,
+                         up_index_key_fn key_at, const void *owner,
+                         const uint32_t *owner_hashes, size_t *positions) {
+    size_t capacity = 16;
+    while (capacity < n * 2) {
+        capacity *= 2;
+    }
+
+    size_t *table = malloc(capacity * sizeof(*table));
+    uint32_t *hashes = malloc(n * sizeof(*hashes));
+    if (!table || !hashes) {
+        free(table);
+        free(hashes);
+        return false;
+    }
+
+    // Slots hold request index + 1; 0 is empty
+    memset(table, 0, capacity * sizeof(*table));
+    for (size_t i = 0; i < n; i++) {
+        positions[i] = count;
+        if (!keys[i]) {
+            continue;
+        }
+        hashes[i] = (uint32_t)up_hash_string(keys[i]);
+        size_t slot = hashes[i] & (capacity - 1);
+        while (table[slot]) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        table[slot] = i + 1;
+    }
+
+    size_t remaining = n;
+    for (size_t position = 0; position < count && remaining; position++) {
+        const char *key = key_at(owner, position);
+        uint32_t hash = owner_hashes ? owner_hashes[position] : (uint32_t)up_hash_string(key);
+        for (size_t slot = hash & (capacity - 1); table[slot]; slot = (slot + 1) & (capacity - 1)) {
+            size_t request = table[slot] - 1;
+            if (hashes[request] == hash && positions[request] == count &&
+                strcmp(keys[request], key) == 0) {
+                positions[request] = position;
+                remaining--;
+            }
+        }
+    }
+
+    free(table);
+    free(hashes);
+    return true;
+}
+
+// Look up several top-level keys at once. out[i] receives the node for
+// keys[i] or NULL; returns how many were found.
+size_t up_document_get_many(up_document_t *doc, const char *const *keys, size_t n, up_node_t **out) {
+    if (!doc || !keys || !out) {
+        return 0;
+    }
+
+    size_t found = 0;
+    bool indexed = doc->count >= UP_INDEX_MIN_KEYS &&
+                   (doc->frozen || up_index_sync(&doc->index, doc->count, document_key_at, doc)) &&
+                   doc->index;
+    size_t *positions = indexed || n < 2 ? NULL : malloc(n * sizeof(*positions));
+
+    if (positions && resolve_many(keys, n, doc->count, document_key_at, doc, NULL, positions)) {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = positions[i] < doc->count ? doc->nodes[positions[i]] : NULL;
+            found += out[i] != NULL;
+        }
+        free(positions);
+        return found;
+    }
+    free(positions);
+
+    for (size_t i = 0; i < n; i++) {
+        out[i] = keys[i] ? up_document_get(doc, keys[i]) : NULL;
+        found += out[i] != NULL;
+    }
+    return found;
+}
+
+static void value_memory_stats(const up_value_t *value, up_memory_stats_t *stats) {
+    if (!value) {
+        return;
+    }
+
+    stats->value_bytes += sizeof(up_value_t);
+    stats->value_counts[value->type]++;
+
+    switch (value->type) {
+        case UP_TYPE_STRING:
+            stats->string_bytes += value->as.string.length + 1;
+            break;
+        case UP_TYPE_BLOCK: {
+            const up_block_t *block = &value->as.block;
+            size_t slot = sizeof(char *) + sizeof(up_value_t *);
+            if (block->hashes) {
+                slot += sizeof(uint32_t);
+            }
+            if (block->types) {
+                slot += sizeof(char *);
+            }
+            stats->array_bytes += block->count * slot;
+            stats->slack_bytes += (block->capacity - block->count) * slot;
+            stats->index_bytes += up_index_bytes(block->index);
+            for (size_t i = 0; i < block->count; i++) {
+                stats->key_bytes += strlen(block->keys[i]) + 1;
+                if (block->types && block->types[i]) {
+                    stats->key_bytes += strlen(block->types[i]) + 1;
+                }
+                value_memory_stats(block->values[i], stats);
+            }
+            break;
+        }
+        case UP_TYPE_LIST: {
+            const up_list_t *list = &value->as.list;
+            stats->array_bytes += list->count * sizeof(up_value_t *);
+            stats->slack_bytes += (list->capacity - list->count) * sizeof(up_value_t *);
+            for (size_t i = 0; i < list->count; i++) {
+                value_memory_stats(list->items[i], stats);
+            }
+            break;
+        }
+    }
+}
+
+// Report the bytes held by a document, broken down by what they store.
+// Subtrees shared with clones are counted in full for every document.
+void up_document_memory_stats(const up_document_t *doc, up_memory_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+    if (!doc) {
+        return;
+    }
+
+    stats->node_bytes = sizeof(up_document_t) + doc->count * sizeof(up_node_t *);
+    stats->slack_bytes = (doc->capacity - doc->count) * sizeof(up_node_t *);
+    stats->index_bytes = up_index_bytes(doc->index) + up_value_index_bytes(doc->value_index) +
+                         up_path_index_bytes(doc->path_index);
+    stats->node_count = doc->count;
+
+    for (size_t i = 0; i < doc->count; i++) {
+        const up_node_t *node = doc->nodes[i];
+        stats->node_bytes += sizeof(up_node_t);
+        stats->key_bytes += strlen(node->key) + 1;
+        if (node->type_annotation) {
+            stats->key_bytes += strlen(node->type_annotation) + 1;
+        }
+        value_memory_stats(node->value, stats);
+    }
+
+    stats->total_bytes = stats->node_bytes + stats->value_bytes + stats->key_bytes +
+                         stats->string_bytes + stats->array_bytes + stats->slack_bytes +
+                         stats->index_bytes;
+}
+
+static void value_freeze(up_value_t *value) {
+    switch (value->type) {
+        case UP_TYPE_STRING:
+            break;
+        case UP_TYPE_BLOCK:
+            value->as.block.frozen = true;
+            block_index_sync(&value->as.block);
+            for (size_t i = 0; i < value->as.block.count; i++) {
+                value_freeze(value->as.block.values[i]);
+            }
+            break;
+        case UP_TYPE_LIST:
+            value->as.list.frozen = true;
+            for (size_t i = 0; i < value->as.list.count; i++) {
+                value_freeze(value->as.list.items[i]);
+            }
+            break;
+    }
+}
+
+// Mark every container read-only and build lookup indexes up front. Nothing
+// in the read path allocates or writes once this returns, which is what
+// makes concurrent readers safe.
+void up_document_freeze(up_document_t *doc) {
+    if (!doc || doc->frozen) {
+        return;
+    }
+
+    for (size_t i = 0; i < doc->count; i++) {
+        value_freeze(doc->nodes[i]->value);
+    }
+    if (doc->count >= UP_INDEX_MIN_KEYS) {
+        up_index_sync(&doc->index, doc->count, document_key_at, doc);
+    }
+    doc->frozen = true;
+}
+
+bool up_document_is_frozen(const up_document_t *doc) {
+    return doc && doc->frozen;
+}
+
+// Free a document
+void up_document_free(up_document_t *doc) {
+    if (!doc) {
+        return;
+    }
+
+    for (size_t i = 0; i < doc->count; i++) {
+        up_node_free(doc->nodes[i]);
+    }
+
+    up_pool_free(doc->nodes, doc->capacity * sizeof(*doc->nodes));
+    up_index_free(doc->index);
+    up_value_index_free(doc->value_index);
+    up_path_index_free(doc->path_index);
+    free(doc);
+}
+
+// Free a node, or drop one reference if it is shared
+void up_node_free(up_node_t *node) {
+    if (!node) {
+        return;
+    }
+    if (node->refs) {
+        node->refs--;
+        return;
+    }
+
+    free(node->key);
+    free(node->type_annotation);
+    up_value_free(node->value);
+    up_pool_free(node, sizeof(up_node_t));
+}
+
+// Free a value, or drop one reference if it is shared
+void up_value_free(up_value_t *value) {
+    if (!value) {
+        return;
+    }
+    if (value->refs) {
+        value->refs--;
+        return;
+    }
+
+    switch (value->type) {
+        case UP_TYPE_STRING:
+            free(value->as.string.data);
+            break;
+        case UP_TYPE_BLOCK:
+            for (size_t i = 0; i < value->as.block.count; i++) {
+                free(value->as.block.keys[i]);
+                up_value_free(value->as.block.values[i]);
+            }
+            up_pool_free(value->as.block.keys, value->as.block.capacity * sizeof(char *));
+            up_pool_free(value->as.block.values, value->as.block.capacity * sizeof(up_value_t *));
+            up_pool_free(value->as.block.hashes, value->as.block.capacity * sizeof(uint32_t));
+            if (value->as.block.types) {
+                for (size_t i = 0; i < value->as.block.count; i++) {
+                    free(value->as.block.types[i]);
+                }
+                up_pool_free(value->as.block.types, value->as.block.capacity * sizeof(char *));
+            }
+            up_index_free(value->as.block.index);
+            break;
+        case UP_TYPE_LIST:
+            for (size_t i = 0; i < value->as.list.count; i++) {
+                up_value_free(value->as.list.items[i]);
+            }
+            up_pool_free(value->as.list.items, value->as.list.capacity * sizeof(up_value_t *));
+            break;
+    }
+
+    up_pool_free(value, sizeof(up_value_t));
+}
+
 
-    // Return a stub document for now
-    up_document_t *doc = malloc(sizeof(up_document_t));
-    if (!doc) {
-        snprintf(error_message, sizeof(error_message), "Memory allocation failed");
+/* ---- Value constructors ---- */
+
+up_value_t *up_value_new_string(const char *str) {
+    return up_value_new_string_n(str ? str : "", str ? strlen(str) : 0);
+}
+
+up_value_t *up_value_new_block(void) {
+    up_value_t *value = up_pool_calloc(sizeof(up_value_t));
+    if (value) {
+        value->type = UP_TYPE_BLOCK;
+    }
+    return value;
+}
+
+up_value_t *up_value_new_list(void) {
+    up_value_t *value = up_pool_calloc(sizeof(up_value_t));
+    if (value) {
+        value->type = UP_TYPE_LIST;
+    }
+    return value;
+}
+
+/* ---- Block operations ---- */
+
+static const char *block_key_at(const void *owner, size_t position) {
+    return ((const up_block_t *)owner)->keys[position];
+}
+
+// Index a block once it outgrows hash-prefix scanning. Failure just leaves
+// the block unindexed; lookups fall back to scanning.
+static void block_index_sync(up_block_t *block) {
+    if (!block->sorted && block->count >= UP_BLOCK_INDEX_MIN_KEYS &&
+        (!block->index || block->index->covered != block->count)) {
+        up_index_sync(&block->index, block->count, block_key_at, block);
+    }
+}
+
+// First position whose key is not below `key` in a sorted block
+static size_t block_lower_bound(const up_block_t *block, const char *key, bool *found) {
+    size_t low = 0, high = block->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (strcmp(block->keys[mid], key) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *found = low < block->count && strcmp(block->keys[low], key) == 0;
+    return low;
+}
+
+// Position of `key` in a block, or block->count if absent. Never writes,
+// so it is safe on frozen blocks from any thread.
+size_t up_block_find(const up_block_t *block, const char *key, uint64_t hash) {
+    if (block->sorted) {
+        bool found;
+        size_t position = block_lower_bound(block, key, &found);
+        return found ? position : block->count;
+    }
+
+    if (block->index && block->index->covered == block->count) {
+        size_t position;
+        if (up_index_lookup(block->index, key, hash, block_key_at, block, &position)) {
+            return position;
+        }
+        return block->count;
+    }
+
+    if (block->hashes) {
+        return up_hash_scan(block->hashes, block->count, (uint32_t)hash, key, block_key_at, block);
+    }
+
+    for (size_t i = 0; i < block->count; i++) {
+        if (strcmp(block->keys[i], key) == 0) {
+            return i;
+        }
+    }
+    return block->count;
+}
+
+// Grow the parallel key, value, hash and type arrays together so all of
+// them always match block->capacity. The type array only exists once some
+// key carries an annotation.
+static bool block_reserve(up_block_t *block, size_t needed) {
+    if (needed <= block->capacity) {
+        return true;
+    }
+
+    size_t capacity = block->capacity ? block->capacity * 2 : 8;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+
+    char **keys = up_pool_alloc(capacity * sizeof(*keys));
+    up_value_t **values = up_pool_alloc(capacity * sizeof(*values));
+    uint32_t *hashes = up_pool_alloc(capacity * sizeof(*hashes));
+    char **types = block->types ? up_pool_calloc(capacity * sizeof(*types)) : NULL;
+    if (!keys || !values || !hashes || (block->types && !types)) {
+        up_pool_free(keys, capacity * sizeof(*keys));
+        up_pool_free(values, capacity * sizeof(*values));
+        up_pool_free(hashes, capacity * sizeof(*hashes));
+        up_pool_free(types, capacity * sizeof(*types));
+        return false;
+    }
+    if (block->count) {
+        memcpy(keys, block->keys, block->count * sizeof(*keys));
+        memcpy(values, block->values, block->count * sizeof(*values));
+    }
+    if (types && block->count) {
+        memcpy(types, block->types, block->count * sizeof(*types));
+    }
+    for (size_t i = 0; i < block->count; i++) {
+        hashes[i] = block->hashes ? block->hashes[i] : (uint32_t)up_hash_string(block->keys[i]);
+    }
+    up_pool_free(block->keys, block->capacity * sizeof(*keys));
+    up_pool_free(block->values, block->capacity * sizeof(*values));
+    up_pool_free(block->hashes, block->capacity * sizeof(*hashes));
+    up_pool_free(block->types, block->capacity * sizeof(*types));
+
+    block->keys = keys;
+    block->values = values;
+    block->hashes = hashes;
+    block->types = types;
+    block->capacity = capacity;
+    return true;
+}
+
+// Store `type` (owned, may be NULL) as the annotation at `position`
+static bool block_store_type(up_block_t *block, size_t position, char *type) {
+    if (!block->types) {
+        if (!type) {
+            return true;
+        }
+        block->types = up_pool_calloc(block->capacity * sizeof(*block->types));
+        if (!block->types) {
+            free(type);
+            return false;
+        }
+    }
+    free(block->types[position]);
+    block->types[position] = type;
+    return true;
+}
+
+// Set a key in a block, taking ownership of `value`. An existing entry
+// for the same key has its value replaced.
+void up_block_set(up_block_t *block, const char *key, up_value_t *value) {
+    up_block_set_typed(block, key, NULL, value);
+}
+
+// Like up_block_set, also recording a type annotation (copied; NULL for
+// none). Replacing a value replaces its annotation too.
+void up_block_set_typed(up_block_t *block, const char *key, const char *type, up_value_t *value) {
+    if (!block || !key) {
+        return;
+    }
+    if (block->frozen) {
+        up_set_error(UP_ERROR_FROZEN, "Cannot modify a frozen block");
+        up_value_free(value);
+        return;
+    }
+
+    char *type_copy = NULL;
+    if (type && !(type_copy = up_strndup(type, strlen(type)))) {
+        up_value_free(value);
+        return;
+    }
+
+    uint64_t hash = up_hash_string(key);
+    size_t position;
+    bool found;
+    if (block->sorted) {
+        position = block_lower_bound(block, key, &found);
+    } else {
+        position = up_block_find(block, key, hash);
+        found = position < block->count;
+    }
+    if (found) {
+        if (block->values[position] != value) {
+            up_value_free(block->values[position]);
+            block->values[position] = value;
+        }
+        block_store_type(block, position, type_copy);
+        return;
+    }
+
+    if (!block_reserve(block, block->count + 1)) {
+        free(type_copy);
+        up_value_free(value);
+        return;
+    }
+
+    char *copy = up_strndup(key, strlen(key));
+    if (!copy) {
+        free(type_copy);
+        up_value_free(value);
+        return;
+    }
+
+    // Sorted blocks open a gap at the insertion point; others append
+    size_t tail = block->count - position;
+    memmove(block->keys + position + 1, block->keys + position, tail * sizeof(*block->keys));
+    memmove(block->values + position + 1, block->values + position, tail * sizeof(*block->values));
+    if (block->hashes) {
+        memmove(block->hashes + position + 1, block->hashes + position, tail * sizeof(*block->hashes));
+        block->hashes[position] = (uint32_t)hash;
+    }
+    if (block->types) {
+        memmove(block->types + position + 1, block->types + position, tail * sizeof(*block->types));
+        block->types[position] = NULL;
+    }
+    block->keys[position] = copy;
+    block->values[position] = value;
+    block->count++;
+    block_store_type(block, position, type_copy);
+    block_index_sync(block);
+}
+
+// Type annotation of a block entry, or NULL
+const char *up_block_get_type(const up_block_t *block, const char *key) {
+    if (!block || !key || !block->types) {
         return NULL;
     }
 
-    doc->nodes = NULL;
-    doc->count = 0;
-    doc->capacity = 0;
+    size_t position = up_block_find(block, key, up_hash_string(key));
+    return position < block->count ? block->types[position] : NULL;
+}
+
+typedef struct {
+    char *key;
+    char *type;
+    up_value_t *value;
+    uint32_t hash;
+} block_entry_t;
 
-    return doc;
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const block_entry_t *)a)->key, ((const block_entry_t *)b)->key);
 }
 
-// Get the last error message
-const char *up_get_error(void) {
-    return error_message[0] ? error_message : "Unknown error";
+// Sort a block's keys bytewise and keep them sorted from now on. Lookups
+// switch to binary search and the hash index is dropped.
+bool up_block_sort(up_block_t *block) {
+    if (!block) {
+        return false;
+    }
+    if (block->frozen) {
+        up_set_error(UP_ERROR_FROZEN, "Cannot modify a frozen block");
+        return false;
+    }
+
+    if (block->count > 1) {
+        block_entry_t *entries = malloc(block->count * sizeof(*entries));
+        if (!entries) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            return false;
+        }
+        for (size_t i = 0; i < block->count; i++) {
+            entries[i].key = block->keys[i];
+            entries[i].value = block->values[i];
+            entries[i].hash = block->hashes ? block->hashes[i] : 0;
+            entries[i].type = block->types ? block->types[i] : NULL;
+        }
+        // Keys within a block are unique, so qsort's instability is moot
+        qsort(entries, block->count, sizeof(*entries), compare_entries);
+        for (size_t i = 0; i < block->count; i++) {
+            block->keys[i] = entries[i].key;
+            block->values[i] = entries[i].value;
+            if (block->hashes) {
+                block->hashes[i] = entries[i].hash;
+            }
+            if (block->types) {
+                block->types[i] = entries[i].type;
+            }
+        }
+        free(entries);
+    }
+
+    up_index_free(block->index);
+    block->index = NULL;
+    block->sorted = true;
+    return true;
 }
 
-// Get a node from the document by key
-up_node_t *up_document_get(up_document_t *doc, const char *key) {
-    if (!doc || !key) {
+// Walk two sorted blocks together in key order, calling `visit` once per
+// distinct key with NULL for the side that lacks it. Linear in the sum of
+// both sizes; returns false if either block is not sorted.
+bool up_block_merge(const up_block_t *a, const up_block_t *b, up_block_merge_fn visit, void *context) {
+    if (!a || !b || !visit || !a->sorted || !b->sorted) {
+        up_set_error(UP_ERROR_ARGUMENT, "up_block_merge requires two sorted blocks");
+        return false;
+    }
+
+    size_t i = 0, j = 0;
+    while (i < a->count || j < b->count) {
+        int order = i == a->count ? 1 : j == b->count ? -1 : strcmp(a->keys[i], b->keys[j]);
+        if (order < 0) {
+            visit(a->keys[i], a->values[i], NULL, context);
+            i++;
+        } else if (order > 0) {
+            visit(b->keys[j], NULL, b->values[j], context);
+            j++;
+        } else {
+            visit(a->keys[i], a->values[i], b->values[j], context);
+            i++;
+            j++;
+        }
+    }
+    return true;
+}
+
+// Small blocks scan stored hash prefixes; large ones use their index
+up_value_t *up_block_get(const up_block_t *block, const char *key) {
+    if (!block || !key) {
         return NULL;
     }
 
-    for (size_t i = 0; i < doc->count; i++) {
-        if (doc->nodes[i] && doc->nodes[i]->key &&
-            strcmp(doc->nodes[i]->key, key) == 0) {
-            return doc->nodes[i];
+    size_t position = up_block_find(block, key, up_hash_string(key));
+    return position < block->count ? block->values[position] : NULL;
+}
+
+// Look up several block keys at once; see up_document_get_many
+size_t up_block_get_many(const up_block_t *block, const char *const *keys, size_t n, up_value_t **out) {
+    if (!block || !keys || !out) {
+        return 0;
+    }
+
+    size_t found = 0;
+    bool indexed = block->index && block->index->covered == block->count;
+    size_t *positions = indexed || n < 2 ? NULL : malloc(n * sizeof(*positions));
+
+    if (positions && resolve_many(keys, n, block->count, block_key_at, block, block->hashes, positions)) {
+        for (size_t i = 0; i < n; i++) {
+            out[i] = positions[i] < block->count ? block->values[positions[i]] : NULL;
+            found += out[i] != NULL;
         }
+        free(positions);
+        return found;
     }
+    free(positions);
 
-    return NULL;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = keys[i] ? up_block_get(block, keys[i]) : NULL;
+        found += out[i] != NULL;
+    }
+    return found;
 }
 
-// Free a document
-void up_document_free(up_document_t *doc) {
-    if (!doc) {
+/* ---- List operations ---- */
+
+// Append to a list, taking ownership of `value`
+void up_list_append(up_list_t *list, up_value_t *value) {
+    if (!list) {
+        return;
+    }
+    if (list->frozen) {
+        up_set_error(UP_ERROR_FROZEN, "Cannot modify a frozen list");
+        up_value_free(value);
         return;
     }
 
-    for (size_t i = 0; i < doc->count; i++) {
-        up_node_free(doc->nodes[i]);
+    up_value_t **items = grow_array(list->items, &list->capacity, list->count + 1, sizeof(*items));
+    if (!items) {
+        up_value_free(value);
+        return;
     }
+    list->items = items;
+    list->items[list->count++] = value;
+}
 
-    free(doc->nodes);
-    free(doc);
+/* ---- Copy-on-write sharing ---- */
+
+up_value_t *up_value_retain(up_value_t *value) {
+    if (value) {
+        value->refs++;
+    }
+    return value;
 }
 
-// Free a node
-void up_node_free(up_node_t *node) {
-    if (!node) {
-        return;
+// Share every node of `doc` with a new document
+up_document_t *up_document_clone(const up_document_t *doc) {
+    if (!doc) {
+        return NULL;
     }
 
-    free(node->key);
-    free(node->type_annotation);
-    up_value_free(node->value);
-    free(node);
+    up_document_t *clone = calloc(1, sizeof(up_document_t));
+    if (!clone) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+    if (doc->count) {
+        clone->nodes = up_pool_alloc(doc->count * sizeof(*clone->nodes));
+        if (!clone->nodes) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            free(clone);
+            return NULL;
+        }
+        clone->capacity = doc->count;
+    }
+
+    for (size_t i = 0; i < doc->count; i++) {
+        doc->nodes[i]->refs++;
+        clone->nodes[i] = doc->nodes[i];
+    }
+    clone->count = doc->count;
+
+    return clone;
 }
 
-// Free a value
-void up_value_free(up_value_t *value) {
-    if (!value) {
-        return;
+// Replace a shared value with a private shallow copy whose children are
+// shared in turn. Returns NULL (leaving *slot untouched) on failure.
+//
+// A frozen value with no other owner is left over from a frozen document
+// that has since been freed (a clone or a merge result outlived it), so it
+// is thawed in place rather than copied; its children stay frozen until
+// they are made mutable in turn.
+static up_value_t *value_unshare(up_value_t **slot) {
+    up_value_t *value = *slot;
+    if (!value->refs) {
+        if (value->type == UP_TYPE_BLOCK) {
+            value->as.block.frozen = false;
+        } else if (value->type == UP_TYPE_LIST) {
+            value->as.list.frozen = false;
+        }
+        value->hash_cache[0] = value->hash_cache[1] = 0;
+        return value;
     }
 
+    up_value_t *copy;
     switch (value->type) {
         case UP_TYPE_STRING:
-            free(value->as.string.data);
+            copy = up_value_new_string_n(value->as.string.data, value->as.string.length);
             break;
         case UP_TYPE_BLOCK:
-            for (size_t i = 0; i < value->as.block.count; i++) {
-                free(value->as.block.keys[i]);
-                up_value_free(value->as.block.values[i]);
+            copy = up_value_new_block();
+            if (copy && !block_reserve(&copy->as.block, value->as.block.count)) {
+                up_value_free(copy);
+                copy = NULL;
+            }
+            for (size_t i = 0; copy && i < value->as.block.count; i++) {
+                up_block_t *dst = &copy->as.block;
+                const up_block_t *src = &value->as.block;
+                char *key = up_strndup(src->keys[i], strlen(src->keys[i]));
+                if (!key) {
+                    up_value_free(copy);
+                    copy = NULL;
+                    break;
+                }
+                dst->keys[i] = key;
+                dst->values[i] = up_value_retain(src->values[i]);
+                if (dst->hashes) {
+                    dst->hashes[i] = src->hashes ? src->hashes[i] : (uint32_t)up_hash_string(key);
+                }
+                dst->count++;
+                if (src->types && src->types[i]) {
+                    char *type = up_strndup(src->types[i], strlen(src->types[i]));
+                    if (!type || !block_store_type(dst, i, type)) {
+                        up_value_free(copy);
+                        copy = NULL;
+                        break;
+                    }
+                }
+            }
+            if (copy) {
+                copy->as.block.sorted = value->as.block.sorted;
+                block_index_sync(&copy->as.block);
             }
-            free(value->as.block.keys);
-            free(value->as.block.values);
             break;
         case UP_TYPE_LIST:
-            for (size_t i = 0; i < value->as.list.count; i++) {
-                up_value_free(value->as.list.items[i]);
+            copy = up_value_new_list();
+            for (size_t i = 0; copy && i < value->as.list.count; i++) {
+                size_t count = copy->as.list.count;
+                up_list_append(&copy->as.list, up_value_retain(value->as.list.items[i]));
+                if (copy->as.list.count == count) {
+                    up_value_free(copy);
+                    copy = NULL;
+                }
             }
-            free(value->as.list.items);
             break;
+        default:
+            copy = NULL;
+            break;
+    }
+
+    if (!copy) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+    value->refs--;
+    *slot = copy;
+    return copy;
+}
+
+// Make the node for `key` and its value private to `doc`, returning the
+// value ready for in-place mutation
+up_value_t *up_document_mutable(up_document_t *doc, const char *key) {
+    if (!doc || !key) {
+        return NULL;
+    }
+    if (doc->frozen) {
+        up_set_error(UP_ERROR_FROZEN, "Cannot modify a frozen document");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < doc->count; i++) {
+        up_node_t *node = doc->nodes[i];
+        if (strcmp(node->key, key) != 0) {
+            continue;
+        }
+
+        if (node->refs) {
+            up_node_t *copy = up_pool_alloc(sizeof(up_node_t));
+            if (!copy) {
+                up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+                return NULL;
+            }
+            copy->key = up_strndup(node->key, strlen(node->key));
+            copy->type_annotation = node->type_annotation
+                ? up_strndup(node->type_annotation, strlen(node->type_annotation))
+                : NULL;
+            if (!copy->key || (node->type_annotation && !copy->type_annotation)) {
+                free(copy->key);
+                free(copy->type_annotation);
+                up_pool_free(copy, sizeof(up_node_t));
+                up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+                return NULL;
+            }
+            copy->value = up_value_retain(node->value);
+            copy->refs = 0;
+            node->refs--;
+            doc->nodes[i] = node = copy;
+        }
+
+        return value_unshare(&node->value);
+    }
+
+    return NULL;
+}
+
+// Make the value stored under `key` private to `block`; the block itself
+// must already be mutable
+up_value_t *up_block_mutable(up_block_t *block, const char *key) {
+    if (!block || !key) {
+        return NULL;
+    }
+    if (block->frozen) {
+        up_set_error(UP_ERROR_FROZEN, "Cannot modify a frozen block");
+        return NULL;
+    }
+
+    size_t position = up_block_find(block, key, up_hash_string(key));
+    return position < block->count ? value_unshare(&block->values[position]) : NULL;
+}
+
+static up_value_t *merge_value(up_value_t *base, up_value_t *over, up_merge_policy_t policy);
+
+// Base entries in base order, overlay-only entries after them. Entries one
+// side supplies unchanged are shared, not copied.
+static up_value_t *merge_block(up_value_t *base, up_value_t *over, up_merge_policy_t policy) {
+    const up_block_t *a = &base->as.block;
+    const up_block_t *b = &over->as.block;
+    if (b->count == 0) {
+        return up_value_retain(base);
+    }
+    if (a->count == 0) {
+        return up_value_retain(over);
+    }
+
+    up_value_t *merged = up_value_new_block();
+    if (!merged || !block_reserve(&merged->as.block, a->count + b->count)) {
+        up_value_free(merged);
+        return NULL;
+    }
+    up_block_t *block = &merged->as.block;
+    block->sorted = a->sorted;
+
+    for (size_t i = 0; i < a->count; i++) {
+        size_t position = up_block_find(b, a->keys[i], up_hash_string(a->keys[i]));
+        const char *type = a->types ? a->types[i] : NULL;
+        up_value_t *value;
+        if (position < b->count) {
+            value = merge_value(a->values[i], b->values[position], policy);
+            if (b->types && b->types[position]) {
+                type = b->types[position];
+            }
+        } else {
+            value = up_value_retain(a->values[i]);
+        }
+
+        size_t count = block->count;
+        if (value) {
+            up_block_set_typed(block, a->keys[i], type, value);
+        }
+        if (block->count == count) {
+            up_value_free(merged);
+            return NULL;
+        }
+    }
+
+    for (size_t i = 0; i < b->count; i++) {
+        if (up_block_find(a, b->keys[i], up_hash_string(b->keys[i])) < a->count) {
+            continue;
+        }
+        size_t count = block->count;
+        up_block_set_typed(block, b->keys[i], b->types ? b->types[i] : NULL,
+                           up_value_retain(b->values[i]));
+        if (block->count == count) {
+            up_value_free(merged);
+            return NULL;
+        }
+    }
+    return merged;
+}
+
+static up_value_t *merge_list(up_value_t *base, up_value_t *over, up_merge_policy_t policy) {
+    const up_list_t *a = &base->as.list;
+    const up_list_t *b = &over->as.list;
+    up_value_t *merged = up_value_new_list();
+    size_t count = policy == UP_MERGE_LIST_APPEND ? a->count + b->count
+                                                  : (a->count > b->count ? a->count : b->count);
+
+    for (size_t i = 0; merged && i < count; i++) {
+        up_value_t *item;
+        if (policy == UP_MERGE_LIST_APPEND) {
+            item = up_value_retain(i < a->count ? a->items[i] : b->items[i - a->count]);
+        } else if (i < a->count && i < b->count) {
+            item = merge_value(a->items[i], b->items[i], policy);
+        } else {
+            item = up_value_retain(i < b->count ? b->items[i] : a->items[i]);
+        }
+
+        size_t before = merged->as.list.count;
+        if (item) {
+            up_list_append(&merged->as.list, item);
+        }
+        if (merged->as.list.count == before) {
+            up_value_free(merged);
+            merged = NULL;
+        }
+    }
+    return merged;
+}
+
+// A new reference to `over` laid on top of `base`, or NULL
+static up_value_t *merge_value(up_value_t *base, up_value_t *over, up_merge_policy_t policy) {
+    if (base->type == UP_TYPE_BLOCK && over->type == UP_TYPE_BLOCK) {
+        return merge_block(base, over, policy);
+    }
+    if (base->type == UP_TYPE_LIST && over->type == UP_TYPE_LIST && policy != UP_MERGE_LIST_REPLACE) {
+        return merge_list(base, over, policy);
+    }
+    return up_value_retain(over);
+}
+
+// Node for a key both documents have: the overlay node itself when its
+// value wins outright, a new node around the merged value otherwise
+static up_node_t *merge_node(up_node_t *base, up_node_t *over, up_merge_policy_t policy) {
+    up_value_t *value = merge_value(base->value, over->value, policy);
+    if (!value) {
+        return NULL;
+    }
+    const char *type = over->type_annotation ? over->type_annotation : base->type_annotation;
+    if (value == over->value && type == over->type_annotation) {
+        up_value_free(value);
+        over->refs++;
+        return over;
     }
 
-    free(value);
+    up_node_t *node = up_pool_alloc(sizeof(up_node_t));
+    if (!node) {
+        up_value_free(value);
+        return NULL;
+    }
+    node->key = up_strndup(over->key, strlen(over->key));
+    node->type_annotation = type ? up_strndup(type, strlen(type)) : NULL;
+    node->value = value;
+    node->refs = 0;
+    if (!node->key || (type && !node->type_annotation)) {
+        up_node_free(node);
+        return NULL;
+    }
+    return node;
 }
 
+// Deep-merge `overlay` onto `base` into a new document. Blocks merge key
+// by key, lists follow `policy`, and anything else in the overlay replaces
+// the base value. Every subtree taken unchanged from either input is
+// shared with it, so the cost follows the overlay, not the base.
+up_document_t *up_document_merge(const up_document_t *base, const up_document_t *overlay,
+                                 up_merge_policy_t policy) {
+    if (!base || !overlay) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return NULL;
+    }
+    // Base keys are only ever looked up in the overlay, usually the smaller
+    // side. Its own index serves when it is current; otherwise a scratch
+    // index is built here, as up_diff does, so the overlay's index is never
+    // written and readers sharing it are not raced.
+    const up_document_t *a = base;
+    const up_document_t *b = overlay;
+    up_index_t *scratch = NULL;
+    const up_index_t *index = NULL;
+    bool indexed = true;
+    if (b->count >= UP_INDEX_MIN_KEYS) {
+        if (b->index && b->index->covered == b->count) {
+            index = b->index;
+        } else {
+            indexed = up_index_sync(&scratch, b->count, document_key_at, b);
+            index = scratch;
+        }
+    }
+
+    up_document_t *merged = calloc(1, sizeof(up_document_t));
+    bool *matched = calloc(b->count ? b->count : 1, sizeof(bool));
+    if (merged && a->count + b->count) {
+        merged->nodes = grow_array(NULL, &merged->capacity, a->count + b->count, sizeof(*merged->nodes));
+    }
+    if (!indexed || !merged || !matched || (a->count + b->count && !merged->nodes)) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        up_index_free(scratch);
+        if (merged) {
+            up_pool_free(merged->nodes, merged->capacity * sizeof(*merged->nodes));
+        }
+        free(merged);
+        free(matched);
+        return NULL;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < a->count; i++) {
+        up_node_t *node = a->nodes[i];
+        size_t position = b->count;
+        if (index) {
+            if (!up_index_lookup(index, node->key, up_hash_string(node->key), document_key_at, b,
+                                 &position)) {
+                position = b->count;
+            }
+        } else {
+            for (position = 0; position < b->count; position++) {
+                if (strcmp(b->nodes[position]->key, node->key) == 0) {
+                    break;
+                }
+            }
+        }
+        if (position < b->count) {
+            matched[position] = true;
+            node = merge_node(node, b->nodes[position], policy);
+        } else {
+            node->refs++;
+        }
+        ok = node && document_append(merged, node);
+        if (!ok) {
+            up_node_free(node);
+        }
+    }
+
+    for (size_t i = 0; ok && i < b->count; i++) {
+        up_node_t *node = b->nodes[i];
+        if (matched[i]) {
+            continue;
+        }
+        node->refs++;
+        ok = document_append(merged, node);
+        if (!ok) {
+            up_node_free(node);
+        }
+    }
+
+    free(matched);
+    up_index_free(scratch);
+    if (!ok) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        up_document_free(merged);
+        return NULL;
+    }
+    return merged;
+}
@@ -0,0 +1,688 @@
+/**
+ * Binary documents (UPB)
+ *
+ * A UPB file is a position-independent image of a document that can be
+ * mapped and read in place. Every reference is a 32-bit offset from the
+ * start of the file, and all records are 4-byte aligned (scalars 8):
+ *
+ *   header   "UPB\0", version, byte order mark, file size, root offset,
+ *            flags, source text hash
+ *   name     hash, length, bytes, NUL      keys and annotations, stored
+ *                                          once however often they occur
+ *   string   kind, length, [int64 | double | bool], bytes, NUL
+ *   block    kind, count, slots, 0, count x {key, type, value},
+ *            slots x (entry + 1)           open-addressed key index
+ *   list     kind, count, count x value
+ *
+ * The root is a block holding the document's top-level nodes. Scalars
+ * whose annotation is int, float or bool carry their value pre-parsed
+ * next to the text (list items take the annotation of their list), and
+ * blocks with UP_INDEX_MIN_KEYS or more entries carry a hash index built
+ * at save time, so opening a file costs one mmap and lookups touch only
+ * the pages they need.
+ *
+ * Images are written in host byte order; the byte order mark makes a
+ * foreign image fail to open rather than read garbage.
+ */
+
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "up.h"
+#include "up_internal.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define UPB_BYTE_ORDER 0x01020304u
+
+enum {
+    UPB_TEXT,
+    UPB_INT,
+    UPB_FLOAT,
+    UPB_BOOL
+};
+
+// Set on images that live in malloc'd memory rather than a mapping
+#define UPB_HEAP 1u
+
+// The image starts with this header, so a handle is just its address
+struct up_binary {
+    char magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t size;
+    uint32_t root;
+    uint32_t flags;         // Always 0 on disk
+    uint64_t source_hash;   // Hash of the text compiled, if known (up_cache.c)
+};
+
+/* ---- Saving ---- */
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    uint32_t *names;        // Offsets of interned name records
+    size_t name_count;
+    size_t name_capacity;
+    up_index_t *name_index;
+} upb_builder_t;
+
+static const char *builder_name_at(const void *owner, size_t position) {
+    const upb_builder_t *builder = owner;
+    return builder->data + builder->names[position] + 8;
+}
+
+// Reserve `length` zeroed bytes at the next `align` boundary; returns the
+// offset, or 0 when out of memory or past the 4 GB offset range
+static uint32_t builder_reserve(upb_builder_t *builder, size_t length, size_t align) {
+    size_t offset = (builder->length + align - 1) & ~(align - 1);
+    if (length > UINT32_MAX - offset) {
+        up_set_error(UP_ERROR_FORMAT, "Document too large for the binary format");
+        return 0;
+    }
+    if (offset + length > builder->capacity) {
+        size_t capacity = builder->capacity ? builder->capacity : 4096;
+        while (offset + length > capacity) {
+            capacity *= 2;
+        }
+        char *data = realloc(builder->data, capacity);
+        if (!data) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            return 0;
+        }
+        builder->data = data;
+        builder->capacity = capacity;
+    }
+    memset(builder->data + builder->length, 0, offset + length - builder->length);
+    builder->length = offset + length;
+    return (uint32_t)offset;
+}
+
+static void put_u32(upb_builder_t *builder, size_t offset, uint32_t value) {
+    memcpy(builder->data + offset, &value, sizeof(value));
+}
+
+// Offset of the name record for `name`, adding it on first use
+static uint32_t builder_name(upb_builder_t *builder, const char *name) {
+    uint64_t hash = up_hash_string(name);
+    size_t position;
+    if (up_index_lookup(builder->name_index, name, hash, builder_name_at, builder, &position)) {
+        return builder->names[position];
+    }
+
+    size_t length = strlen(name);
+    uint32_t offset = builder_reserve(builder, 8 + length + 1, 4);
+    if (!offset) {
+        return 0;
+    }
+    put_u32(builder, offset, (uint32_t)hash);
+    put_u32(builder, offset + 4, (uint32_t)length);
+    memcpy(builder->data + offset + 8, name, length);
+
+    if (builder->name_count == builder->name_capacity) {
+        size_t capacity = builder->name_capacity ? builder->name_capacity * 2 : 64;
+        uint32_t *names = realloc(builder->names, capacity * sizeof(*names));
+        if (!names) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            return 0;
+        }
+        builder->names = names;
+        builder->name_capacity = capacity;
+    }
+    builder->names[builder->name_count] = offset;
+    if (!up_index_add(builder->name_index, hash, builder->name_count, builder_name_at, builder)) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return 0;
+    }
+    builder->name_count++;
+    return offset;
+}
+
+// Parse a typed scalar the way the generated accessors do: the whole
+// text must be the literal
+static int scalar_kind(const up_string_t *string, const char *type, char payload[8]) {
+    if (!type || !string->length || memchr(string->data, '\0', string->length)) {
+        return UPB_TEXT;
+    }
+    char *end;
+    errno = 0;
+    if (strcmp(type, "int") == 0) {
+        int64_t value = strtoll(string->data, &end, 10);
+        if (*end == '\0' && errno == 0) {
+            memcpy(payload, &value, sizeof(value));
+            return UPB_INT;
+        }
+    } else if (strcmp(type, "float") == 0) {
+        double value = strtod(string->data, &end);
+        if (*end == '\0' && errno == 0) {
+            memcpy(payload, &value, sizeof(value));
+            return UPB_FLOAT;
+        }
+    } else if (strcmp(type, "bool") == 0) {
+        if (strcmp(string->data, "true") == 0 || strcmp(string->data, "false") == 0) {
+            payload[0] = string->data[0] == 't';
+            return UPB_BOOL;
+        }
+    }
+    return UPB_TEXT;
+}
+
+static size_t slots_for(size_t count) {
+    if (count < UP_INDEX_MIN_KEYS) {
+        return 0;
+    }
+    size_t slots = 16;
+    while (slots < count * 2) {
+        slots *= 2;
+    }
+    return slots;
+}
+
+static uint32_t builder_value(upb_builder_t *builder, const up_value_t *value, const char *type);
+
+// Blocks and the root share one layout; `types` may be NULL
+static uint32_t builder_block(upb_builder_t *builder, size_t count, const char *const *keys,
+                              const char *const *types, const up_value_t *const *values) {
+    size_t slots = slots_for(count);
+    if (count > UINT32_MAX / 16) {
+        up_set_error(UP_ERROR_FORMAT, "Document too large for the binary format");
+        return 0;
+    }
+    uint32_t offset = builder_reserve(builder, 16 + count * 12 + slots * 4, 4);
+    if (!offset) {
+        return 0;
+    }
+    put_u32(builder, offset, UP_TYPE_BLOCK);
+    put_u32(builder, offset + 4, (uint32_t)count);
+    put_u32(builder, offset + 8, (uint32_t)slots);
+
+    size_t entries = offset + 16;
+    size_t table = entries + count * 12;
+    for (size_t i = 0; i < count; i++) {
+        const char *type = types ? types[i] : NULL;
+        uint32_t key = builder_name(builder, keys[i]);
+        uint32_t type_name = type ? builder_name(builder, type) : 0;
+        uint32_t child = key && (!type || type_name) ? builder_value(builder, values[i], type) : 0;
+        if (!child) {
+            return 0;
+        }
+        put_u32(builder, entries + i * 12, key);
+        put_u32(builder, entries + i * 12 + 4, type_name);
+        put_u32(builder, entries + i * 12 + 8, child);
+
+        if (slots) {
+            uint32_t hash;
+            memcpy(&hash, builder->data + key, sizeof(hash));
+            size_t slot = hash & (slots - 1);
+            uint32_t taken;
+            while (memcpy(&taken, builder->data + table + slot * 4, 4), taken) {
+                slot = (slot + 1) & (slots - 1);
+            }
+            put_u32(builder, table + slot * 4, (uint32_t)i + 1);
+        }
+    }
+    return offset;
+}
+
+static uint32_t builder_value(upb_builder_t *builder, const up_value_t *value, const char *type) {
+    switch (value->type) {
+        case UP_TYPE_STRING: {
+            const up_string_t *string = &value->as.string;
+            char payload[8] = {0};
+            int kind = scalar_kind(string, type, payload);
+            size_t header = kind == UPB_TEXT ? 8 : 16;
+            uint32_t offset = builder_reserve(builder, header + string->length + 1, 8);
+            if (!offset) {
+                return 0;
+            }
+            put_u32(builder, offset, UP_TYPE_STRING | (uint32_t)kind << 8);
+            put_u32(builder, offset + 4, (uint32_t)string->length);
+            memcpy(builder->data + offset + 8, payload, header - 8);
+            memcpy(builder->data + offset + header, string->data, string->length);
+            return offset;
+        }
+        case UP_TYPE_BLOCK: {
+            const up_block_t *block = &value->as.block;
+            return builder_block(builder, block->count, (const char *const *)block->keys,
+                                 (const char *const *)block->types,
+                                 (const up_value_t *const *)block->values);
+        }
+        case UP_TYPE_LIST: {
+            const up_list_t *list = &value->as.list;
+            if (list->count > UINT32_MAX / 4) {
+                up_set_error(UP_ERROR_FORMAT, "Document too large for the binary format");
+                return 0;
+            }
+            uint32_t offset = builder_reserve(builder, 8 + list->count * 4, 4);
+            if (!offset) {
+                return 0;
+            }
+            put_u32(builder, offset, UP_TYPE_LIST);
+            put_u32(builder, offset + 4, (uint32_t)list->count);
+            for (size_t i = 0; i < list->count; i++) {
+                uint32_t item = builder_value(builder, list->items[i], type);
+                if (!item) {
+                    return 0;
+                }
+                put_u32(builder, offset + 8 + i * 4, item);
+            }
+            return offset;
+        }
+    }
+    up_set_error(UP_ERROR_ARGUMENT, "Unknown value type");
+    return 0;
+}
+
+// Lay out the whole image in memory
+static bool builder_document(upb_builder_t *builder, const up_document_t *doc, uint64_t source_hash) {
+    const char **keys = malloc((doc->count ? doc->count : 1) * sizeof(*keys));
+    const char **types = malloc((doc->count ? doc->count : 1) * sizeof(*types));
+    const up_value_t **values = malloc((doc->count ? doc->count : 1) * sizeof(*values));
+    bool ok = keys && types && values &&
+              up_index_sync(&builder->name_index, 0, builder_name_at, builder);
+    if (!ok) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+    }
+    // The header takes offset 0, which then never names a record
+    if (ok) {
+        builder_reserve(builder, sizeof(up_binary_t), 8);
+        ok = builder->data != NULL;
+    }
+
+    uint32_t root = 0;
+    if (ok) {
+        for (size_t i = 0; i < doc->count; i++) {
+            keys[i] = doc->nodes[i]->key;
+            types[i] = doc->nodes[i]->type_annotation;
+            values[i] = doc->nodes[i]->value;
+        }
+        root = builder_block(builder, doc->count, keys, types, values);
+        ok = root != 0;
+    }
+    free(keys);
+    free(types);
+    free(values);
+    if (!ok) {
+        return false;
+    }
+
+    up_binary_t header = {{'U', 'P', 'B', '\0'}, UP_BINARY_VERSION, UPB_BYTE_ORDER,
+                          (uint32_t)builder->length, root, 0, source_hash};
+    memcpy(builder->data, &header, sizeof(header));
+    return true;
+}
+
+static void builder_free(upb_builder_t *builder) {
+    free(builder->names);
+    up_index_free(builder->name_index);
+}
+
+// The image goes to a temporary file renamed over `path`, so readers
+// never map a partly written file
+bool up_binary_save(const up_document_t *doc, const char *path, uint64_t source_hash) {
+    if (!doc || !path) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return false;
+    }
+
+    upb_builder_t builder = {0};
+    bool ok = builder_document(&builder, doc, source_hash);
+
+    char *temp = ok ? malloc(strlen(path) + 32) : NULL;
+    if (ok && !temp) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        ok = false;
+    }
+    if (ok) {
+#ifdef _WIN32
+        sprintf(temp, "%s.tmp", path);
+#else
+        sprintf(temp, "%s.%ld.tmp", path, (long)getpid());
+#endif
+#ifdef _WIN32
+        FILE *file = fopen(temp, "wb");
+#else
+        // Created afresh and never group or world writable, whatever the
+        // umask, so up_load_cached can trust its own images
+        remove(temp);
+        int fd = open(temp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        FILE *file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+        if (fd >= 0 && !file) {
+            close(fd);
+        }
+#endif
+        ok = file && fwrite(builder.data, 1, builder.length, file) == builder.length;
+        ok = file && fclose(file) == 0 && ok;
+#ifdef _WIN32
+        ok = ok && (remove(path) == 0 || errno == ENOENT);
+#endif
+        ok = ok && rename(temp, path) == 0;
+        if (!ok) {
+            up_set_error(UP_ERROR_IO, "Cannot write %s: %s", path, strerror(errno));
+            remove(temp);
+        }
+    }
+
+    free(temp);
+    free(builder.data);
+    builder_free(&builder);
+    return ok;
+}
+
+bool up_document_save_binary(const up_document_t *doc, const char *path) {
+    return up_binary_save(doc, path, 0);
+}
+
+// Build the image in memory instead; up_binary_close frees it
+const up_binary_t *up_binary_build(const up_document_t *doc, uint64_t source_hash) {
+    upb_builder_t builder = {0};
+    bool ok = builder_document(&builder, doc, source_hash);
+    builder_free(&builder);
+    if (!ok) {
+        free(builder.data);
+        return NULL;
+    }
+
+    up_binary_t *image = (up_binary_t *)builder.data;
+    image->flags = UPB_HEAP;
+    return image;
+}
+
+uint64_t up_binary_source_hash(const up_binary_t *binary) {
+    return binary ? binary->source_hash : 0;
+}
+
+/* ---- Reading ---- */
+
+// Bytes [offset, offset + length) of the image, or NULL if they fall
+// outside it
+static const char *image_at(const up_binary_t *binary, uint32_t offset, size_t length) {
+    if (!binary || !offset || offset > binary->size || length > binary->size - offset) {
+        return NULL;
+    }
+    return (const char *)binary + offset;
+}
+
+static uint32_t image_u32(const up_binary_t *binary, uint32_t offset) {
+    const char *bytes = image_at(binary, offset, 4);
+    uint32_t value = 0;
+    if (bytes) {
+        memcpy(&value, bytes, sizeof(value));
+    }
+    return value;
+}
+
+static bool image_valid(const up_binary_t *binary, size_t size) {
+    static const char magic[4] = {'U', 'P', 'B', '\0'};
+    return size >= sizeof(up_binary_t) && memcmp(binary->magic, magic, 4) == 0 &&
+           binary->version == UP_BINARY_VERSION && binary->byte_order == UPB_BYTE_ORDER &&
+           binary->size == size && binary->flags == 0 &&
+           image_u32(binary, binary->root) == UP_TYPE_BLOCK;
+}
+
+const up_binary_t *up_document_open_binary(const char *path) {
+    return up_binary_open(path, false);
+}
+
+// With `owned`, refuse files that belong to another user or that group or
+// others may write. The check is made on the open descriptor, so the file
+// cannot be swapped between the check and the mapping. Windows has no
+// such check.
+const up_binary_t *up_binary_open(const char *path, bool owned) {
+    if (!path) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return NULL;
+    }
+
+#ifdef _WIN32
+    (void)owned;
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        up_set_error(UP_ERROR_IO, "Cannot open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    up_binary_t header;
+    void *image = NULL;
+    size_t size = 0;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.size >= sizeof(header) &&
+        (image = malloc(header.size))) {
+        memcpy(image, &header, sizeof(header));
+        size = sizeof(header) + fread((char *)image + sizeof(header), 1,
+                                      header.size - sizeof(header), file);
+    }
+    fclose(file);
+    if (!image || !image_valid(image, size)) {
+        free(image);
+        up_set_error(UP_ERROR_FORMAT, "%s is not a valid binary document", path);
+        return NULL;
+    }
+    ((up_binary_t *)image)->flags = UPB_HEAP;
+    return image;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        up_set_error(UP_ERROR_IO, "Cannot open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+    struct stat st;
+    void *image = MAP_FAILED;
+    bool stated = fstat(fd, &st) == 0;
+    if (owned && (!stated || st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)))) {
+        close(fd);
+        up_set_error(UP_ERROR_IO, "%s is not owned by this user or is writable by others", path);
+        return NULL;
+    }
+    if (stated && st.st_size >= (off_t)sizeof(up_binary_t) &&
+        (uintmax_t)st.st_size <= UINT32_MAX) {
+        image = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (image == MAP_FAILED) {
+        up_set_error(UP_ERROR_FORMAT, "%s is not a valid binary document", path);
+        return NULL;
+    }
+    if (!image_valid(image, (size_t)st.st_size)) {
+        munmap(image, (size_t)st.st_size);
+        up_set_error(UP_ERROR_FORMAT, "%s is not a valid binary document", path);
+        return NULL;
+    }
+    return image;
+#endif
+}
+
+void up_binary_close(const up_binary_t *binary) {
+    if (!binary) {
+        return;
+    }
+    if (binary->flags & UPB_HEAP) {
+        free((void *)binary);
+        return;
+    }
+#ifndef _WIN32
+    munmap((void *)binary, binary->size);
+#endif
+}
+
+up_bvalue_t up_binary_root(const up_binary_t *binary) {
+    up_bvalue_t root = {binary, binary ? binary->root : 0};
+    return root;
+}
+
+up_bvalue_t up_binary_get(const up_binary_t *binary, const char *key) {
+    return up_bvalue_get(up_binary_root(binary), key);
+}
+
+// Header of a string record, or NULL if `value` is not a string. The
+// record must fit the image and end in the NUL its length promises, so
+// the text can be handed out as a C string.
+static const char *string_record(up_bvalue_t value, int *kind, uint32_t *length) {
+    uint32_t tag = image_u32(value.binary, value.offset);
+    if (!image_at(value.binary, value.offset, 8) || (tag & 0xff) != UP_TYPE_STRING ||
+        (tag >> 8) > UPB_BOOL) {
+        return NULL;
+    }
+    *kind = (int)(tag >> 8);
+    *length = image_u32(value.binary, value.offset + 4);
+    size_t header = *kind == UPB_TEXT ? 8 : 16;
+    const char *record = image_at(value.binary, value.offset, header + (size_t)*length + 1);
+    return record && record[header + *length] == '\0' ? record : NULL;
+}
+
+// A missing value (offset 0) or a record with an unknown tag has no type;
+// tag 0 alone would otherwise read as UP_TYPE_STRING
+bool up_bvalue_type(up_bvalue_t value, up_value_type_t *type) {
+    if (!image_at(value.binary, value.offset, 4) || !type) {
+        return false;
+    }
+    uint32_t tag = image_u32(value.binary, value.offset);
+    if ((tag & 0xff) == UP_TYPE_STRING) {
+        int kind;
+        uint32_t length;
+        if (!string_record(value, &kind, &length)) {
+            return false;
+        }
+    } else if (tag != UP_TYPE_BLOCK && tag != UP_TYPE_LIST) {
+        return false;
+    }
+    *type = (up_value_type_t)(tag & 0xff);
+    return true;
+}
+
+const char *up_bvalue_string(up_bvalue_t value, size_t *length) {
+    int kind;
+    uint32_t string_length;
+    const char *record = string_record(value, &kind, &string_length);
+    if (!record) {
+        return NULL;
+    }
+    if (length) {
+        *length = string_length;
+    }
+    return record + (kind == UPB_TEXT ? 8 : 16);
+}
+
+static bool scalar_payload(up_bvalue_t value, int expected, void *out, size_t size) {
+    int kind;
+    uint32_t length;
+    const char *record = string_record(value, &kind, &length);
+    if (!record || kind != expected) {
+        return false;
+    }
+    memcpy(out, record + 8, size);
+    return true;
+}
+
+bool up_bvalue_int(up_bvalue_t value, int64_t *out) {
+    return scalar_payload(value, UPB_INT, out, sizeof(*out));
+}
+
+bool up_bvalue_float(up_bvalue_t value, double *out) {
+    return scalar_payload(value, UPB_FLOAT, out, sizeof(*out));
+}
+
+bool up_bvalue_bool(up_bvalue_t value, bool *out) {
+    char flag;
+    if (!scalar_payload(value, UPB_BOOL, &flag, 1)) {
+        return false;
+    }
+    *out = flag != 0;
+    return true;
+}
+
+size_t up_bvalue_count(up_bvalue_t value) {
+    uint32_t tag = image_u32(value.binary, value.offset);
+    if (tag != UP_TYPE_BLOCK && tag != UP_TYPE_LIST) {
+        return 0;
+    }
+    return image_u32(value.binary, value.offset + 4);
+}
+
+// Text of a name record, or NULL if it overruns the image or lacks its NUL
+static const char *name_text(const up_binary_t *binary, uint32_t offset) {
+    uint32_t length = image_u32(binary, offset + 4);
+    const char *text = offset ? image_at(binary, offset + 8, (size_t)length + 1) : NULL;
+    return text && text[length] == '\0' ? text : NULL;
+}
+
+// Offset of block entry `i`'s {key, type, value} triple, or 0 if there
+// is no such entry or the triple lies outside the image
+static uint32_t block_entry(up_bvalue_t value, size_t i) {
+    if (image_u32(value.binary, value.offset) != UP_TYPE_BLOCK ||
+        i >= image_u32(value.binary, value.offset + 4)) {
+        return 0;
+    }
+    uint64_t entry = (uint64_t)value.offset + 16 + (uint64_t)i * 12;
+    return entry <= UINT32_MAX && image_at(value.binary, (uint32_t)entry, 12) ? (uint32_t)entry : 0;
+}
+
+up_bvalue_t up_bvalue_at(up_bvalue_t value, size_t i) {
+    up_bvalue_t item = {value.binary, 0};
+    uint32_t tag = image_u32(value.binary, value.offset);
+    if (tag == UP_TYPE_LIST && i < image_u32(value.binary, value.offset + 4)) {
+        uint64_t slot = (uint64_t)value.offset + 8 + (uint64_t)i * 4;
+        item.offset = slot <= UINT32_MAX ? image_u32(value.binary, (uint32_t)slot) : 0;
+    } else if (tag == UP_TYPE_BLOCK) {
+        uint32_t entry = block_entry(value, i);
+        item.offset = entry ? image_u32(value.binary, entry + 8) : 0;
+    }
+    return item;
+}
+
+const char *up_bvalue_key_at(up_bvalue_t value, size_t i) {
+    uint32_t entry = block_entry(value, i);
+    return entry ? name_text(value.binary, image_u32(value.binary, entry)) : NULL;
+}
+
+const char *up_bvalue_type_at(up_bvalue_t value, size_t i) {
+    uint32_t entry = block_entry(value, i);
+    return entry ? name_text(value.binary, image_u32(value.binary, entry + 4)) : NULL;
+}
+
+// Probe the saved index, or scan small blocks comparing stored hashes
+up_bvalue_t up_bvalue_get(up_bvalue_t value, const char *key) {
+    up_bvalue_t found = {value.binary, 0};
+    if (!key || image_u32(value.binary, value.offset) != UP_TYPE_BLOCK) {
+        return found;
+    }
+
+    const up_binary_t *binary = value.binary;
+    uint32_t count = image_u32(binary, value.offset + 4);
+    uint32_t slots = image_u32(binary, value.offset + 8);
+    uint32_t hash = (uint32_t)up_hash_string(key);
+    uint32_t table = value.offset + 16 + count * 12;
+
+    for (uint32_t probe = 0; probe < (slots ? slots : count); probe++) {
+        uint32_t i = probe;
+        if (slots) {
+            uint32_t slot = image_u32(binary, table + ((hash + probe) & (slots - 1)) * 4);
+            if (!slot) {
+                break;
+            }
+            i = slot - 1;
+        }
+        uint32_t entry = block_entry(value, i);
+        if (!entry && !slots) {
+            break;          // A count larger than the image holds
+        }
+        uint32_t name = entry ? image_u32(binary, entry) : 0;
+        if (image_u32(binary, name) == hash) {
+            const char *text = name_text(binary, name);
+            if (text && strcmp(text, key) == 0) {
+                found.offset = image_u32(binary, entry + 8);
+                break;
+            }
+        }
+    }
+    return found;
+}
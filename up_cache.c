@@ -0,0 +1,101 @@
+/**
+ * Compiled-config cache
+ *
+ * up_load_cached serves a UP file from a UPB image compiled from exactly
+ * the same text. The text is still read and hashed on every load (with
+ * up_hash_bytes, far cheaper than parsing it), and the hash picks and checks
+ * the image: a "<file>.upb" sidecar, or "<hash>.v<version>.upb" under a
+ * cache directory. An edited file, or an image from a library with a
+ * different format version, misses and is compiled again; images are
+ * renamed into place, so concurrent loaders never see a partial one.
+ *
+ * Trust model: an image is run as config without being parsed, so only
+ * the loading user may be able to plant one. The cache directory is
+ * created 0700, images are saved 0644 at most, and an image owned by
+ * another user or writable by group or others is ignored and compiled
+ * again (and replaced, where the directory allows). This guards against
+ * other local users, not against the same user or root; a cache_dir the
+ * caller shares with others is only as safe as its own permissions. On
+ * Windows ownership is not checked.
+ */
+
+#include "up.h"
+#include "up_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static char *cache_entry(const char *path, const char *cache_dir, uint64_t hash) {
+    size_t length = strlen(cache_dir ? cache_dir : path) + 48;
+    char *entry = malloc(length);
+    if (!entry) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+    if (cache_dir) {
+        snprintf(entry, length, "%s/%016llx.v%d.upb", cache_dir,
+                 (unsigned long long)hash, UP_BINARY_VERSION);
+    } else {
+        snprintf(entry, length, "%s.upb", path);
+    }
+    return entry;
+}
+
+const up_binary_t *up_load_cached(const char *path, const up_cache_options_t *opts) {
+    if (!path) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return NULL;
+    }
+    const char *cache_dir = opts ? opts->cache_dir : NULL;
+
+    size_t length;
+    char *text = up_read_file(path, &length);
+    if (!text) {
+        return NULL;
+    }
+    // 0 marks images saved without a source hash
+    uint64_t hash = up_hash_bytes(text, length, UP_BINARY_VERSION) | 1;
+    char *entry = cache_entry(path, cache_dir, hash);
+    if (!entry) {
+        free(text);
+        return NULL;
+    }
+
+    const up_binary_t *binary = up_binary_open(entry, true);
+    if (binary && up_binary_source_hash(binary) == hash) {
+        free(entry);
+        free(text);
+        return binary;
+    }
+    up_binary_close(binary);
+
+    up_document_t *doc = up_parse_string(text);
+    free(text);
+    if (!doc) {
+        free(entry);
+        return NULL;
+    }
+
+    if (cache_dir) {
+#ifdef _WIN32
+        _mkdir(cache_dir);
+#else
+        mkdir(cache_dir, 0700);
+#endif
+    }
+    // An unwritable cache costs the mapping, not the load: the image is
+    // then built in memory instead
+    binary = up_binary_save(doc, entry, hash) ? up_binary_open(entry, true) : NULL;
+    if (!binary) {
+        binary = up_binary_build(doc, hash);
+    }
+    up_document_free(doc);
+    free(entry);
+    return binary;
+}
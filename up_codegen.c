@@ -0,0 +1,572 @@
+/**
+ * UP schema code generator
+ *
+ * Reads a schema written in UP and emits C accessors for it:
+ *
+ *     up-codegen schema.up myconf    # writes myconf.h and myconf.c
+ *
+ * Each schema entry is "key type", where type is string, int, bool, float,
+ * list or value; a "key {" entry opens a nested block:
+ *
+ *     name string
+ *     server {
+ *       port int
+ *       tls {
+ *         cert string
+ *       }
+ *     }
+ *
+ * Every schema block gets a minimal perfect hash over its keys (hash and
+ * displace). `myconf_bind` walks a parsed document once, placing each
+ * known value in a fixed slot; the typed accessors then read that slot
+ * directly with no hashing or strcmp. Keys outside the schema are left for
+ * the generic up_document_get / up_block_get calls.
+ *
+ * Accessor names come from the key path with every character outside
+ * [A-Za-z0-9] turned into '_', so "server.tls" and "server_tls" (or "a-b"
+ * and "a_b") would both be named server_tls. Such schemas are rejected, as
+ * are keys whose accessor would clash with a generated helper.
+ */
+
+#include "up.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    FIELD_STRING,
+    FIELD_INT,
+    FIELD_BOOL,
+    FIELD_FLOAT,
+    FIELD_VALUE,
+    FIELD_BLOCK
+} field_kind_t;
+
+// One schema entry, flattened: slot ids are assigned in depth-first order
+typedef struct {
+    char *path;             // "server.tls.cert"
+    char *ident;            // "server_tls_cert"
+    field_kind_t kind;
+    int child_table;        // Table of a nested block, or -1
+} field_t;
+
+// One schema block and its perfect hash
+typedef struct {
+    const char *path;       // Path of the block, "" at the root
+    size_t size;
+    const char **keys;      // Indexed by local slot
+    int *slots;             // Local slot -> field id
+    uint32_t *displace;     // Bucket -> hash seed
+} table_t;
+
+static field_t *fields;
+static size_t field_count;
+static table_t *tables;
+static size_t table_count;
+
+// Seeds tried per bucket before giving up on a block. Distinct keys almost
+// always place within a few hundred; this only stops pathological input
+// from spinning forever.
+#define MAX_SEED_TRIES (1u << 20)
+
+static void *xrealloc(void *ptr, size_t size) {
+    void *grown = realloc(ptr, size);
+    if (!grown) {
+        fprintf(stderr, "up-codegen: out of memory\n");
+        exit(1);
+    }
+    return grown;
+}
+
+static char *xstrdup(const char *str) {
+    size_t length = strlen(str);
+    char *copy = xrealloc(NULL, length + 1);
+    memcpy(copy, str, length + 1);
+    return copy;
+}
+
+// Must match the hash emitted into the generated source
+static uint32_t schema_hash(const char *key, uint32_t seed) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ ((uint64_t)seed * 0x9e3779b97f4a7c15ULL);
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        hash ^= *p;
+        hash *= 0x100000001b3ULL;
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static bool parse_kind(const char *name, field_kind_t *kind) {
+    static const struct {
+        const char *name;
+        field_kind_t kind;
+    } kinds[] = {
+        {"string", FIELD_STRING}, {"int", FIELD_INT}, {"bool", FIELD_BOOL},
+        {"float", FIELD_FLOAT}, {"list", FIELD_VALUE}, {"value", FIELD_VALUE},
+    };
+
+    for (size_t i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        if (strcmp(name, kinds[i].name) == 0) {
+            *kind = kinds[i].kind;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hash and displace: bucket keys by seed 0, then place the largest
+// buckets first, searching for a seed that lands all their keys in free
+// slots. The result maps n keys onto exactly n slots.
+static void build_perfect_hash(table_t *table) {
+    size_t n = table->size;
+    size_t *bucket_of = xrealloc(NULL, n * sizeof(size_t));
+    size_t *bucket_size = calloc(n, sizeof(size_t));
+    size_t *order = xrealloc(NULL, n * sizeof(size_t));
+    bool *taken = calloc(n, sizeof(bool));
+    size_t *placed = xrealloc(NULL, n * sizeof(size_t));
+    table->displace = calloc(n, sizeof(uint32_t));
+    if (!bucket_size || !taken || !table->displace) {
+        fprintf(stderr, "up-codegen: out of memory\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        bucket_of[i] = schema_hash(table->keys[i], 0) % n;
+        bucket_size[bucket_of[i]]++;
+        order[i] = i;
+    }
+    for (size_t i = 1; i < n; i++) {
+        for (size_t j = i; j > 0 && bucket_size[order[j]] > bucket_size[order[j - 1]]; j--) {
+            size_t swap = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = swap;
+        }
+    }
+
+    const char **keys = xrealloc(NULL, n * sizeof(*keys));
+    int *slots = xrealloc(NULL, n * sizeof(*slots));
+
+    for (size_t b = 0; b < n && bucket_size[order[b]]; b++) {
+        size_t bucket = order[b];
+        uint32_t seed;
+        for (seed = 1; seed <= MAX_SEED_TRIES; seed++) {
+            size_t count = 0;
+            for (size_t i = 0; i < n; i++) {
+                if (bucket_of[i] != bucket) {
+                    continue;
+                }
+                size_t slot = schema_hash(table->keys[i], seed) % n;
+                bool clash = taken[slot];
+                for (size_t k = 0; k < count && !clash; k++) {
+                    clash = schema_hash(table->keys[placed[k]], seed) % n == slot;
+                }
+                if (clash) {
+                    break;
+                }
+                placed[count++] = i;
+            }
+            if (count == bucket_size[bucket]) {
+                table->displace[bucket] = seed;
+                for (size_t k = 0; k < count; k++) {
+                    size_t slot = schema_hash(table->keys[placed[k]], seed) % n;
+                    taken[slot] = true;
+                    keys[slot] = table->keys[placed[k]];
+                    slots[slot] = table->slots[placed[k]];
+                }
+                break;
+            }
+        }
+        if (seed > MAX_SEED_TRIES) {
+            fprintf(stderr, "up-codegen: %s: no perfect hash found after %u seeds\n",
+                    *table->path ? table->path : "(root)", MAX_SEED_TRIES);
+            exit(1);
+        }
+    }
+
+    free((void *)table->keys);
+    free(table->slots);
+    table->keys = keys;
+    table->slots = slots;
+    free(bucket_of);
+    free(bucket_size);
+    free(order);
+    free(taken);
+    free(placed);
+}
+
+static int add_table(const char *const *keys, const up_value_t *const *values,
+                     size_t count, const char *parent_path);
+
+// Accessor suffixes the generated source already uses for itself
+static bool reserved_ident(const char *ident) {
+    static const char *const names[] = {"t", "bind", "bind_entry", "find", "hash", "scalar",
+                                        "table_t", "tables"};
+    static const char *const arrays[] = {"keys_", "slots_", "children_", "displace_"};
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(ident, names[i]) == 0) {
+            return true;
+        }
+    }
+    for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+        size_t length = strlen(arrays[i]);
+        if (strncmp(ident, arrays[i], length) == 0 && ident[length] &&
+            strspn(ident + length, "0123456789") == strlen(ident + length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int add_field(const char *key, const up_value_t *value, const char *parent_path) {
+    size_t path_length = strlen(parent_path) + strlen(key) + 2;
+    char *path = xrealloc(NULL, path_length);
+    snprintf(path, path_length, "%s%s%s", parent_path, *parent_path ? "." : "", key);
+
+    char *ident = xstrdup(path);
+    for (char *p = ident; *p; p++) {
+        if (!isalnum((unsigned char)*p)) {
+            *p = '_';
+        }
+    }
+    for (size_t i = 0; i < field_count; i++) {
+        if (strcmp(fields[i].ident, ident) == 0) {
+            fprintf(stderr, "up-codegen: %s and %s would both be named '%s'\n",
+                    fields[i].path, path, ident);
+            exit(1);
+        }
+    }
+    if (reserved_ident(ident)) {
+        fprintf(stderr, "up-codegen: %s: accessor name '%s' is reserved\n", path, ident);
+        exit(1);
+    }
+
+    field_kind_t kind;
+    if (value->type == UP_TYPE_BLOCK) {
+        kind = FIELD_BLOCK;
+    } else if (value->type != UP_TYPE_STRING || !parse_kind(value->as.string.data, &kind)) {
+        fprintf(stderr, "up-codegen: %s: expected a type or a block\n", path);
+        exit(1);
+    }
+
+    int id = (int)field_count;
+    fields = xrealloc(fields, (field_count + 1) * sizeof(*fields));
+    fields[field_count++] = (field_t){path, ident, kind, -1};
+
+    if (kind == FIELD_BLOCK) {
+        const up_block_t *block = &value->as.block;
+        int child = add_table((const char *const *)block->keys,
+                              (const up_value_t *const *)block->values, block->count, path);
+        fields[id].child_table = child;
+    }
+    return id;
+}
+
+static int add_table(const char *const *keys, const up_value_t *const *values,
+                     size_t count, const char *parent_path) {
+    int id = (int)table_count;
+    tables = xrealloc(tables, (table_count + 1) * sizeof(*tables));
+    table_count++;
+
+    table_t table = {parent_path, count, NULL, NULL, NULL};
+    table.keys = xrealloc(NULL, (count ? count : 1) * sizeof(*table.keys));
+    table.slots = xrealloc(NULL, (count ? count : 1) * sizeof(*table.slots));
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (strcmp(keys[i], keys[j]) == 0) {
+                fprintf(stderr, "up-codegen: duplicate schema key '%s'\n", keys[i]);
+                exit(1);
+            }
+        }
+        table.keys[i] = keys[i];
+        table.slots[i] = add_field(keys[i], values[i], parent_path);
+    }
+    if (count) {
+        build_perfect_hash(&table);
+    }
+    tables[id] = table;
+    return id;
+}
+
+static void emit_header(FILE *out, const char *prefix) {
+    char *upper = xstrdup(prefix);
+    for (char *p = upper; *p; p++) {
+        *p = (char)toupper((unsigned char)*p);
+    }
+
+    fprintf(out, "/**\n * Generated by up-codegen; do not edit\n */\n\n");
+    fprintf(out, "#ifndef %s_H\n#define %s_H\n\n", upper, upper);
+    fprintf(out, "#include \"up.h\"\n\n");
+    fprintf(out, "#define %s_SLOT_COUNT %zu\n\n", upper, field_count);
+    fprintf(out, "// Values bound to schema slots; NULL where the document has none\n");
+    fprintf(out, "typedef struct {\n    const up_value_t *slots[%zu];\n} %s_t;\n\n",
+            field_count ? field_count : 1, prefix);
+    fprintf(out, "void %s_bind(%s_t *cfg, const up_document_t *doc);\n\n", prefix, prefix);
+
+    for (size_t i = 0; i < field_count; i++) {
+        const field_t *field = &fields[i];
+        switch (field->kind) {
+            case FIELD_STRING:
+                fprintf(out, "const char *%s_%s(const %s_t *cfg);\n", prefix, field->ident, prefix);
+                break;
+            case FIELD_INT:
+                fprintf(out, "bool %s_%s(const %s_t *cfg, long *out);\n", prefix, field->ident, prefix);
+                break;
+            case FIELD_BOOL:
+                fprintf(out, "bool %s_%s(const %s_t *cfg, bool *out);\n", prefix, field->ident, prefix);
+                break;
+            case FIELD_FLOAT:
+                fprintf(out, "bool %s_%s(const %s_t *cfg, double *out);\n", prefix, field->ident, prefix);
+                break;
+            case FIELD_VALUE:
+            case FIELD_BLOCK:
+                fprintf(out, "const up_value_t *%s_%s(const %s_t *cfg);\n", prefix, field->ident, prefix);
+                break;
+        }
+    }
+    fprintf(out, "\n#endif // %s_H\n", upper);
+    free(upper);
+}
+
+static void emit_source(FILE *out, const char *prefix) {
+    fprintf(out, "/**\n * Generated by up-codegen; do not edit\n */\n\n");
+    fprintf(out, "#include \"%s.h\"\n#include <errno.h>\n#include <stdint.h>\n#include <stdlib.h>\n"
+                 "#include <string.h>\n\n", prefix);
+
+    fprintf(out, "typedef struct {\n    size_t size;\n    const char *const *keys;\n"
+                 "    const int *slots;\n    const int *children;\n    const uint32_t *displace;\n"
+                 "} %s_table_t;\n\n", prefix);
+
+    for (size_t t = 0; t < table_count; t++) {
+        const table_t *table = &tables[t];
+        if (!table->size) {
+            continue;
+        }
+        fprintf(out, "static const char *const %s_keys_%zu[] = {", prefix, t);
+        for (size_t i = 0; i < table->size; i++) {
+            fprintf(out, "%s\"%s\"", i ? ", " : "", table->keys[i]);
+        }
+        fprintf(out, "};\nstatic const int %s_slots_%zu[] = {", prefix, t);
+        for (size_t i = 0; i < table->size; i++) {
+            fprintf(out, "%s%d", i ? ", " : "", table->slots[i]);
+        }
+        fprintf(out, "};\nstatic const int %s_children_%zu[] = {", prefix, t);
+        for (size_t i = 0; i < table->size; i++) {
+            fprintf(out, "%s%d", i ? ", " : "", fields[table->slots[i]].child_table);
+        }
+        fprintf(out, "};\nstatic const uint32_t %s_displace_%zu[] = {", prefix, t);
+        for (size_t i = 0; i < table->size; i++) {
+            fprintf(out, "%s%u", i ? ", " : "", (unsigned)table->displace[i]);
+        }
+        fprintf(out, "};\n\n");
+    }
+
+    fprintf(out, "static const %s_table_t %s_tables[] = {\n", prefix, prefix);
+    for (size_t t = 0; t < table_count; t++) {
+        if (tables[t].size) {
+            fprintf(out, "    {%zu, %s_keys_%zu, %s_slots_%zu, %s_children_%zu, %s_displace_%zu},\n",
+                    tables[t].size, prefix, t, prefix, t, prefix, t, prefix, t);
+        } else {
+            fprintf(out, "    {0, NULL, NULL, NULL, NULL},\n");
+        }
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out,
+            "static uint32_t %s_hash(const char *key, uint32_t seed) {\n"
+            "    uint64_t hash = 0xcbf29ce484222325ULL ^ ((uint64_t)seed * 0x9e3779b97f4a7c15ULL);\n"
+            "    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {\n"
+            "        hash ^= *p;\n"
+            "        hash *= 0x100000001b3ULL;\n"
+            "    }\n"
+            "    return (uint32_t)(hash ^ (hash >> 32));\n"
+            "}\n\n", prefix);
+
+    fprintf(out,
+            "// Local slot of a schema key, or -1 for keys outside the schema\n"
+            "static int %s_find(const %s_table_t *table, const char *key) {\n"
+            "    if (!table->size) {\n"
+            "        return -1;\n"
+            "    }\n"
+            "    uint32_t bucket = %s_hash(key, 0) %% table->size;\n"
+            "    uint32_t slot = %s_hash(key, table->displace[bucket]) %% table->size;\n"
+            "    return strcmp(table->keys[slot], key) == 0 ? (int)slot : -1;\n"
+            "}\n\n", prefix, prefix, prefix, prefix);
+
+    fprintf(out,
+            "static void %s_bind_entry(%s_t *cfg, int table, const char *key, const up_value_t *value) {\n"
+            "    const %s_table_t *t = &%s_tables[table];\n"
+            "    int local = %s_find(t, key);\n"
+            "    if (local < 0 || cfg->slots[t->slots[local]]) {\n"
+            "        return;\n"
+            "    }\n"
+            "    cfg->slots[t->slots[local]] = value;\n"
+            "    if (t->children[local] >= 0 && value->type == UP_TYPE_BLOCK) {\n"
+            "        for (size_t i = 0; i < value->as.block.count; i++) {\n"
+            "            %s_bind_entry(cfg, t->children[local], value->as.block.keys[i],\n"
+            "                          value->as.block.values[i]);\n"
+            "        }\n"
+            "    }\n"
+            "}\n\n", prefix, prefix, prefix, prefix, prefix, prefix);
+
+    fprintf(out,
+            "// Resolve every schema path in one pass over the document\n"
+            "void %s_bind(%s_t *cfg, const up_document_t *doc) {\n"
+            "    memset(cfg, 0, sizeof(*cfg));\n"
+            "    for (size_t i = 0; doc && i < doc->count; i++) {\n"
+            "        %s_bind_entry(cfg, 0, doc->nodes[i]->key, doc->nodes[i]->value);\n"
+            "    }\n"
+            "}\n\n", prefix, prefix, prefix);
+
+    fprintf(out,
+            "static const char *%s_scalar(const %s_t *cfg, int slot) {\n"
+            "    const up_value_t *value = cfg->slots[slot];\n"
+            "    return value && value->type == UP_TYPE_STRING ? value->as.string.data : NULL;\n"
+            "}\n", prefix, prefix);
+
+    for (size_t i = 0; i < field_count; i++) {
+        const field_t *field = &fields[i];
+        fprintf(out, "\n// %s\n", field->path);
+        switch (field->kind) {
+            case FIELD_STRING:
+                fprintf(out, "const char *%s_%s(const %s_t *cfg) {\n"
+                             "    return %s_scalar(cfg, %zu);\n}\n",
+                        prefix, field->ident, prefix, prefix, i);
+                break;
+            case FIELD_INT:
+                fprintf(out, "bool %s_%s(const %s_t *cfg, long *out) {\n"
+                             "    const char *text = %s_scalar(cfg, %zu);\n"
+                             "    char *end;\n"
+                             "    if (!text || !*text) {\n        return false;\n    }\n"
+                             "    errno = 0;\n"
+                             "    long value = strtol(text, &end, 10);\n"
+                             "    if (*end != '\\0' || errno == ERANGE) {\n        return false;\n    }\n"
+                             "    *out = value;\n"
+                             "    return true;\n}\n",
+                        prefix, field->ident, prefix, prefix, i);
+                break;
+            case FIELD_BOOL:
+                fprintf(out, "bool %s_%s(const %s_t *cfg, bool *out) {\n"
+                             "    const char *text = %s_scalar(cfg, %zu);\n"
+                             "    if (!text || (strcmp(text, \"true\") != 0 && strcmp(text, \"false\") != 0)) {\n"
+                             "        return false;\n    }\n"
+                             "    *out = text[0] == 't';\n"
+                             "    return true;\n}\n",
+                        prefix, field->ident, prefix, prefix, i);
+                break;
+            case FIELD_FLOAT:
+                fprintf(out, "bool %s_%s(const %s_t *cfg, double *out) {\n"
+                             "    const char *text = %s_scalar(cfg, %zu);\n"
+                             "    char *end;\n"
+                             "    if (!text || !*text) {\n        return false;\n    }\n"
+                             "    errno = 0;\n"
+                             "    double value = strtod(text, &end);\n"
+                             "    if (*end != '\\0' || errno == ERANGE) {\n        return false;\n    }\n"
+                             "    *out = value;\n"
+                             "    return true;\n}\n",
+                        prefix, field->ident, prefix, prefix, i);
+                break;
+            case FIELD_VALUE:
+            case FIELD_BLOCK:
+                fprintf(out, "const up_value_t *%s_%s(const %s_t *cfg) {\n"
+                             "    return cfg->slots[%zu];\n}\n",
+                        prefix, field->ident, prefix, i);
+                break;
+        }
+    }
+}
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+
+    size_t length = 0, capacity = 4096;
+    char *data = xrealloc(NULL, capacity);
+    size_t n;
+    while ((n = fread(data + length, 1, capacity - length - 1, file)) > 0) {
+        length += n;
+        if (capacity - length - 1 == 0) {
+            capacity *= 2;
+            data = xrealloc(data, capacity);
+        }
+    }
+    fclose(file);
+    data[length] = '\0';
+    return data;
+}
+
+static FILE *open_output(const char *prefix, const char *extension) {
+    size_t length = strlen(prefix) + strlen(extension) + 1;
+    char *path = xrealloc(NULL, length);
+    snprintf(path, length, "%s%s", prefix, extension);
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    free(path);
+    return file;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: up-codegen <schema.up> <prefix>\n");
+        return 2;
+    }
+
+    const char *prefix = argv[2];
+    if (!isalpha((unsigned char)prefix[0])) {
+        fprintf(stderr, "up-codegen: prefix must be a C identifier\n");
+        return 2;
+    }
+    for (const char *p = prefix; *p; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '_') {
+            fprintf(stderr, "up-codegen: prefix must be a C identifier\n");
+            return 2;
+        }
+    }
+
+    char *input = read_file(argv[1]);
+    up_document_t *schema = up_parse_string(input);
+    free(input);
+    if (!schema) {
+        fprintf(stderr, "%s: %s\n", argv[1], up_get_error());
+        return 1;
+    }
+
+    const char **keys = xrealloc(NULL, (schema->count ? schema->count : 1) * sizeof(*keys));
+    const up_value_t **values = xrealloc(NULL, (schema->count ? schema->count : 1) * sizeof(*values));
+    for (size_t i = 0; i < schema->count; i++) {
+        keys[i] = schema->nodes[i]->key;
+        values[i] = schema->nodes[i]->value;
+    }
+    add_table(keys, values, schema->count, "");
+
+    FILE *header = open_output(prefix, ".h");
+    emit_header(header, prefix);
+    fclose(header);
+
+    FILE *source = open_output(prefix, ".c");
+    emit_source(source, prefix);
+    fclose(source);
+
+    for (size_t i = 0; i < field_count; i++) {
+        free(fields[i].path);
+        free(fields[i].ident);
+    }
+    for (size_t i = 0; i < table_count; i++) {
+        free((void *)tables[i].keys);
+        free(tables[i].slots);
+        free(tables[i].displace);
+    }
+    free(fields);
+    free(tables);
+    free(keys);
+    free(values);
+    up_document_free(schema);
+    return 0;
+}
@@ -0,0 +1,292 @@
+/**
+ * Structural diff
+ *
+ * up_diff walks both trees together and reports leaf paths only: a block
+ * present on both sides is descended into, list items are compared by
+ * position, and a key whose annotation or value type changed is reported
+ * once at that key. Subtrees are skipped without a walk when both sides
+ * are the same value (clones share them) or are frozen with equal cached
+ * hashes, so the cost follows the size of the change rather than of the
+ * documents.
+ *
+ * Keys are matched by position first, since most snapshots keep their
+ * order, and otherwise through the container's own index or a scratch
+ * index built for the diff. Equal hashes are trusted as equal subtrees.
+ */
+
+#include "up.h"
+#include "up_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+typedef struct {
+    up_diff_fn visit;
+    void *context;
+    char *path;
+    size_t path_length;
+    size_t path_capacity;
+} diff_t;
+
+// The entries of a document or a block, viewed the same way
+typedef struct {
+    const up_document_t *doc;   // Exactly one of doc and block is set
+    const up_block_t *block;
+    size_t count;
+    up_index_t *scratch;        // Built when the owner has no usable index
+} entries_t;
+
+static const char *document_key_at(const void *owner, size_t position) {
+    return ((const up_document_t *)owner)->nodes[position]->key;
+}
+
+static const char *block_key_at(const void *owner, size_t position) {
+    return ((const up_block_t *)owner)->keys[position];
+}
+
+static const char *entry_key(const entries_t *e, size_t i) {
+    return e->doc ? e->doc->nodes[i]->key : e->block->keys[i];
+}
+
+static const char *entry_type(const entries_t *e, size_t i) {
+    if (e->doc) {
+        return e->doc->nodes[i]->type_annotation;
+    }
+    return e->block->types ? e->block->types[i] : NULL;
+}
+
+static const up_value_t *entry_value(const entries_t *e, size_t i) {
+    return e->doc ? e->doc->nodes[i]->value : e->block->values[i];
+}
+
+static bool entries_index(entries_t *e, up_index_key_fn key_at, const void *owner) {
+    if (!up_index_sync(&e->scratch, e->count, key_at, owner)) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return false;
+    }
+    return true;
+}
+
+static bool entries_init(entries_t *e, const up_document_t *doc, const up_block_t *block) {
+    e->doc = doc;
+    e->block = block;
+    e->count = doc ? doc->count : block->count;
+    e->scratch = NULL;
+
+    if (doc) {
+        bool indexed = doc->index && doc->index->covered == doc->count;
+        if (doc->count < UP_INDEX_MIN_KEYS || indexed) {
+            return true;
+        }
+        return entries_index(e, document_key_at, doc);
+    }
+
+    // up_block_find already answers quickly for these
+    bool indexed = block->index && block->index->covered == block->count;
+    if (block->sorted || indexed || block->count < UP_BLOCK_INDEX_MIN_KEYS) {
+        return true;
+    }
+    return entries_index(e, block_key_at, block);
+}
+
+static size_t entries_find(const entries_t *e, const char *key) {
+    uint64_t hash = up_hash_string(key);
+    const up_index_t *index = e->scratch;
+    if (!index && e->doc && e->doc->count >= UP_INDEX_MIN_KEYS) {
+        index = e->doc->index;
+    }
+
+    if (index) {
+        size_t position;
+        up_index_key_fn key_at = e->doc ? document_key_at : block_key_at;
+        const void *owner = e->doc ? (const void *)e->doc : (const void *)e->block;
+        return up_index_lookup(index, key, hash, key_at, owner, &position) ? position : e->count;
+    }
+    if (e->block) {
+        return up_block_find(e->block, key, hash);
+    }
+    for (size_t i = 0; i < e->count; i++) {
+        if (strcmp(entry_key(e, i), key) == 0) {
+            return i;
+        }
+    }
+    return e->count;
+}
+
+// Extend the current path by ".key" (or "key" at the root) or "[index]"
+static bool push_path(diff_t *d, const char *key, size_t index) {
+    char brackets[32];
+    const char *part = key;
+    size_t length;
+    if (key) {
+        length = strlen(key) + (d->path_length ? 1 : 0);
+    } else {
+        length = (size_t)snprintf(brackets, sizeof(brackets), "[%zu]", index);
+        part = brackets;
+    }
+
+    size_t needed = d->path_length + length + 1;
+    if (needed > d->path_capacity) {
+        size_t capacity = d->path_capacity ? d->path_capacity * 2 : 256;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        char *path = realloc(d->path, capacity);
+        if (!path) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            return false;
+        }
+        d->path = path;
+        d->path_capacity = capacity;
+    }
+
+    if (key && d->path_length) {
+        d->path[d->path_length++] = '.';
+        length--;
+    }
+    memcpy(d->path + d->path_length, part, length);
+    d->path_length += length;
+    d->path[d->path_length] = '\0';
+    return true;
+}
+
+static bool same_type(const char *a, const char *b) {
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+static bool value_frozen(const up_value_t *value) {
+    switch (value->type) {
+        case UP_TYPE_BLOCK:
+            return value->as.block.frozen;
+        case UP_TYPE_LIST:
+            return value->as.list.frozen;
+        default:
+            return false;
+    }
+}
+
+static bool diff_entries(diff_t *d, const entries_t *a, const entries_t *b);
+
+// Compare the values at the current path
+static bool diff_value(diff_t *d, const up_value_t *a, const up_value_t *b) {
+    if (a == b) {
+        return true;
+    }
+    if (a->type != b->type) {
+        d->visit(UP_DIFF_CHANGED, d->path, a, b, d->context);
+        return true;
+    }
+
+    switch (a->type) {
+        case UP_TYPE_STRING:
+            if (a->as.string.length != b->as.string.length ||
+                memcmp(a->as.string.data, b->as.string.data, a->as.string.length) != 0) {
+                d->visit(UP_DIFF_CHANGED, d->path, a, b, d->context);
+            }
+            return true;
+
+        case UP_TYPE_BLOCK: {
+            if (value_frozen(a) && value_frozen(b) && up_value_hash(a, 0) == up_value_hash(b, 0)) {
+                return true;
+            }
+            entries_t ea = {0}, eb = {0};
+            bool ok = entries_init(&ea, NULL, &a->as.block) && entries_init(&eb, NULL, &b->as.block) &&
+                      diff_entries(d, &ea, &eb);
+            up_index_free(ea.scratch);
+            up_index_free(eb.scratch);
+            return ok;
+        }
+
+        case UP_TYPE_LIST: {
+            if (value_frozen(a) && value_frozen(b) && up_value_hash(a, 0) == up_value_hash(b, 0)) {
+                return true;
+            }
+            const up_list_t *la = &a->as.list;
+            const up_list_t *lb = &b->as.list;
+            size_t mark = d->path_length;
+            size_t count = la->count > lb->count ? la->count : lb->count;
+            for (size_t i = 0; i < count; i++) {
+                if (!push_path(d, NULL, i)) {
+                    return false;
+                }
+                if (i >= lb->count) {
+                    d->visit(UP_DIFF_REMOVED, d->path, la->items[i], NULL, d->context);
+                } else if (i >= la->count) {
+                    d->visit(UP_DIFF_ADDED, d->path, NULL, lb->items[i], d->context);
+                } else if (!diff_value(d, la->items[i], lb->items[i])) {
+                    return false;
+                }
+                d->path_length = mark;
+                d->path[mark] = '\0';
+            }
+            return true;
+        }
+    }
+    return true;
+}
+
+// Removed and changed keys in `a` order, then added keys in `b` order
+static bool diff_entries(diff_t *d, const entries_t *a, const entries_t *b) {
+    bool *matched = b->count ? calloc(b->count, sizeof(bool)) : NULL;
+    if (b->count && !matched) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return false;
+    }
+
+    size_t mark = d->path_length;
+    bool ok = true;
+    for (size_t i = 0; ok && i < a->count; i++) {
+        const char *key = entry_key(a, i);
+        size_t j = i < b->count && strcmp(entry_key(b, i), key) == 0 ? i : entries_find(b, key);
+        if (!push_path(d, key, 0)) {
+            ok = false;
+            break;
+        }
+        if (j == b->count) {
+            d->visit(UP_DIFF_REMOVED, d->path, entry_value(a, i), NULL, d->context);
+        } else {
+            matched[j] = true;
+            if (!same_type(entry_type(a, i), entry_type(b, j))) {
+                d->visit(UP_DIFF_CHANGED, d->path, entry_value(a, i), entry_value(b, j), d->context);
+            } else {
+                ok = diff_value(d, entry_value(a, i), entry_value(b, j));
+            }
+        }
+        d->path_length = mark;
+        d->path[mark] = '\0';
+    }
+
+    for (size_t j = 0; ok && j < b->count; j++) {
+        if (matched[j]) {
+            continue;
+        }
+        if (!push_path(d, entry_key(b, j), 0)) {
+            ok = false;
+            break;
+        }
+        d->visit(UP_DIFF_ADDED, d->path, NULL, entry_value(b, j), d->context);
+        d->path_length = mark;
+        d->path[mark] = '\0';
+    }
+
+    free(matched);
+    return ok;
+}
+
+bool up_diff(const up_document_t *a, const up_document_t *b, up_diff_fn visit, void *context) {
+    if (!a || !b || !visit) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return false;
+    }
+    if (a == b || (a->frozen && b->frozen && up_document_hash(a, 0) == up_document_hash(b, 0))) {
+        return true;
+    }
+
+    diff_t d = {visit, context, NULL, 0, 0};
+    entries_t ea = {0}, eb = {0};
+    bool ok = entries_init(&ea, a, NULL) && entries_init(&eb, b, NULL) && diff_entries(&d, &ea, &eb);
+    up_index_free(ea.scratch);
+    up_index_free(eb.scratch);
+    free(d.path);
+    return ok;
+}
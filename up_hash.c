@@ -0,0 +1,140 @@
+/**
+ * Structural hashing
+ *
+ * Hashes are computed bottom-up over the tree: strings with up_hash_bytes,
+ * block entries from their key, annotation and value hash, and containers
+ * by folding their children in order. Unordered hashing folds block
+ * entries with a sum and an xor instead, which does not depend on order.
+ *
+ * Frozen containers keep their hash in hash_cache after the first call.
+ * Several readers may fill the cache of one frozen document at once; they
+ * all store the same value, with relaxed atomics where the compiler has
+ * them so the race stays well defined.
+ */
+
+#include "up.h"
+#include "up_internal.h"
+#include <string.h>
+
+#define HASH_K 0x9e3779b97f4a7c15ULL
+
+enum {
+    SEED_STRING = 0x5354,
+    SEED_BLOCK = 0x424c,
+    SEED_LIST = 0x4c53,
+    SEED_NAME = 0x4e4d
+};
+
+static uint64_t mix(uint64_t hash, uint64_t value) {
+    hash = (hash ^ value) * HASH_K;
+    return hash ^ (hash >> 32);
+}
+
+static uint64_t cache_load(const uint64_t *slot) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __atomic_load_n(slot, __ATOMIC_RELAXED);
+#else
+    return *slot;
+#endif
+}
+
+static void cache_store(uint64_t *slot, uint64_t hash) {
+#if defined(__GNUC__) || defined(__clang__)
+    __atomic_store_n(slot, hash, __ATOMIC_RELAXED);
+#else
+    *slot = hash;
+#endif
+}
+
+static uint64_t name_hash(const char *name) {
+    return name ? up_hash_bytes(name, strlen(name), SEED_NAME) : 0;
+}
+
+// Fold one entry into a block hash: in sequence, or into a sum and an xor
+// that ignore order
+typedef struct {
+    uint64_t ordered;
+    uint64_t sum;
+    uint64_t xor;
+} entry_fold_t;
+
+static void fold_entry(entry_fold_t *fold, const char *key, const char *type, uint64_t value) {
+    uint64_t entry = mix(mix(name_hash(key), name_hash(type)), value);
+    fold->ordered = mix(fold->ordered, entry);
+    fold->sum += entry;
+    fold->xor ^= entry;
+}
+
+static uint64_t fold_result(const entry_fold_t *fold, size_t count, unsigned flags) {
+    uint64_t hash = flags & UP_HASH_UNORDERED ? mix(mix(SEED_BLOCK, fold->sum), fold->xor)
+                                              : fold->ordered;
+    hash = mix(hash, count);
+    return hash ? hash : 1;
+}
+
+uint64_t up_value_hash(const up_value_t *value, unsigned flags) {
+    if (!value) {
+        return 0;
+    }
+    if (value->type == UP_TYPE_STRING) {
+        return mix(SEED_STRING, up_hash_bytes(value->as.string.data, value->as.string.length, SEED_STRING));
+    }
+
+    unsigned slot = flags & UP_HASH_UNORDERED ? 1 : 0;
+    bool frozen = value->type == UP_TYPE_BLOCK ? value->as.block.frozen : value->as.list.frozen;
+    uint64_t *cache = (uint64_t *)&value->hash_cache[slot];
+    uint64_t hash = frozen ? cache_load(cache) : 0;
+    if (hash) {
+        return hash;
+    }
+
+    if (value->type == UP_TYPE_BLOCK) {
+        const up_block_t *block = &value->as.block;
+        entry_fold_t fold = {SEED_BLOCK, 0, 0};
+        for (size_t i = 0; i < block->count; i++) {
+            fold_entry(&fold, block->keys[i], block->types ? block->types[i] : NULL,
+                       up_value_hash(block->values[i], flags));
+        }
+        hash = fold_result(&fold, block->count, flags);
+    } else {
+        const up_list_t *list = &value->as.list;
+        hash = SEED_LIST;
+        for (size_t i = 0; i < list->count; i++) {
+            hash = mix(hash, up_value_hash(list->items[i], flags));
+        }
+        hash = mix(hash, list->count);
+        hash = hash ? hash : 1;
+    }
+
+    if (frozen) {
+        cache_store(cache, hash);
+    }
+    return hash;
+}
+
+// A document hashes like a block holding its nodes, so a document and a
+// block with the same entries match
+uint64_t up_document_hash(const up_document_t *doc, unsigned flags) {
+    if (!doc) {
+        return 0;
+    }
+
+    unsigned slot = flags & UP_HASH_UNORDERED ? 1 : 0;
+    uint64_t *cache = (uint64_t *)&doc->hash_cache[slot];
+    uint64_t hash = doc->frozen ? cache_load(cache) : 0;
+    if (hash) {
+        return hash;
+    }
+
+    entry_fold_t fold = {SEED_BLOCK, 0, 0};
+    for (size_t i = 0; i < doc->count; i++) {
+        const up_node_t *node = doc->nodes[i];
+        fold_entry(&fold, node->key, node->type_annotation, up_value_hash(node->value, flags));
+    }
+    hash = fold_result(&fold, doc->count, flags);
+
+    if (doc->frozen) {
+        cache_store(cache, hash);
+    }
+    return hash;
+}
@@ -0,0 +1,274 @@
+/**
+ * Open-addressing key index
+ *
+ * A Swiss-table style hash index from keys to their position in an owner
+ * array (document nodes or block keys). Each slot has a control byte with
+ * a 7-bit hash tag, scanned a group of 16 at a time (with SSE2 when the
+ * compiler targets it). Keys are not copied: the owner maps a position
+ * back to its key through a callback, so a slot costs five bytes.
+ */
+
+#include "up_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define UP_INDEX_GROUP 16
+#define UP_INDEX_EMPTY 0x80
+
+// FNV-1a; keys are short, so a byte loop beats anything with setup cost
+uint64_t up_hash_string(const char *key) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        hash ^= *p;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Bulk hash for long inputs (file contents, string values): four
+// independent multiply-xorshift lanes over 8-byte words, folded together
+// at the end, so throughput is bound by memory rather than multiply
+// latency
+uint64_t up_hash_bytes(const void *data, size_t length, uint64_t seed) {
+    const unsigned char *bytes = data;
+    const uint64_t k = 0x9e3779b97f4a7c15ULL;
+    uint64_t lanes[4] = {seed ^ length, k, k << 1, k << 2};
+    size_t i = 0;
+
+    for (; i + 32 <= length; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, bytes + i + lane * 8, sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * k;
+            lanes[lane] ^= lanes[lane] >> 32;
+        }
+    }
+    for (; i < length; i++) {
+        lanes[0] = (lanes[0] ^ bytes[i]) * 0x100000001b3ULL;
+    }
+
+    uint64_t hash = seed;
+    for (int lane = 0; lane < 4; lane++) {
+        hash = (hash ^ lanes[lane]) * k;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+// Bitmask of the control bytes in a group equal to `tag`
+static unsigned group_match(const uint8_t *ctrl, uint8_t tag) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+#else
+    unsigned mask = 0;
+    for (unsigned i = 0; i < UP_INDEX_GROUP; i++) {
+        if (ctrl[i] == tag) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+static unsigned lowest_bit(unsigned mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctz(mask);
+#else
+    unsigned bit = 0;
+    while (!(mask & 1u)) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static size_t first_group(const up_index_t *index, uint64_t hash) {
+    return (size_t)(hash >> 7) & (index->capacity / UP_INDEX_GROUP - 1);
+}
+
+static uint8_t hash_tag(uint64_t hash) {
+    return (uint8_t)(hash & 0x7f);
+}
+
+// Linear search over stored 32-bit hash prefixes, four at a time with
+// SSE2. Returns the position of `key`, or `count` if it is absent.
+size_t up_hash_scan(const uint32_t *hashes, size_t count, uint32_t hash, const char *key,
+                    up_index_key_fn key_at, const void *owner) {
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i needle = _mm_set1_epi32((int)hash);
+    for (; i + 4 <= count; i += 4) {
+        __m128i group = _mm_loadu_si128((const __m128i *)(hashes + i));
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(group, needle)));
+        for (; mask; mask &= mask - 1) {
+            size_t position = i + lowest_bit(mask);
+            if (strcmp(key_at(owner, position), key) == 0) {
+                return position;
+            }
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        if (hashes[i] == hash && strcmp(key_at(owner, i), key) == 0) {
+            return i;
+        }
+    }
+    return count;
+}
+
+static up_index_t *index_new(size_t capacity) {
+    up_index_t *index = calloc(1, sizeof(up_index_t));
+    if (!index) {
+        return NULL;
+    }
+    index->ctrl = malloc(capacity);
+    index->slots = malloc(capacity * sizeof(*index->slots));
+    if (!index->ctrl || !index->slots) {
+        up_index_free(index);
+        return NULL;
+    }
+    memset(index->ctrl, UP_INDEX_EMPTY, capacity);
+    index->capacity = capacity;
+    return index;
+}
+
+void up_index_free(up_index_t *index) {
+    if (!index) {
+        return;
+    }
+    free(index->ctrl);
+    free(index->slots);
+    free(index);
+}
+
+size_t up_index_bytes(const up_index_t *index) {
+    if (!index) {
+        return 0;
+    }
+    return sizeof(up_index_t) + index->capacity * (1 + sizeof(*index->slots));
+}
+
+bool up_index_lookup(const up_index_t *index, const char *key, uint64_t hash,
+                     up_index_key_fn key_at, const void *owner, size_t *position) {
+    size_t groups = index->capacity / UP_INDEX_GROUP;
+    size_t group = first_group(index, hash);
+    uint8_t tag = hash_tag(hash);
+
+    // Triangular probing visits every group of a power-of-two table
+    for (size_t probe = 1; probe <= groups; probe++) {
+        const uint8_t *ctrl = index->ctrl + group * UP_INDEX_GROUP;
+        for (unsigned mask = group_match(ctrl, tag); mask; mask &= mask - 1) {
+            size_t slot = group * UP_INDEX_GROUP + lowest_bit(mask);
+            if (strcmp(key_at(owner, index->slots[slot]), key) == 0) {
+                *position = index->slots[slot];
+                return true;
+            }
+        }
+        if (group_match(ctrl, UP_INDEX_EMPTY)) {
+            return false;
+        }
+        group = (group + probe) & (groups - 1);
+    }
+
+    return false;
+}
+
+// Place a position in the first free slot along its probe sequence; the
+// table must have room
+static void index_place(up_index_t *index, uint64_t hash, size_t position) {
+    size_t groups = index->capacity / UP_INDEX_GROUP;
+    size_t group = first_group(index, hash);
+
+    for (size_t probe = 1;; probe++) {
+        const uint8_t *ctrl = index->ctrl + group * UP_INDEX_GROUP;
+        unsigned empty = group_match(ctrl, UP_INDEX_EMPTY);
+        if (empty) {
+            size_t slot = group * UP_INDEX_GROUP + lowest_bit(empty);
+            index->ctrl[slot] = hash_tag(hash);
+            index->slots[slot] = (uint32_t)position;
+            index->count++;
+            return;
+        }
+        group = (group + probe) & (groups - 1);
+    }
+}
+
+static size_t capacity_for(size_t count) {
+    size_t capacity = UP_INDEX_GROUP;
+    while (capacity - capacity / 8 < count) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// Rebuild at a larger capacity, rehashing keys through the owner
+static bool index_grow(up_index_t *index, up_index_key_fn key_at, const void *owner) {
+    up_index_t *grown = index_new(index->capacity * 2);
+    if (!grown) {
+        return false;
+    }
+    for (size_t slot = 0; slot < index->capacity; slot++) {
+        if (index->ctrl[slot] != UP_INDEX_EMPTY) {
+            size_t position = index->slots[slot];
+            index_place(grown, up_hash_string(key_at(owner, position)), position);
+        }
+    }
+
+    free(index->ctrl);
+    free(index->slots);
+    index->ctrl = grown->ctrl;
+    index->slots = grown->slots;
+    index->capacity = grown->capacity;
+    free(grown);
+    return true;
+}
+
+bool up_index_add(up_index_t *index, uint64_t hash, size_t position,
+                  up_index_key_fn key_at, const void *owner) {
+    if (position > UINT32_MAX) {
+        return false;
+    }
+    if (index->count + 1 > index->capacity - index->capacity / 8 &&
+        !index_grow(index, key_at, owner)) {
+        return false;
+    }
+    index_place(index, hash, position);
+    return true;
+}
+
+// Index owner positions [covered, count). A key already present keeps its
+// first position. The index is rebuilt if the owner shrank underneath it.
+// On allocation failure the index is freed and *index set to NULL.
+bool up_index_sync(up_index_t **index, size_t count, up_index_key_fn key_at, const void *owner) {
+    if (*index && (*index)->covered > count) {
+        up_index_free(*index);
+        *index = NULL;
+    }
+    if (!*index) {
+        *index = index_new(capacity_for(count));
+        if (!*index) {
+            return false;
+        }
+    }
+
+    up_index_t *idx = *index;
+    for (size_t position = idx->covered; position < count; position++) {
+        const char *key = key_at(owner, position);
+        uint64_t hash = up_hash_string(key);
+        size_t existing;
+        if (!up_index_lookup(idx, key, hash, key_at, owner, &existing) &&
+            !up_index_add(idx, hash, position, key_at, owner)) {
+            up_index_free(idx);
+            *index = NULL;
+            return false;
+        }
+    }
+    idx->covered = count;
+    return true;
+}
@@ -0,0 +1,115 @@
+/**
+ * Internal helpers shared by the UP library sources
+ * Not part of the public API
+ */
+
+#ifndef UP_INTERNAL_H
+#define UP_INTERNAL_H
+
+#include "up.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Allocation through the per-thread freelists in up_pool.c. `size` must be
+// the exact size the block was requested with; NULL is ignored on free.
+void *up_pool_alloc(size_t size);
+void *up_pool_calloc(size_t size);
+void *up_pool_realloc(void *ptr, size_t old_size, size_t new_size);
+void up_pool_free(void *ptr, size_t size);
+
+// Record the calling thread's last error (see up_last_error). The _at form
+// adds a position in the input, which up_get_error puts in front of the
+// message. The arguments must not point into the current error.
+void up_set_error(up_error_code_t code, const char *format, ...);
+void up_set_error_at(up_error_code_t code, size_t line, size_t column, size_t offset,
+                     const char *format, ...);
+
+// Free a long error message kept for the calling thread (up_pool_trim)
+void up_error_release(void);
+
+// Whole file contents, NUL-terminated; free() the result
+char *up_read_file(const char *path, size_t *length);
+
+// String value holding `length` bytes of `str` (which may contain NULs)
+up_value_t *up_value_new_string_n(const char *str, size_t length);
+
+// Set a top-level key, taking ownership of `value`; the key and type are
+// copied and an existing node is updated in place
+bool up_document_put(up_document_t *doc, const char *key, const char *type, up_value_t *value);
+
+// Position of a key given its up_hash_string hash, or the owner's count
+// when absent
+size_t up_document_find(up_document_t *doc, const char *key, uint64_t hash);
+size_t up_block_find(const up_block_t *block, const char *key, uint64_t hash);
+
+// Key index (up_index.c). Positions refer to the owner's key array and are
+// mapped back to keys through `key_at`, so the index never copies keys.
+typedef const char *(*up_index_key_fn)(const void *owner, size_t position);
+
+struct up_index {
+    uint8_t *ctrl;          // Per-slot 7-bit hash tag, or empty
+    uint32_t *slots;        // Owner position stored in each slot
+    size_t capacity;        // Power of two, at least one 16-slot group
+    size_t count;           // Distinct keys indexed
+    size_t covered;         // Owner positions [0, covered) are indexed
+};
+
+// Documents with fewer keys than this are scanned instead of indexed
+#define UP_INDEX_MIN_KEYS 8
+
+// Blocks scan their stored hash prefixes up to this size, then index
+#define UP_BLOCK_INDEX_MIN_KEYS 32
+
+uint64_t up_hash_string(const char *key);
+uint64_t up_hash_bytes(const void *data, size_t length, uint64_t seed);
+bool up_index_sync(up_index_t **index, size_t count, up_index_key_fn key_at, const void *owner);
+bool up_index_lookup(const up_index_t *index, const char *key, uint64_t hash,
+                     up_index_key_fn key_at, const void *owner, size_t *position);
+bool up_index_add(up_index_t *index, uint64_t hash, size_t position,
+                  up_index_key_fn key_at, const void *owner);
+size_t up_hash_scan(const uint32_t *hashes, size_t count, uint32_t hash, const char *key,
+                    up_index_key_fn key_at, const void *owner);
+void up_index_free(up_index_t *index);
+size_t up_index_bytes(const up_index_t *index);
+
+// Whole-tree indexes (up_tree_index.c)
+void up_value_index_free(up_value_index_t *index);
+size_t up_value_index_bytes(const up_value_index_t *index);
+void up_path_index_free(up_path_index_t *index);
+size_t up_path_index_bytes(const up_path_index_t *index);
+
+// Binary images (up_binary.c) tagged with a hash of the source text they
+// were compiled from. up_binary_build lays the image out in memory. Bump
+// the version whenever the layout changes so cached images are rebuilt.
+#define UP_BINARY_VERSION 1
+
+bool up_binary_save(const up_document_t *doc, const char *path, uint64_t source_hash);
+const up_binary_t *up_binary_build(const up_document_t *doc, uint64_t source_hash);
+const up_binary_t *up_binary_open(const char *path, bool owned);
+uint64_t up_binary_source_hash(const up_binary_t *binary);
+
+// Buffered output shared by the writers (up_write.c). Output collects in
+// `data` and reaches the sink a buffer at a time; after a sink failure
+// everything else is dropped and `failed` stays set.
+#define UP_OUT_BUFFER 8192
+
+typedef struct {
+    up_sink_t sink;
+    size_t length;
+    bool failed;
+    char data[UP_OUT_BUFFER];
+} up_out_t;
+
+void up_out_init(up_out_t *out, up_sink_t sink);
+void up_out_write(up_out_t *out, const char *data, size_t length);
+bool up_out_flush(up_out_t *out);
+
+static inline void up_out_char(up_out_t *out, char c) {
+    if (out->length == UP_OUT_BUFFER && !up_out_flush(out)) {
+        return;
+    }
+    out->data[out->length++] = c;
+}
+
+#endif // UP_INTERNAL_H
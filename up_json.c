@@ -0,0 +1,763 @@
+/**
+ * JSON export and import
+ *
+ * Documents become one JSON object with keys in document order. Strings
+ * are escaped by scanning for the next byte that needs it (a quote, a
+ * backslash or a control byte) sixteen bytes at a time with SSE2, then
+ * copying the clean run in one piece, so typical config text goes out at
+ * memcpy speed. Scalars annotated !int, !float or !bool become JSON
+ * numbers and booleans when their text is a valid literal.
+ *
+ * Import is the mirror image: one pass over the buffer, using the same
+ * scan to find the end of each clean string run, building blocks, lists
+ * and typed scalars directly. Decoded strings go through one reusable
+ * scratch buffer, so the only allocations are the document's own. Keys
+ * outside the UP key syntax are refused rather than escaped.
+ */
+
+#include "up.h"
+#include "up_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* ---- String escaping ---- */
+
+static unsigned lowest_bit(unsigned mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctz(mask);
+#else
+    unsigned bit = 0;
+    while (!(mask & 1u)) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static bool needs_escape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+// Position of the first byte at or after `i` that needs escaping, or
+// `length` if the rest is clean
+static size_t escape_scan(const char *data, size_t i, size_t length) {
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        // Unsigned c <= 0x1f is max(c, 0x1f) == 0x1f
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        unsigned mask = (unsigned)_mm_movemask_epi8(special);
+        if (mask) {
+            return i + lowest_bit(mask);
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        if (needs_escape((unsigned char)data[i])) {
+            return i;
+        }
+    }
+    return length;
+}
+
+static void write_escape(up_out_t *out, unsigned char c) {
+    static const char hex[] = "0123456789abcdef";
+    char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+    switch (c) {
+        case '"': up_out_write(out, "\\\"", 2); return;
+        case '\\': up_out_write(out, "\\\\", 2); return;
+        case '\b': up_out_write(out, "\\b", 2); return;
+        case '\f': up_out_write(out, "\\f", 2); return;
+        case '\n': up_out_write(out, "\\n", 2); return;
+        case '\r': up_out_write(out, "\\r", 2); return;
+        case '\t': up_out_write(out, "\\t", 2); return;
+    }
+    up_out_write(out, escape, sizeof(escape));
+}
+
+static void write_string(up_out_t *out, const char *data, size_t length) {
+    up_out_char(out, '"');
+    size_t start = 0;
+    while (start < length) {
+        size_t stop = escape_scan(data, start, length);
+        up_out_write(out, data + start, stop - start);
+        if (stop == length) {
+            break;
+        }
+        write_escape(out, (unsigned char)data[stop]);
+        start = stop + 1;
+    }
+    up_out_char(out, '"');
+}
+
+/* ---- Typed scalars ---- */
+
+static size_t skip_digits(const char *data, size_t i, size_t length) {
+    while (i < length && data[i] >= '0' && data[i] <= '9') {
+        i++;
+    }
+    return i;
+}
+
+// JSON number grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?,
+// with the fraction and exponent only allowed when `integer` is false
+static bool is_json_number(const up_string_t *string, bool integer) {
+    const char *data = string->data;
+    size_t length = string->length;
+    size_t i = length && data[0] == '-';
+
+    if (i == length || data[i] < '0' || data[i] > '9') {
+        return false;
+    }
+    i = data[i] == '0' ? i + 1 : skip_digits(data, i, length);
+    if (integer) {
+        return i == length;
+    }
+    if (i < length && data[i] == '.') {
+        size_t digits = skip_digits(data, i + 1, length);
+        if (digits == i + 1) {
+            return false;
+        }
+        i = digits;
+    }
+    if (i < length && (data[i] == 'e' || data[i] == 'E')) {
+        i++;
+        if (i < length && (data[i] == '+' || data[i] == '-')) {
+            i++;
+        }
+        size_t digits = skip_digits(data, i, length);
+        if (digits == i) {
+            return false;
+        }
+        i = digits;
+    }
+    return i == length;
+}
+
+static bool is_literal(const up_string_t *string, const char *literal) {
+    return string->length == strlen(literal) && memcmp(string->data, literal, string->length) == 0;
+}
+
+// Scalars whose text does not match their annotation stay JSON strings
+static void write_scalar(up_out_t *out, const up_string_t *string, const char *type) {
+    bool native = false;
+    if (type && strcmp(type, "int") == 0) {
+        native = is_json_number(string, true);
+    } else if (type && strcmp(type, "float") == 0) {
+        native = is_json_number(string, false);
+    } else if (type && strcmp(type, "bool") == 0) {
+        native = is_literal(string, "true") || is_literal(string, "false");
+    } else if (type && strcmp(type, "null") == 0 && string->length == 0) {
+        up_out_write(out, "null", 4);
+        return;
+    }
+
+    if (native) {
+        up_out_write(out, string->data, string->length);
+    } else {
+        write_string(out, string->data, string->length);
+    }
+}
+
+/* ---- Values ---- */
+
+typedef struct {
+    up_out_t out;
+    bool pretty;
+    bool typed;
+} json_writer_t;
+
+static void write_newline(json_writer_t *writer, size_t depth) {
+    if (!writer->pretty) {
+        return;
+    }
+    up_out_char(&writer->out, '\n');
+    for (size_t i = 0; i < depth; i++) {
+        up_out_write(&writer->out, "  ", 2);
+    }
+}
+
+static void write_key(json_writer_t *writer, const char *key) {
+    write_string(&writer->out, key, strlen(key));
+    if (writer->pretty) {
+        up_out_write(&writer->out, ": ", 2);
+    } else {
+        up_out_char(&writer->out, ':');
+    }
+}
+
+// `type` is the annotation of the entry holding the value; list items
+// inherit it, so "ports!int [80, 443]" becomes [80, 443]
+static void write_value(json_writer_t *writer, const up_value_t *value, const char *type, size_t depth) {
+    up_out_t *out = &writer->out;
+    if (out->failed) {
+        return;
+    }
+
+    switch (value->type) {
+        case UP_TYPE_STRING:
+            write_scalar(out, &value->as.string, writer->typed ? type : NULL);
+            break;
+        case UP_TYPE_BLOCK: {
+            const up_block_t *block = &value->as.block;
+            up_out_char(out, '{');
+            for (size_t i = 0; i < block->count; i++) {
+                if (i) {
+                    up_out_char(out, ',');
+                }
+                write_newline(writer, depth + 1);
+                write_key(writer, block->keys[i]);
+                write_value(writer, block->values[i], block->types ? block->types[i] : NULL, depth + 1);
+            }
+            if (block->count) {
+                write_newline(writer, depth);
+            }
+            up_out_char(out, '}');
+            break;
+        }
+        case UP_TYPE_LIST: {
+            const up_list_t *list = &value->as.list;
+            up_out_char(out, '[');
+            for (size_t i = 0; i < list->count; i++) {
+                if (i) {
+                    up_out_char(out, ',');
+                }
+                write_newline(writer, depth + 1);
+                write_value(writer, list->items[i], type, depth + 1);
+            }
+            if (list->count) {
+                write_newline(writer, depth);
+            }
+            up_out_char(out, ']');
+            break;
+        }
+    }
+}
+
+bool up_document_to_json(const up_document_t *doc, up_sink_t sink, const up_json_options_t *opts) {
+    if (!doc || !sink.write) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return false;
+    }
+
+    json_writer_t *writer = malloc(sizeof(*writer));
+    if (!writer) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return false;
+    }
+    bool stream = opts && opts->stream;
+    up_out_init(&writer->out, sink);
+    writer->pretty = opts && opts->pretty && !stream;
+    writer->typed = !(opts && opts->plain_scalars);
+
+    // Streaming writes one single-key object per line and hands each line
+    // to the sink as soon as it is complete
+    if (!stream) {
+        up_out_char(&writer->out, '{');
+    }
+    for (size_t i = 0; i < doc->count; i++) {
+        const up_node_t *node = doc->nodes[i];
+        if (stream) {
+            up_out_char(&writer->out, '{');
+        } else {
+            if (i) {
+                up_out_char(&writer->out, ',');
+            }
+            write_newline(writer, 1);
+        }
+        write_key(writer, node->key);
+        write_value(writer, node->value, node->type_annotation, 1);
+        if (stream) {
+            up_out_write(&writer->out, "}\n", 2);
+            if (!up_out_flush(&writer->out)) {
+                break;
+            }
+        }
+    }
+    if (!stream) {
+        if (doc->count) {
+            write_newline(writer, 0);
+        }
+        up_out_write(&writer->out, "}\n", 2);
+    }
+
+    bool ok = up_out_flush(&writer->out);
+    free(writer);
+    return ok;
+}
+
+/* ---- JSON import ---- */
+
+#define UP_JSON_MAX_DEPTH 512
+
+// Input cursor plus a scratch stack for decoded strings: each string is
+// pushed NUL-terminated at the top, and callers pop back to the offset
+// they started at once the string has been copied into the document
+typedef struct {
+    const char *data;
+    size_t length;
+    size_t pos;
+    char *scratch;
+    size_t scratch_length;
+    size_t scratch_capacity;
+    size_t depth;
+} json_reader_t;
+
+// Stands for "no items yet": an empty list fits any item type
+static const char json_any[] = "";
+
+static void reader_fail(const json_reader_t *reader, const char *message) {
+    size_t offset = reader->pos < reader->length ? reader->pos : reader->length;
+    size_t line = 1, line_start = 0;
+    for (size_t i = 0; i < offset; i++) {
+        if (reader->data[i] == '\n') {
+            line++;
+            line_start = i + 1;
+        }
+    }
+    up_set_error_at(UP_ERROR_SYNTAX, line, offset - line_start + 1, offset, "%s", message);
+}
+
+static void skip_whitespace(json_reader_t *reader) {
+    while (reader->pos < reader->length) {
+        char c = reader->data[reader->pos];
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            break;
+        }
+        reader->pos++;
+    }
+}
+
+static bool consume(json_reader_t *reader, char c) {
+    skip_whitespace(reader);
+    if (reader->pos < reader->length && reader->data[reader->pos] == c) {
+        reader->pos++;
+        return true;
+    }
+    return false;
+}
+
+static bool scratch_push(json_reader_t *reader, const char *data, size_t length) {
+    if (length > reader->scratch_capacity - reader->scratch_length) {
+        size_t capacity = reader->scratch_capacity ? reader->scratch_capacity : 256;
+        while (length > capacity - reader->scratch_length) {
+            capacity *= 2;
+        }
+        char *scratch = realloc(reader->scratch, capacity);
+        if (!scratch) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            return false;
+        }
+        reader->scratch = scratch;
+        reader->scratch_capacity = capacity;
+    }
+    if (length) {
+        memcpy(reader->scratch + reader->scratch_length, data, length);
+        reader->scratch_length += length;
+    }
+    return true;
+}
+
+static bool read_hex4(json_reader_t *reader, unsigned *code) {
+    if (reader->length - reader->pos < 4) {
+        return false;
+    }
+    *code = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = reader->data[reader->pos++];
+        unsigned digit = c >= '0' && c <= '9' ? (unsigned)(c - '0')
+                       : c >= 'a' && c <= 'f' ? (unsigned)(c - 'a' + 10)
+                       : c >= 'A' && c <= 'F' ? (unsigned)(c - 'A' + 10)
+                       : 16;
+        if (digit == 16) {
+            return false;
+        }
+        *code = *code << 4 | digit;
+    }
+    return true;
+}
+
+// Decode the \uXXXX escape after the backslash-u (and its low surrogate,
+// if any) to UTF-8
+static bool read_unicode(json_reader_t *reader, char *utf8, size_t *length) {
+    unsigned code;
+    if (!read_hex4(reader, &code) || (code >= 0xdc00 && code <= 0xdfff)) {
+        return false;
+    }
+    if (code >= 0xd800 && code <= 0xdbff) {
+        unsigned low;
+        if (reader->length - reader->pos < 2 || reader->data[reader->pos] != '\\' ||
+            reader->data[reader->pos + 1] != 'u') {
+            return false;
+        }
+        reader->pos += 2;
+        if (!read_hex4(reader, &low) || low < 0xdc00 || low > 0xdfff) {
+            return false;
+        }
+        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+    }
+
+    if (code < 0x80) {
+        utf8[0] = (char)code;
+        *length = 1;
+    } else if (code < 0x800) {
+        utf8[0] = (char)(0xc0 | code >> 6);
+        utf8[1] = (char)(0x80 | (code & 0x3f));
+        *length = 2;
+    } else if (code < 0x10000) {
+        utf8[0] = (char)(0xe0 | code >> 12);
+        utf8[1] = (char)(0x80 | (code >> 6 & 0x3f));
+        utf8[2] = (char)(0x80 | (code & 0x3f));
+        *length = 3;
+    } else {
+        utf8[0] = (char)(0xf0 | code >> 18);
+        utf8[1] = (char)(0x80 | (code >> 12 & 0x3f));
+        utf8[2] = (char)(0x80 | (code >> 6 & 0x3f));
+        utf8[3] = (char)(0x80 | (code & 0x3f));
+        *length = 4;
+    }
+    return true;
+}
+
+// Decode the string at the cursor onto the scratch stack. Clean runs
+// between escapes are found with the same scan the exporter uses and
+// copied whole.
+static bool read_string(json_reader_t *reader, size_t *offset, size_t *length) {
+    *offset = reader->scratch_length;
+    reader->pos++;
+
+    for (;;) {
+        size_t stop = escape_scan(reader->data, reader->pos, reader->length);
+        if (!scratch_push(reader, reader->data + reader->pos, stop - reader->pos)) {
+            return false;
+        }
+        reader->pos = stop;
+        if (stop == reader->length) {
+            reader_fail(reader, "unterminated string");
+            return false;
+        }
+
+        char c = reader->data[reader->pos++];
+        if (c == '"') {
+            break;
+        }
+        if (c != '\\' || reader->pos == reader->length) {
+            reader_fail(reader, "control character in string");
+            return false;
+        }
+
+        static const char escapes[] = "\"\\/bfnrt";
+        static const char decoded[] = "\"\\/\b\f\n\r\t";
+        char escaped = reader->data[reader->pos++];
+        const char *simple = escaped ? strchr(escapes, escaped) : NULL;
+        char utf8[4];
+        size_t utf8_length = 1;
+        if (simple) {
+            utf8[0] = decoded[simple - escapes];
+        } else if (escaped != 'u' || !read_unicode(reader, utf8, &utf8_length)) {
+            reader_fail(reader, "invalid escape in string");
+            return false;
+        }
+        if (!scratch_push(reader, utf8, utf8_length)) {
+            return false;
+        }
+    }
+
+    *length = reader->scratch_length - *offset;
+    return scratch_push(reader, "", 1);
+}
+
+// Scan the number at the cursor; its text ends at the new position
+static bool read_number(json_reader_t *reader, const char **type) {
+    const char *data = reader->data;
+    size_t i = reader->pos + (data[reader->pos] == '-');
+    bool integer = true;
+
+    if (i < reader->length && data[i] == '0') {
+        i++;
+    } else if (i < reader->length && data[i] >= '1' && data[i] <= '9') {
+        i = skip_digits(data, i, reader->length);
+    } else {
+        reader->pos = i;
+        return false;
+    }
+    if (i < reader->length && data[i] == '.') {
+        size_t digits = skip_digits(data, i + 1, reader->length);
+        integer = false;
+        if (digits == i + 1) {
+            reader->pos = i;
+            return false;
+        }
+        i = digits;
+    }
+    if (i < reader->length && (data[i] == 'e' || data[i] == 'E')) {
+        size_t exponent = i + 1;
+        if (exponent < reader->length && (data[exponent] == '+' || data[exponent] == '-')) {
+            exponent++;
+        }
+        size_t digits = skip_digits(data, exponent, reader->length);
+        integer = false;
+        if (digits == exponent) {
+            reader->pos = i;
+            return false;
+        }
+        i = digits;
+    }
+
+    reader->pos = i;
+    *type = integer ? "int" : "float";
+    return true;
+}
+
+static bool read_literal(json_reader_t *reader, const char *literal) {
+    size_t length = strlen(literal);
+    if (reader->length - reader->pos < length ||
+        memcmp(reader->data + reader->pos, literal, length) != 0) {
+        reader_fail(reader, "invalid literal");
+        return false;
+    }
+    reader->pos += length;
+    return true;
+}
+
+// Common annotation for the items of a list: ints widen to float, and any
+// other disagreement leaves the list untyped
+static const char *merge_type(const char *a, const char *b) {
+    if (a == json_any) {
+        return b;
+    }
+    if (b == json_any || (a && b && strcmp(a, b) == 0)) {
+        return a;
+    }
+    if (a && b && (strcmp(a, "int") == 0 || strcmp(a, "float") == 0) &&
+        (strcmp(b, "int") == 0 || strcmp(b, "float") == 0)) {
+        return "float";
+    }
+    return NULL;
+}
+
+static up_value_t *read_value(json_reader_t *reader, const char **type);
+
+// Keys must be UP keys, or the document could not be written back as UP:
+// a letter or '_', then letters, digits, '_' or '-'
+static bool is_up_key(const char *key, size_t length) {
+    if (!length || !((key[0] >= 'A' && key[0] <= 'Z') || (key[0] >= 'a' && key[0] <= 'z') ||
+                     key[0] == '_')) {
+        return false;
+    }
+    for (size_t i = 1; i < length; i++) {
+        char c = key[i];
+        if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+              c == '_' || c == '-')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Object members go to `doc` at the top level and to `block` below it
+static bool read_members(json_reader_t *reader, up_document_t *doc, up_block_t *block) {
+    if (consume(reader, '}')) {
+        return true;
+    }
+
+    do {
+        size_t key_offset, key_length;
+        skip_whitespace(reader);
+        if (reader->pos == reader->length || reader->data[reader->pos] != '"') {
+            reader_fail(reader, "expected object key");
+            return false;
+        }
+        size_t key_start = reader->pos;
+        if (!read_string(reader, &key_offset, &key_length)) {
+            return false;
+        }
+        if (!is_up_key(reader->scratch + key_offset, key_length)) {
+            reader->pos = key_start;
+            reader_fail(reader, "key is not a valid UP key");
+            return false;
+        }
+        if (!consume(reader, ':')) {
+            reader_fail(reader, "expected ':'");
+            return false;
+        }
+
+        const char *type = NULL;
+        up_value_t *value = read_value(reader, &type);
+        if (!value) {
+            return false;
+        }
+        if (type == json_any) {
+            type = NULL;
+        }
+
+        const char *key = reader->scratch + key_offset;
+        if (doc) {
+            if (!up_document_put(doc, key, type, value)) {
+                return false;
+            }
+        } else {
+            up_block_set_typed(block, key, type, value);
+        }
+        reader->scratch_length = key_offset;
+    } while (consume(reader, ','));
+
+    if (!consume(reader, '}')) {
+        reader_fail(reader, "expected ',' or '}'");
+        return false;
+    }
+    return true;
+}
+
+static up_value_t *read_container(json_reader_t *reader, char open, const char **type) {
+    if (++reader->depth > UP_JSON_MAX_DEPTH) {
+        reader_fail(reader, "nesting too deep");
+        return NULL;
+    }
+    reader->pos++;
+
+    up_value_t *value = open == '{' ? up_value_new_block() : up_value_new_list();
+    if (!value) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+
+    if (open == '{') {
+        *type = NULL;
+        if (!read_members(reader, NULL, &value->as.block)) {
+            up_value_free(value);
+            return NULL;
+        }
+    } else {
+        *type = json_any;
+        if (!consume(reader, ']')) {
+            do {
+                const char *item_type = NULL;
+                up_value_t *item = read_value(reader, &item_type);
+                if (!item) {
+                    up_value_free(value);
+                    return NULL;
+                }
+                *type = merge_type(*type, item_type);
+                up_list_append(&value->as.list, item);
+            } while (consume(reader, ','));
+
+            if (!consume(reader, ']')) {
+                reader_fail(reader, "expected ',' or ']'");
+                up_value_free(value);
+                return NULL;
+            }
+        }
+    }
+
+    reader->depth--;
+    return value;
+}
+
+// Read one value, reporting the annotation it maps to (NULL for strings
+// and objects; the shared item type for arrays)
+static up_value_t *read_value(json_reader_t *reader, const char **type) {
+    skip_whitespace(reader);
+    if (reader->pos == reader->length) {
+        reader_fail(reader, "unexpected end of input");
+        return NULL;
+    }
+
+    up_value_t *value;
+    char c = reader->data[reader->pos];
+    switch (c) {
+        case '{':
+        case '[':
+            return read_container(reader, c, type);
+        case '"': {
+            size_t offset, length;
+            if (!read_string(reader, &offset, &length)) {
+                return NULL;
+            }
+            value = up_value_new_string_n(reader->scratch + offset, length);
+            reader->scratch_length = offset;
+            *type = NULL;
+            break;
+        }
+        case 't':
+        case 'f':
+            if (!read_literal(reader, c == 't' ? "true" : "false")) {
+                return NULL;
+            }
+            value = up_value_new_string(c == 't' ? "true" : "false");
+            *type = "bool";
+            break;
+        case 'n':
+            if (!read_literal(reader, "null")) {
+                return NULL;
+            }
+            value = up_value_new_string("");
+            *type = "null";
+            break;
+        default: {
+            size_t start = reader->pos;
+            if (c != '-' && (c < '0' || c > '9')) {
+                reader_fail(reader, "unexpected character");
+                return NULL;
+            }
+            if (!read_number(reader, type)) {
+                reader_fail(reader, "invalid number");
+                return NULL;
+            }
+            value = up_value_new_string_n(reader->data + start, reader->pos - start);
+            break;
+        }
+    }
+
+    if (!value) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+    }
+    return value;
+}
+
+up_document_t *up_document_from_json(const char *buf, size_t len) {
+    if (!buf) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return NULL;
+    }
+
+    json_reader_t reader = {buf, len, 0, NULL, 0, 0, 0};
+    if (len >= 3 && memcmp(buf, "\xef\xbb\xbf", 3) == 0) {
+        reader.pos = 3;
+    }
+    if (!consume(&reader, '{')) {
+        reader_fail(&reader, "expected a JSON object");
+        return NULL;
+    }
+
+    up_document_t *doc = calloc(1, sizeof(up_document_t));
+    if (!doc) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+
+    bool ok = read_members(&reader, doc, NULL);
+    if (ok) {
+        skip_whitespace(&reader);
+        if (reader.pos != reader.length) {
+            reader_fail(&reader, "unexpected data after the JSON object");
+            ok = false;
+        }
+    }
+    free(reader.scratch);
+    if (!ok) {
+        up_document_free(doc);
+        return NULL;
+    }
+    return doc;
+}
@@ -0,0 +1,181 @@
+/**
+ * Compiled key paths
+ *
+ * A path such as "server.tls.cert" or "upstreams[3].host" is split and
+ * hashed once by up_path_compile. Each key segment also remembers the
+ * position it matched last time, so repeated reads against documents with
+ * the same layout confirm that slot instead of probing for the key again.
+ */
+
+#include "up.h"
+#include "up_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *key;              // NULL for a list index segment
+    uint64_t hash;
+    size_t index;           // List index when key is NULL
+    size_t cached;          // Position of the last match
+} up_path_segment_t;
+
+struct up_path {
+    up_path_segment_t *segments;
+    size_t count;
+};
+
+static bool is_path_key_char(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+           (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+void up_path_free(up_path_t *path) {
+    if (!path) {
+        return;
+    }
+
+    for (size_t i = 0; i < path->count; i++) {
+        free(path->segments[i].key);
+    }
+    free(path->segments);
+    free(path);
+}
+
+static bool add_segment(up_path_t *path, const char *key, size_t length, size_t index) {
+    up_path_segment_t *segments = realloc(path->segments, (path->count + 1) * sizeof(*segments));
+    if (!segments) {
+        return false;
+    }
+    path->segments = segments;
+
+    up_path_segment_t *segment = &segments[path->count];
+    segment->key = NULL;
+    segment->hash = 0;
+    segment->index = index;
+    segment->cached = 0;
+    if (key) {
+        segment->key = malloc(length + 1);
+        if (!segment->key) {
+            return false;
+        }
+        memcpy(segment->key, key, length);
+        segment->key[length] = '\0';
+        segment->hash = up_hash_string(segment->key);
+    }
+    path->count++;
+    return true;
+}
+
+// Compile "a.b[2].c" into key and index segments
+up_path_t *up_path_compile(const char *text) {
+    if (!text) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return NULL;
+    }
+
+    up_path_t *path = calloc(1, sizeof(up_path_t));
+    if (!path) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+
+    const char *cursor = text;
+    bool expect_key = true;
+    while (*cursor || expect_key) {
+        if (expect_key) {
+            const char *start = cursor;
+            while (is_path_key_char(*cursor)) {
+                cursor++;
+            }
+            if (cursor == start) {
+                up_set_error_at(UP_ERROR_SYNTAX, 1, (size_t)(start - text) + 1, (size_t)(start - text),
+                                "path '%s': expected key", text);
+                up_path_free(path);
+                return NULL;
+            }
+            if (!add_segment(path, start, (size_t)(cursor - start), 0)) {
+                up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+                up_path_free(path);
+                return NULL;
+            }
+            expect_key = false;
+        } else if (*cursor == '.') {
+            cursor++;
+            expect_key = true;
+        } else if (*cursor == '[') {
+            char *end;
+            unsigned long long index = strtoull(cursor + 1, &end, 10);
+            if (end == cursor + 1 || *end != ']' || cursor[1] == '-' || cursor[1] == '+') {
+                up_set_error_at(UP_ERROR_SYNTAX, 1, (size_t)(cursor - text) + 1, (size_t)(cursor - text),
+                                "path '%s': bad list index", text);
+                up_path_free(path);
+                return NULL;
+            }
+            if (!add_segment(path, NULL, 0, (size_t)index)) {
+                up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+                up_path_free(path);
+                return NULL;
+            }
+            cursor = end + 1;
+        } else {
+            up_set_error_at(UP_ERROR_SYNTAX, 1, (size_t)(cursor - text) + 1, (size_t)(cursor - text),
+                            "path '%s': unexpected '%c'", text, *cursor);
+            up_path_free(path);
+            return NULL;
+        }
+    }
+
+    return path;
+}
+
+static up_value_t *block_step(const up_block_t *block, up_path_segment_t *segment) {
+    size_t cached = segment->cached;
+    if (cached < block->count && (!block->hashes || block->hashes[cached] == (uint32_t)segment->hash) &&
+        strcmp(block->keys[cached], segment->key) == 0) {
+        return block->values[cached];
+    }
+
+    size_t position = up_block_find(block, segment->key, segment->hash);
+    if (position == block->count) {
+        return NULL;
+    }
+    segment->cached = position;
+    return block->values[position];
+}
+
+// Resolve a compiled path against a document. Returns a borrowed value, or
+// NULL if any segment is missing or the value has the wrong shape.
+up_value_t *up_path_get(up_document_t *doc, up_path_t *path) {
+    if (!doc || !path || !path->count) {
+        return NULL;
+    }
+
+    up_path_segment_t *segment = &path->segments[0];
+    size_t cached = segment->cached;
+    up_value_t *value;
+    if (cached < doc->count && strcmp(doc->nodes[cached]->key, segment->key) == 0) {
+        value = doc->nodes[cached]->value;
+    } else {
+        size_t position = up_document_find(doc, segment->key, segment->hash);
+        if (position == doc->count) {
+            return NULL;
+        }
+        segment->cached = position;
+        value = doc->nodes[position]->value;
+    }
+
+    for (size_t i = 1; i < path->count && value; i++) {
+        segment = &path->segments[i];
+        if (!segment->key) {
+            value = value->type == UP_TYPE_LIST && segment->index < value->as.list.count
+                ? value->as.list.items[segment->index]
+                : NULL;
+        } else if (value->type == UP_TYPE_BLOCK) {
+            value = block_step(&value->as.block, segment);
+        } else {
+            value = NULL;
+        }
+    }
+
+    return value;
+}
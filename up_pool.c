@@ -0,0 +1,165 @@
+/**
+ * Size-class freelists for small allocations
+ *
+ * Values, nodes and short pointer arrays are recycled through per-thread
+ * freelists instead of going back to malloc. Every class holds blocks of
+ * exactly one size, so any block on a list can serve any request of that
+ * size. Build with -DUP_NO_POOL to route everything straight to malloc.
+ *
+ * Callers must free a block with the exact size it was allocated with,
+ * or it lands on the wrong list and is later handed out at the wrong
+ * size. Build with -DUP_POOL_DEBUG to record each block's size in a
+ * header and abort on the first mismatched free or realloc.
+ */
+
+#include "up.h"
+#include "up_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Blocks kept per class before frees fall through to the allocator
+#define UP_POOL_MAX_CACHED 1024
+
+typedef struct up_pool_block {
+    struct up_pool_block *next;
+} up_pool_block_t;
+
+typedef struct {
+    up_pool_block_t *head;
+    size_t count;
+} up_pool_class_t;
+
+static const size_t class_sizes[] = {
+    sizeof(up_node_t),
+    sizeof(up_value_t),
+    8 * sizeof(void *),
+    16 * sizeof(void *),
+    32 * sizeof(void *),
+    64 * sizeof(void *),
+};
+
+#define UP_POOL_CLASS_COUNT (sizeof(class_sizes) / sizeof(class_sizes[0]))
+
+static _Thread_local up_pool_class_t pool[UP_POOL_CLASS_COUNT];
+
+#ifdef UP_POOL_DEBUG
+#define HEADER_SIZE sizeof(max_align_t)
+
+static void *raw_alloc(size_t size) {
+    unsigned char *block = malloc(HEADER_SIZE + size);
+    if (!block) {
+        return NULL;
+    }
+    memcpy(block, &size, sizeof(size));
+    return block + HEADER_SIZE;
+}
+
+static void check_size(void *ptr, size_t size, const char *caller) {
+    size_t recorded;
+    memcpy(&recorded, (unsigned char *)ptr - HEADER_SIZE, sizeof(recorded));
+    if (recorded != size) {
+        fprintf(stderr, "%s: block of %zu bytes passed as %zu bytes\n", caller, recorded, size);
+        abort();
+    }
+}
+
+static void raw_free(void *ptr) {
+    free((unsigned char *)ptr - HEADER_SIZE);
+}
+
+static void *raw_realloc(void *ptr, size_t size) {
+    unsigned char *block = realloc((unsigned char *)ptr - HEADER_SIZE, HEADER_SIZE + size);
+    if (!block) {
+        return NULL;
+    }
+    memcpy(block, &size, sizeof(size));
+    return block + HEADER_SIZE;
+}
+#else
+#define raw_alloc malloc
+#define raw_free free
+#define raw_realloc realloc
+#define check_size(ptr, size, caller) ((void)0)
+#endif
+
+static up_pool_class_t *find_class(size_t size) {
+#ifdef UP_NO_POOL
+    (void)size;
+#else
+    for (size_t i = 0; i < UP_POOL_CLASS_COUNT; i++) {
+        if (class_sizes[i] == size) {
+            return &pool[i];
+        }
+    }
+#endif
+    return NULL;
+}
+
+void *up_pool_alloc(size_t size) {
+    up_pool_class_t *cls = find_class(size);
+    if (cls && cls->head) {
+        up_pool_block_t *block = cls->head;
+        cls->head = block->next;
+        cls->count--;
+        return block;
+    }
+    return raw_alloc(size);
+}
+
+void *up_pool_calloc(size_t size) {
+    void *ptr = up_pool_alloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void *up_pool_realloc(void *ptr, size_t old_size, size_t new_size) {
+    if (!ptr) {
+        return up_pool_alloc(new_size);
+    }
+    check_size(ptr, old_size, "up_pool_realloc");
+    if (!find_class(old_size) && !find_class(new_size)) {
+        return raw_realloc(ptr, new_size);
+    }
+
+    void *moved = up_pool_alloc(new_size);
+    if (!moved) {
+        return NULL;
+    }
+    memcpy(moved, ptr, old_size < new_size ? old_size : new_size);
+    up_pool_free(ptr, old_size);
+    return moved;
+}
+
+void up_pool_free(void *ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    check_size(ptr, size, "up_pool_free");
+
+    up_pool_class_t *cls = find_class(size);
+    if (!cls || cls->count >= UP_POOL_MAX_CACHED) {
+        raw_free(ptr);
+        return;
+    }
+
+    up_pool_block_t *block = ptr;
+    block->next = cls->head;
+    cls->head = block;
+    cls->count++;
+}
+
+// Return every block cached by the calling thread to the allocator
+void up_pool_trim(void) {
+    up_error_release();
+    for (size_t i = 0; i < UP_POOL_CLASS_COUNT; i++) {
+        while (pool[i].head) {
+            up_pool_block_t *block = pool[i].head;
+            pool[i].head = block->next;
+            raw_free(block);
+        }
+        pool[i].count = 0;
+    }
+}
@@ -0,0 +1,462 @@
+/**
+ * Selector queries
+ *
+ * Queries select values by shape rather than by exact path:
+ *
+ *     upstreams[*].host
+ *     services[?(region == "eu")].port
+ *     servers[1:3].name
+ *     *.tls
+ *
+ * up_query_compile turns the text into a flat program of steps. Running
+ * it keeps a frontier of matched values and applies one step at a time,
+ * producing the next frontier, so evaluation needs no recursion and the
+ * results come out in document order. Results are borrowed pointers into
+ * the document.
+ */
+
+#include "up.h"
+#include "up_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    OP_ROOT_KEY,            // Document node by key
+    OP_ROOT_ALL,            // Every document node
+    OP_KEY,                 // Block entry by key
+    OP_WILDCARD,            // Every block value or list item
+    OP_INDEX,               // List item; negative counts from the end
+    OP_SLICE,               // List items [start, end)
+    OP_FILTER               // Children whose `key` entry equals a literal
+} up_query_op_t;
+
+typedef struct {
+    up_query_op_t op;
+    char *key;
+    uint64_t hash;
+    char *literal;
+    bool negate;
+    long start;
+    long end;
+    bool has_start;
+    bool has_end;
+} up_query_step_t;
+
+struct up_query {
+    up_query_step_t *steps;
+    size_t count;
+};
+
+void up_query_free(up_query_t *query) {
+    if (!query) {
+        return;
+    }
+
+    for (size_t i = 0; i < query->count; i++) {
+        free(query->steps[i].key);
+        free(query->steps[i].literal);
+    }
+    free(query->steps);
+    free(query);
+}
+
+/* ---- Compiler ---- */
+
+typedef struct {
+    const char *text;
+    const char *cursor;
+    up_query_t *query;
+} up_query_compiler_t;
+
+static bool is_query_key_char(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+           (c >= '0' && c <= '9') || c == '_' || c == '-';
+}
+
+static char *copy_span(const char *start, size_t length) {
+    char *copy = malloc(length + 1);
+    if (copy) {
+        memcpy(copy, start, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+static bool compile_error(up_query_compiler_t *c, const char *what) {
+    size_t offset = (size_t)(c->cursor - c->text);
+    up_set_error_at(UP_ERROR_SYNTAX, 1, offset + 1, offset, "query '%s': %s", c->text, what);
+    return false;
+}
+
+static up_query_step_t *add_step(up_query_compiler_t *c, up_query_op_t op) {
+    up_query_step_t *steps = realloc(c->query->steps, (c->query->count + 1) * sizeof(*steps));
+    if (!steps) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+    c->query->steps = steps;
+    up_query_step_t *step = &steps[c->query->count++];
+    memset(step, 0, sizeof(*step));
+    step->op = op;
+    return step;
+}
+
+static void skip_blanks(up_query_compiler_t *c) {
+    while (*c->cursor == ' ' || *c->cursor == '\t') {
+        c->cursor++;
+    }
+}
+
+// Read a key at the cursor into step->key and step->hash
+static bool compile_key(up_query_compiler_t *c, up_query_step_t *step) {
+    const char *start = c->cursor;
+    while (is_query_key_char(*c->cursor)) {
+        c->cursor++;
+    }
+    if (c->cursor == start) {
+        return compile_error(c, "expected key");
+    }
+    step->key = copy_span(start, (size_t)(c->cursor - start));
+    if (!step->key) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return false;
+    }
+    step->hash = up_hash_string(step->key);
+    return true;
+}
+
+static bool compile_number(up_query_compiler_t *c, long *out, bool *present) {
+    char *end;
+    long value = strtol(c->cursor, &end, 10);
+    *present = end != c->cursor;
+    if (*present) {
+        *out = value;
+        c->cursor = end;
+    }
+    return true;
+}
+
+// Literal after == or !=: "quoted with \" escapes" or a bare word
+static bool compile_literal(up_query_compiler_t *c, up_query_step_t *step) {
+    if (*c->cursor != '"') {
+        const char *start = c->cursor;
+        while (*c->cursor && *c->cursor != ')' && *c->cursor != ' ' && *c->cursor != '\t') {
+            c->cursor++;
+        }
+        if (c->cursor == start) {
+            return compile_error(c, "expected value");
+        }
+        step->literal = copy_span(start, (size_t)(c->cursor - start));
+    } else {
+        const char *start = ++c->cursor;
+        size_t length = 0;
+        while (*c->cursor && *c->cursor != '"') {
+            c->cursor += (*c->cursor == '\\' && c->cursor[1]) ? 2 : 1;
+        }
+        if (*c->cursor != '"') {
+            return compile_error(c, "unterminated string");
+        }
+        step->literal = malloc((size_t)(c->cursor - start) + 1);
+        if (step->literal) {
+            for (const char *p = start; p < c->cursor; p++) {
+                if (*p == '\\') {
+                    p++;
+                }
+                step->literal[length++] = *p;
+            }
+            step->literal[length] = '\0';
+        }
+        c->cursor++;
+    }
+
+    if (!step->literal) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return false;
+    }
+    return true;
+}
+
+// Inside [...]: *, N, [A]:[B] or ?(key == value)
+static bool compile_bracket(up_query_compiler_t *c) {
+    up_query_step_t *step;
+
+    if (*c->cursor == '*') {
+        c->cursor++;
+        return add_step(c, OP_WILDCARD) != NULL;
+    }
+
+    if (*c->cursor == '?') {
+        c->cursor++;
+        if (*c->cursor != '(') {
+            return compile_error(c, "expected '('");
+        }
+        c->cursor++;
+        skip_blanks(c);
+        if (!(step = add_step(c, OP_FILTER)) || !compile_key(c, step)) {
+            return false;
+        }
+        skip_blanks(c);
+        if (strncmp(c->cursor, "==", 2) == 0) {
+            step->negate = false;
+        } else if (strncmp(c->cursor, "!=", 2) == 0) {
+            step->negate = true;
+        } else {
+            return compile_error(c, "expected '==' or '!='");
+        }
+        c->cursor += 2;
+        skip_blanks(c);
+        if (!compile_literal(c, step)) {
+            return false;
+        }
+        skip_blanks(c);
+        if (*c->cursor != ')') {
+            return compile_error(c, "expected ')'");
+        }
+        c->cursor++;
+        return true;
+    }
+
+    long start = 0, end = 0;
+    bool has_start, has_end = false;
+    compile_number(c, &start, &has_start);
+    if (*c->cursor == ':') {
+        c->cursor++;
+        compile_number(c, &end, &has_end);
+        if (!(step = add_step(c, OP_SLICE))) {
+            return false;
+        }
+        step->start = start;
+        step->end = end;
+        step->has_start = has_start;
+        step->has_end = has_end;
+        return true;
+    }
+    if (!has_start) {
+        return compile_error(c, "expected index, slice, '*' or filter");
+    }
+    if (!(step = add_step(c, OP_INDEX))) {
+        return false;
+    }
+    step->start = start;
+    return true;
+}
+
+up_query_t *up_query_compile(const char *text) {
+    if (!text) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return NULL;
+    }
+
+    up_query_compiler_t c = {text, text, calloc(1, sizeof(up_query_t))};
+    if (!c.query) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+
+    bool ok;
+    up_query_step_t *step;
+    if (*c.cursor == '*') {
+        c.cursor++;
+        ok = add_step(&c, OP_ROOT_ALL) != NULL;
+    } else {
+        ok = (step = add_step(&c, OP_ROOT_KEY)) != NULL && compile_key(&c, step);
+    }
+
+    while (ok && *c.cursor) {
+        if (*c.cursor == '.') {
+            c.cursor++;
+            if (*c.cursor == '*') {
+                c.cursor++;
+                ok = add_step(&c, OP_WILDCARD) != NULL;
+            } else {
+                ok = (step = add_step(&c, OP_KEY)) != NULL && compile_key(&c, step);
+            }
+        } else if (*c.cursor == '[') {
+            c.cursor++;
+            ok = compile_bracket(&c);
+            if (ok && *c.cursor != ']') {
+                ok = compile_error(&c, "expected ']'");
+            }
+            c.cursor++;
+        } else {
+            ok = compile_error(&c, "unexpected character");
+        }
+    }
+
+    if (!ok) {
+        up_query_free(c.query);
+        return NULL;
+    }
+    return c.query;
+}
+
+/* ---- Evaluator ---- */
+
+static bool frontier_push(up_value_t ***items, size_t *count, size_t *capacity, up_value_t *value) {
+    if (*count == *capacity) {
+        size_t grown_capacity = *capacity ? *capacity * 2 : 16;
+        up_value_t **grown = realloc(*items, grown_capacity * sizeof(*grown));
+        if (!grown) {
+            return false;
+        }
+        *items = grown;
+        *capacity = grown_capacity;
+    }
+    (*items)[(*count)++] = value;
+    return true;
+}
+
+static bool filter_matches(const up_query_step_t *step, const up_value_t *value) {
+    if (value->type != UP_TYPE_BLOCK) {
+        return false;
+    }
+    size_t position = up_block_find(&value->as.block, step->key, step->hash);
+    if (position == value->as.block.count) {
+        return false;
+    }
+    const up_value_t *field = value->as.block.values[position];
+    bool equal = field->type == UP_TYPE_STRING && strcmp(field->as.string.data, step->literal) == 0;
+    return equal != step->negate;
+}
+
+// Clamp a Python-style list bound into [0, count]
+static size_t resolve_bound(long bound, size_t count) {
+    if (bound < 0) {
+        bound += (long)count;
+        return bound < 0 ? 0 : (size_t)bound;
+    }
+    return (size_t)bound > count ? count : (size_t)bound;
+}
+
+// Apply one step to every value in the current frontier
+static bool apply_step(const up_query_step_t *step, up_value_t *const *current, size_t current_count,
+                       up_value_t ***next, size_t *next_count, size_t *next_capacity) {
+    for (size_t i = 0; i < current_count; i++) {
+        up_value_t *value = current[i];
+        size_t position;
+
+        switch (step->op) {
+            case OP_ROOT_KEY:
+            case OP_ROOT_ALL:
+                break;
+            case OP_KEY:
+                if (value->type != UP_TYPE_BLOCK) {
+                    break;
+                }
+                position = up_block_find(&value->as.block, step->key, step->hash);
+                if (position < value->as.block.count &&
+                    !frontier_push(next, next_count, next_capacity, value->as.block.values[position])) {
+                    return false;
+                }
+                break;
+            case OP_WILDCARD:
+            case OP_FILTER: {
+                up_value_t **children;
+                size_t child_count;
+                if (value->type == UP_TYPE_BLOCK) {
+                    children = value->as.block.values;
+                    child_count = value->as.block.count;
+                } else if (value->type == UP_TYPE_LIST) {
+                    children = value->as.list.items;
+                    child_count = value->as.list.count;
+                } else {
+                    break;
+                }
+                for (size_t j = 0; j < child_count; j++) {
+                    if ((step->op == OP_WILDCARD || filter_matches(step, children[j])) &&
+                        !frontier_push(next, next_count, next_capacity, children[j])) {
+                        return false;
+                    }
+                }
+                break;
+            }
+            case OP_INDEX: {
+                if (value->type != UP_TYPE_LIST) {
+                    break;
+                }
+                // Negated as size_t: -LONG_MIN does not fit in a long
+                size_t back = 0 - (size_t)step->start;
+                if (step->start < 0 ? back <= value->as.list.count
+                                    : (size_t)step->start < value->as.list.count) {
+                    position = step->start < 0 ? value->as.list.count - back : (size_t)step->start;
+                    if (!frontier_push(next, next_count, next_capacity, value->as.list.items[position])) {
+                        return false;
+                    }
+                }
+                break;
+            }
+            case OP_SLICE: {
+                if (value->type != UP_TYPE_LIST) {
+                    break;
+                }
+                size_t count = value->as.list.count;
+                size_t start = step->has_start ? resolve_bound(step->start, count) : 0;
+                size_t end = step->has_end ? resolve_bound(step->end, count) : count;
+                for (size_t j = start; j < end; j++) {
+                    if (!frontier_push(next, next_count, next_capacity, value->as.list.items[j])) {
+                        return false;
+                    }
+                }
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// Run a compiled query over a document. `result` is cleared first and can
+// be reused across runs to avoid reallocating; its items are borrowed.
+bool up_query_run(const up_query_t *query, up_document_t *doc, up_query_result_t *result) {
+    if (!query || !doc || !result) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return false;
+    }
+    result->count = 0;
+
+    const up_query_step_t *root = &query->steps[0];
+    if (root->op == OP_ROOT_ALL) {
+        for (size_t i = 0; i < doc->count; i++) {
+            if (!frontier_push(&result->items, &result->count, &result->capacity, doc->nodes[i]->value)) {
+                up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+                return false;
+            }
+        }
+    } else {
+        size_t position = up_document_find(doc, root->key, root->hash);
+        if (position < doc->count &&
+            !frontier_push(&result->items, &result->count, &result->capacity, doc->nodes[position]->value)) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            return false;
+        }
+    }
+
+    for (size_t i = 1; i < query->count && result->count; i++) {
+        size_t next_count = 0;
+        if (!apply_step(&query->steps[i], result->items, result->count,
+                        &result->scratch, &next_count, &result->scratch_capacity)) {
+            up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+            result->count = 0;
+            return false;
+        }
+
+        up_value_t **swap_items = result->items;
+        size_t swap_capacity = result->capacity;
+        result->items = result->scratch;
+        result->capacity = result->scratch_capacity;
+        result->count = next_count;
+        result->scratch = swap_items;
+        result->scratch_capacity = swap_capacity;
+    }
+
+    return true;
+}
+
+void up_query_result_free(up_query_result_t *result) {
+    if (!result) {
+        return;
+    }
+
+    free(result->items);
+    free(result->scratch);
+    memset(result, 0, sizeof(*result));
+}
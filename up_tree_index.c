@@ -0,0 +1,425 @@
+/**
+ * Whole-tree indexes over full key paths
+ *
+ * Both indexes come from one pass that records values with the path that
+ * reaches them ("services.web.host", "upstreams[3].host"):
+ *
+ * - The reverse value index holds every string scalar, sorted by value
+ *   hash and text, so all paths for one value sit next to each other.
+ * - The path index holds every value, sorted by path with the separators
+ *   '.' and '[' ordered before every other byte, so a path and everything
+ *   under it form one contiguous run ("a", "a.b", "a[0]", then "a-b").
+ *
+ * Lookups are binary searches. The indexes point into the document, so
+ * they are only built for frozen documents, whose values cannot move.
+ * Frozen documents are shared between threads, so a finished index is
+ * published with a compare-and-swap where the compiler has one: callers
+ * racing to build it keep the first index stored and free their own.
+ */
+
+#include "up.h"
+#include "up_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define INDEX_LOAD(slot) __atomic_load_n((slot), __ATOMIC_ACQUIRE)
+#define INDEX_PUBLISH(slot, expected, index) \
+    __atomic_compare_exchange_n((slot), (expected), (index), false, __ATOMIC_ACQ_REL, \
+                                __ATOMIC_ACQUIRE)
+#else
+#define INDEX_LOAD(slot) (*(slot))
+#define INDEX_PUBLISH(slot, expected, index) ((void)(expected), *(slot) = (index), true)
+#endif
+
+typedef struct {
+    uint64_t hash;
+    const up_value_t *value;
+    size_t path_offset;
+} up_value_entry_t;
+
+struct up_path_index {
+    const char **paths;     // Sorted with strcmp
+    const up_value_t **values;
+    char *path_data;
+    size_t path_bytes;
+    size_t count;
+};
+
+struct up_value_index {
+    uint64_t *hashes;
+    const up_value_t **values;
+    const char **paths;     // Sorted alongside hashes and values
+    char *path_data;        // Every path, NUL-terminated, back to back
+    size_t path_bytes;
+    size_t count;
+};
+
+typedef struct {
+    up_value_entry_t *entries;
+    size_t count;
+    size_t capacity;
+    char *data;             // Finished paths
+    size_t data_length;
+    size_t data_capacity;
+    char *path;             // Path of the value being visited
+    size_t path_length;
+    size_t path_capacity;
+    bool all_values;        // Record containers too, not just strings
+} up_value_builder_t;
+
+static bool reserve_bytes(char **buffer, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return true;
+    }
+    size_t grown_capacity = *capacity ? *capacity * 2 : 256;
+    while (grown_capacity < needed) {
+        grown_capacity *= 2;
+    }
+    char *grown = realloc(*buffer, grown_capacity);
+    if (!grown) {
+        return false;
+    }
+    *buffer = grown;
+    *capacity = grown_capacity;
+    return true;
+}
+
+// Extend the current path by ".key" (or "key" at the root) or "[index]"
+static bool push_path(up_value_builder_t *b, const char *key, size_t index) {
+    char brackets[32];
+    const char *part = key;
+    size_t length;
+    if (key) {
+        length = strlen(key) + (b->path_length ? 1 : 0);
+    } else {
+        length = (size_t)snprintf(brackets, sizeof(brackets), "[%zu]", index);
+        part = brackets;
+    }
+    if (!reserve_bytes(&b->path, &b->path_capacity, b->path_length + length + 1)) {
+        return false;
+    }
+    if (key && b->path_length) {
+        b->path[b->path_length++] = '.';
+        length--;
+    }
+    memcpy(b->path + b->path_length, part, length);
+    b->path_length += length;
+    b->path[b->path_length] = '\0';
+    return true;
+}
+
+static bool add_entry(up_value_builder_t *b, const up_value_t *value) {
+    if (b->count == b->capacity) {
+        size_t capacity = b->capacity ? b->capacity * 2 : 64;
+        up_value_entry_t *entries = realloc(b->entries, capacity * sizeof(*entries));
+        if (!entries) {
+            return false;
+        }
+        b->entries = entries;
+        b->capacity = capacity;
+    }
+    if (!reserve_bytes(&b->data, &b->data_capacity, b->data_length + b->path_length + 1)) {
+        return false;
+    }
+
+    up_value_entry_t *entry = &b->entries[b->count++];
+    entry->hash = value->type == UP_TYPE_STRING ? up_hash_string(value->as.string.data) : 0;
+    entry->value = value;
+    entry->path_offset = b->data_length;
+    memcpy(b->data + b->data_length, b->path, b->path_length + 1);
+    b->data_length += b->path_length + 1;
+    return true;
+}
+
+static bool collect(up_value_builder_t *b, const up_value_t *value) {
+    size_t mark = b->path_length;
+    bool ok = value->type == UP_TYPE_STRING || !b->all_values || add_entry(b, value);
+
+    switch (value->type) {
+        case UP_TYPE_STRING:
+            return add_entry(b, value);
+        case UP_TYPE_BLOCK:
+            for (size_t i = 0; ok && i < value->as.block.count; i++) {
+                ok = push_path(b, value->as.block.keys[i], 0) && collect(b, value->as.block.values[i]);
+                b->path_length = mark;
+            }
+            break;
+        case UP_TYPE_LIST:
+            for (size_t i = 0; ok && i < value->as.list.count; i++) {
+                ok = push_path(b, NULL, i) && collect(b, value->as.list.items[i]);
+                b->path_length = mark;
+            }
+            break;
+    }
+    return ok;
+}
+
+static void builder_free(up_value_builder_t *b) {
+    free(b->entries);
+    free(b->data);
+    free(b->path);
+}
+
+// Collect entries for every top-level node of `doc`
+static bool builder_run(up_value_builder_t *b, const up_document_t *doc) {
+    bool ok = true;
+    for (size_t i = 0; ok && i < doc->count; i++) {
+        b->path_length = 0;
+        ok = push_path(b, doc->nodes[i]->key, 0) && collect(b, doc->nodes[i]->value);
+    }
+    return ok;
+}
+
+static bool require_frozen(const up_document_t *doc) {
+    if (!doc) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return false;
+    }
+    if (!doc->frozen) {
+        up_set_error(UP_ERROR_ARGUMENT, "Tree indexes require a frozen document");
+        return false;
+    }
+    return true;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const up_value_entry_t *x = a, *y = b;
+    if (x->hash != y->hash) {
+        return x->hash < y->hash ? -1 : 1;
+    }
+    int order = strcmp(x->value->as.string.data, y->value->as.string.data);
+    if (order) {
+        return order;
+    }
+    return x->path_offset < y->path_offset ? -1 : x->path_offset > y->path_offset;
+}
+
+void up_value_index_free(up_value_index_t *index) {
+    if (!index) {
+        return;
+    }
+    free(index->hashes);
+    free((void *)index->values);
+    free((void *)index->paths);
+    free(index->path_data);
+    free(index);
+}
+
+size_t up_value_index_bytes(const up_value_index_t *index) {
+    if (!index) {
+        return 0;
+    }
+    return sizeof(*index) + index->path_bytes +
+           index->count * (sizeof(*index->hashes) + sizeof(*index->values) + sizeof(*index->paths));
+}
+
+// Build the reverse index of a frozen document in one pass over the tree
+bool up_document_index_values(up_document_t *doc) {
+    if (!require_frozen(doc)) {
+        return false;
+    }
+    if (INDEX_LOAD(&doc->value_index)) {
+        return true;
+    }
+
+    up_value_builder_t b = {0};
+    bool ok = builder_run(&b, doc);
+
+    up_value_index_t *index = ok ? calloc(1, sizeof(*index)) : NULL;
+    if (index && b.count) {
+        index->hashes = malloc(b.count * sizeof(*index->hashes));
+        index->values = malloc(b.count * sizeof(*index->values));
+        index->paths = malloc(b.count * sizeof(*index->paths));
+        if (!index->hashes || !index->values || !index->paths) {
+            up_value_index_free(index);
+            index = NULL;
+        }
+    }
+    if (!index) {
+        builder_free(&b);
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return false;
+    }
+
+    qsort(b.entries, b.count, sizeof(*b.entries), compare_entries);
+    for (size_t i = 0; i < b.count; i++) {
+        index->hashes[i] = b.entries[i].hash;
+        index->values[i] = b.entries[i].value;
+        index->paths[i] = b.data + b.entries[i].path_offset;
+    }
+    index->count = b.count;
+    index->path_data = b.data;
+    index->path_bytes = b.data_capacity;
+
+    free(b.entries);
+    free(b.path);
+    up_value_index_t *expected = NULL;
+    if (!INDEX_PUBLISH(&doc->value_index, &expected, index)) {
+        up_value_index_free(index);
+    }
+    return true;
+}
+
+// Paths of every string scalar equal to `value`. *paths points into the
+// index and stays valid until the document is freed. Returns the count.
+size_t up_document_find_value(const up_document_t *doc, const char *value, const char *const **paths) {
+    const up_value_index_t *index = doc ? INDEX_LOAD(&doc->value_index) : NULL;
+    if (!index || !value || !paths) {
+        return 0;
+    }
+
+    uint64_t hash = up_hash_string(value);
+    size_t low = 0, high = index->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (index->hashes[mid] < hash ||
+            (index->hashes[mid] == hash && strcmp(index->values[mid]->as.string.data, value) < 0)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    size_t end = low;
+    while (end < index->count && index->hashes[end] == hash &&
+           strcmp(index->values[end]->as.string.data, value) == 0) {
+        end++;
+    }
+
+    *paths = index->paths + low;
+    return end - low;
+}
+
+/* ---- Path prefix index ---- */
+
+typedef struct {
+    const char *path;
+    const up_value_t *value;
+} up_path_entry_t;
+
+// Byte rank in path order: end of string, then the separators, then the
+// rest bytewise
+static int path_rank(unsigned char c) {
+    return c == '\0' ? 0 : c == '.' ? 1 : c == '[' ? 2 : c + 3;
+}
+
+static int path_compare(const char *a, const char *b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return path_rank((unsigned char)*a) - path_rank((unsigned char)*b);
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return path_compare(((const up_path_entry_t *)a)->path, ((const up_path_entry_t *)b)->path);
+}
+
+void up_path_index_free(up_path_index_t *index) {
+    if (!index) {
+        return;
+    }
+    free((void *)index->paths);
+    free((void *)index->values);
+    free(index->path_data);
+    free(index);
+}
+
+size_t up_path_index_bytes(const up_path_index_t *index) {
+    if (!index) {
+        return 0;
+    }
+    return sizeof(*index) + index->path_bytes +
+           index->count * (sizeof(*index->paths) + sizeof(*index->values));
+}
+
+// Build the path index of a frozen document in one pass over the tree
+bool up_document_index_paths(up_document_t *doc) {
+    if (!require_frozen(doc)) {
+        return false;
+    }
+    if (INDEX_LOAD(&doc->path_index)) {
+        return true;
+    }
+
+    up_value_builder_t b = {0};
+    b.all_values = true;
+    bool ok = builder_run(&b, doc);
+
+    up_path_index_t *index = ok ? calloc(1, sizeof(*index)) : NULL;
+    up_path_entry_t *sorted = index && b.count ? malloc(b.count * sizeof(*sorted)) : NULL;
+    if (index && b.count) {
+        index->paths = malloc(b.count * sizeof(*index->paths));
+        index->values = malloc(b.count * sizeof(*index->values));
+    }
+    if (!index || (b.count && (!sorted || !index->paths || !index->values))) {
+        free(sorted);
+        up_path_index_free(index);
+        builder_free(&b);
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return false;
+    }
+
+    for (size_t i = 0; i < b.count; i++) {
+        sorted[i].path = b.data + b.entries[i].path_offset;
+        sorted[i].value = b.entries[i].value;
+    }
+    qsort(sorted, b.count, sizeof(*sorted), compare_paths);
+    for (size_t i = 0; i < b.count; i++) {
+        index->paths[i] = sorted[i].path;
+        index->values[i] = sorted[i].value;
+    }
+    index->count = b.count;
+    index->path_data = b.data;
+    index->path_bytes = b.data_capacity;
+
+    free(sorted);
+    free(b.entries);
+    free(b.path);
+    up_path_index_t *expected = NULL;
+    if (!INDEX_PUBLISH(&doc->path_index, &expected, index)) {
+        up_path_index_free(index);
+    }
+    return true;
+}
+
+// The indexed path `prefix` and every path under it ("server.tls" gives
+// server.tls, server.tls.cert and server.tls[0], not server.tlsx), in
+// index order, with the value at each. A prefix that already ends in '.'
+// or '[' (or is empty) matches whatever follows. Both arrays point into
+// the index. Returns the count.
+size_t up_document_find_prefix(const up_document_t *doc, const char *prefix,
+                               const char *const **paths, const up_value_t *const **values) {
+    const up_path_index_t *index = doc ? INDEX_LOAD(&doc->path_index) : NULL;
+    if (!index || !prefix || !paths) {
+        return 0;
+    }
+
+    size_t low = 0, high = index->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (path_compare(index->paths[mid], prefix) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    // Paths continuing the last key ("server.tlsx") sort after the whole
+    // run, so the scan stops at the first of them
+    size_t length = strlen(prefix);
+    bool open = length == 0 || prefix[length - 1] == '.' || prefix[length - 1] == '[';
+    size_t end = low;
+    while (end < index->count && strncmp(index->paths[end], prefix, length) == 0 &&
+           (open || path_rank((unsigned char)index->paths[end][length]) <= path_rank('['))) {
+        end++;
+    }
+
+    *paths = index->paths + low;
+    if (values) {
+        *values = index->values + low;
+    }
+    return end - low;
+}
@@ -0,0 +1,669 @@
+/**
+ * Canonical UP writer
+ *
+ * Output goes through a fixed buffer (up_out_t) that reaches the sink a
+ * buffer at a time, so writing costs a memcpy per token rather than a
+ * formatted call per value. The layout follows what the parser reads
+ * back: each string is checked once to pick between the plain form and a
+ * fenced multiline block, and lists are written inline, as table rows or
+ * one item per line depending on what their items allow.
+ *
+ * up_writer_t applies the same rules to values handed over one call at a
+ * time, for output too large to build as a document first. It only keeps
+ * a stack of open containers, so memory stays flat however much it
+ * writes; lists it streams always take the one-item-per-line form.
+ */
+
+#include "up.h"
+#include "up_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---- Buffered output ---- */
+
+void up_out_init(up_out_t *out, up_sink_t sink) {
+    out->sink = sink;
+    out->length = 0;
+    out->failed = false;
+}
+
+bool up_out_flush(up_out_t *out) {
+    if (!out->failed && out->length &&
+        !out->sink.write(out->sink.context, out->data, out->length)) {
+        up_set_error(UP_ERROR_IO, "Write failed");
+        out->failed = true;
+    }
+    out->length = 0;
+    return !out->failed;
+}
+
+// Large chunks skip the buffer once it has been flushed
+void up_out_write(up_out_t *out, const char *data, size_t length) {
+    if (length > UP_OUT_BUFFER - out->length) {
+        if (!up_out_flush(out)) {
+            return;
+        }
+        if (length >= UP_OUT_BUFFER) {
+            if (!out->sink.write(out->sink.context, data, length)) {
+                up_set_error(UP_ERROR_IO, "Write failed");
+                out->failed = true;
+            }
+            return;
+        }
+    }
+    memcpy(out->data + out->length, data, length);
+    out->length += length;
+}
+
+static void out_str(up_out_t *out, const char *str) {
+    up_out_write(out, str, strlen(str));
+}
+
+bool up_sink_file(void *context, const char *data, size_t length) {
+    return fwrite(data, 1, length, (FILE *)context) == length;
+}
+
+/* ---- Layout decisions ---- */
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static bool is_key_start(char c) {
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+}
+
+static bool is_key_char(char c) {
+    return is_key_start(c) || (c >= '0' && c <= '9') || c == '-';
+}
+
+// Keys and type annotations share the same syntax
+static bool is_name(const char *name, bool allow_digit_start) {
+    if (!*name || !(is_key_start(*name) || (allow_digit_start && is_key_char(*name)))) {
+        return false;
+    }
+    while (*++name) {
+        if (!is_key_char(*name)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A string can follow its key on the same line when the parser would read
+// exactly these bytes back: one line, no surrounding whitespace, and no
+// text the parser takes for the start of a block, list or fence.
+static bool fits_plain(const up_string_t *string) {
+    const char *data = string->data;
+    size_t length = string->length;
+    if (length == 0) {
+        return true;
+    }
+    if (is_space(data[0]) || is_space(data[length - 1])) {
+        return false;
+    }
+    if (length == 1 && (data[0] == '{' || data[0] == '[')) {
+        return false;
+    }
+    if (length >= 2 && data[0] == '[' && data[length - 1] == ']') {
+        return false;
+    }
+    if (length >= 3 && memcmp(data, "```", 3) == 0) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] == '\n' || data[i] == '\r' || data[i] == '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// List items sit on a line of their own, where blank lines, comments and
+// a lone "]" mean something else
+static bool fits_item(const up_string_t *string) {
+    return string->length && string->data[0] != '#' &&
+           !(string->length == 1 && string->data[0] == ']') && fits_plain(string);
+}
+
+// Items of an inline list or table row are split on commas and brackets
+static bool fits_cell(const up_string_t *string) {
+    if (!string->length || !fits_plain(string)) {
+        return false;
+    }
+    for (size_t i = 0; i < string->length; i++) {
+        if (string->data[i] == ',' || string->data[i] == '[' || string->data[i] == ']') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool fits_inline(const up_value_t *value) {
+    if (value->type == UP_TYPE_LIST) {
+        for (size_t i = 0; i < value->as.list.count; i++) {
+            if (!fits_inline(value->as.list.items[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return value->type == UP_TYPE_STRING && fits_cell(&value->as.string);
+}
+
+// A non-empty list whose items are all inline lists is written as a table
+static bool fits_table(const up_list_t *list) {
+    if (!list->count) {
+        return false;
+    }
+    for (size_t i = 0; i < list->count; i++) {
+        if (list->items[i]->type != UP_TYPE_LIST || !fits_inline(list->items[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Multiline content is read back line by line up to the closing fence,
+// and always ends in a newline. Text that would contain a fence line or
+// lose bytes on the way back cannot be written.
+static bool fits_multiline(const up_string_t *string) {
+    const char *data = string->data;
+    const char *end = data + string->length;
+    for (const char *line = data; line < end;) {
+        const char *newline = memchr(line, '\n', (size_t)(end - line));
+        const char *stop = newline ? newline : end;
+        if (memchr(line, '\0', (size_t)(stop - line)) ||
+            (stop > line && stop[-1] == '\r')) {
+            return false;
+        }
+        const char *text = line;
+        while (text < stop && is_space(*text)) {
+            text++;
+        }
+        if (stop - text >= 3 && memcmp(text, "```", 3) == 0) {
+            const char *rest = text + 3;
+            while (rest < stop && is_space(*rest)) {
+                rest++;
+            }
+            if (rest == stop) {
+                return false;
+            }
+        }
+        line = stop + 1;
+    }
+    return true;
+}
+
+// A value written through a fence reads back with its final newline, so
+// only text that already ends in one survives the trip unchanged
+static bool fits_fence(const up_string_t *string) {
+    return string->length && string->data[string->length - 1] == '\n' && fits_multiline(string);
+}
+
+/* ---- Emitters ---- */
+
+static void write_indent(up_out_t *out, size_t depth) {
+    static const char spaces[] = "                                ";
+    size_t width = depth * 2;
+    while (width) {
+        size_t chunk = width < sizeof(spaces) - 1 ? width : sizeof(spaces) - 1;
+        up_out_write(out, spaces, chunk);
+        width -= chunk;
+    }
+}
+
+static bool write_value(up_out_t *out, const up_value_t *value, size_t depth, bool item);
+
+static bool write_multiline(up_out_t *out, const up_string_t *string, size_t depth) {
+    if (!fits_multiline(string)) {
+        up_set_error(UP_ERROR_FORMAT, "String cannot be written as UP text");
+        return false;
+    }
+    up_out_write(out, "```\n", 4);
+    up_out_write(out, string->data, string->length);
+    if (string->length && string->data[string->length - 1] != '\n') {
+        up_out_char(out, '\n');
+    }
+    write_indent(out, depth);
+    up_out_write(out, "```\n", 4);
+    return true;
+}
+
+static void write_inline(up_out_t *out, const up_value_t *value) {
+    if (value->type == UP_TYPE_STRING) {
+        up_out_write(out, value->as.string.data, value->as.string.length);
+        return;
+    }
+    up_out_char(out, '[');
+    for (size_t i = 0; i < value->as.list.count; i++) {
+        if (i) {
+            up_out_write(out, ", ", 2);
+        }
+        write_inline(out, value->as.list.items[i]);
+    }
+    up_out_char(out, ']');
+}
+
+static bool write_entry(up_out_t *out, const char *key, const char *type,
+                        const up_value_t *value, size_t depth) {
+    if (!key || !is_name(key, false) || (type && !is_name(type, true)) || !value) {
+        up_set_error(UP_ERROR_FORMAT, "Cannot write key '%s'", key ? key : "(null)");
+        return false;
+    }
+
+    write_indent(out, depth);
+    out_str(out, key);
+    if (type) {
+        up_out_char(out, '!');
+        out_str(out, type);
+    }
+    if (value->type == UP_TYPE_STRING && value->as.string.length == 0) {
+        up_out_char(out, '\n');
+        return true;
+    }
+    up_out_char(out, ' ');
+    return write_value(out, value, depth, false);
+}
+
+static bool write_block(up_out_t *out, const up_block_t *block, size_t depth) {
+    up_out_write(out, "{\n", 2);
+    for (size_t i = 0; i < block->count; i++) {
+        const char *type = block->types ? block->types[i] : NULL;
+        if (!write_entry(out, block->keys[i], type, block->values[i], depth + 1)) {
+            return false;
+        }
+    }
+    write_indent(out, depth);
+    up_out_write(out, "}\n", 2);
+    return true;
+}
+
+static bool write_list(up_out_t *out, const up_value_t *value, size_t depth) {
+    const up_list_t *list = &value->as.list;
+    bool table = fits_table(list);
+
+    if (!table && fits_inline(value)) {
+        write_inline(out, value);
+        up_out_char(out, '\n');
+        return true;
+    }
+
+    up_out_write(out, table ? "{\n" : "[\n", 2);
+    for (size_t i = 0; i < list->count; i++) {
+        write_indent(out, depth + 1);
+        if (table) {
+            write_inline(out, list->items[i]);
+            up_out_char(out, '\n');
+        } else if (!write_value(out, list->items[i], depth + 1, true)) {
+            return false;
+        }
+    }
+    write_indent(out, depth);
+    up_out_write(out, table ? "}\n" : "]\n", 2);
+    return true;
+}
+
+// Write the text following a key or list item indentation, through the
+// end of the value's last line
+static bool write_value(up_out_t *out, const up_value_t *value, size_t depth, bool item) {
+    switch (value->type) {
+        case UP_TYPE_STRING:
+            if (item ? fits_item(&value->as.string) : fits_plain(&value->as.string)) {
+                up_out_write(out, value->as.string.data, value->as.string.length);
+                up_out_char(out, '\n');
+                return true;
+            }
+            if (!fits_fence(&value->as.string)) {
+                up_set_error(UP_ERROR_FORMAT, "String cannot be written as UP text");
+                return false;
+            }
+            return write_multiline(out, &value->as.string, depth);
+        case UP_TYPE_BLOCK:
+            return write_block(out, &value->as.block, depth);
+        case UP_TYPE_LIST:
+            return write_list(out, value, depth);
+    }
+    up_set_error(UP_ERROR_ARGUMENT, "Unknown value type");
+    return false;
+}
+
+bool up_document_write(const up_document_t *doc, up_sink_t sink) {
+    if (!doc || !sink.write) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return false;
+    }
+
+    up_out_t *out = malloc(sizeof(*out));
+    if (!out) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return false;
+    }
+    up_out_init(out, sink);
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < doc->count; i++) {
+        const up_node_t *node = doc->nodes[i];
+        ok = write_entry(out, node->key, node->type_annotation, node->value, 0);
+    }
+    ok = up_out_flush(out) && ok;
+    free(out);
+    return ok;
+}
+
+/* ---- String output ---- */
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} string_sink_t;
+
+static bool string_sink_write(void *context, const char *data, size_t length) {
+    string_sink_t *string = context;
+    if (length >= string->capacity - string->length) {
+        size_t capacity = string->capacity ? string->capacity : UP_OUT_BUFFER;
+        while (length >= capacity - string->length) {
+            capacity *= 2;
+        }
+        char *grown = realloc(string->data, capacity);
+        if (!grown) {
+            return false;
+        }
+        string->data = grown;
+        string->capacity = capacity;
+    }
+    memcpy(string->data + string->length, data, length);
+    string->length += length;
+    return true;
+}
+
+char *up_document_to_string(const up_document_t *doc, size_t *length) {
+    string_sink_t string = {NULL, 0, 0};
+    up_sink_t sink = {string_sink_write, &string};
+
+    // The extra byte keeps room for the terminator even for empty output
+    if (!string_sink_write(&string, "", 0)) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        return NULL;
+    }
+    if (!up_document_write(doc, sink)) {
+        free(string.data);
+        return NULL;
+    }
+    string.data[string.length] = '\0';
+    if (length) {
+        *length = string.length;
+    }
+    return string.data;
+}
+
+/* ---- Streaming writer ---- */
+
+typedef enum {
+    FRAME_DOCUMENT,
+    FRAME_BLOCK,
+    FRAME_LIST,
+    FRAME_TABLE,
+    FRAME_TABLE_EMPTY       // Table with no rows yet; nothing written
+} writer_frame_t;
+
+struct up_writer {
+    up_out_t out;
+    uint8_t *frames;        // Open containers; frames[depth] is innermost
+    size_t depth;
+    size_t capacity;
+    bool keyed;             // A key was written and waits for its value
+    bool failed;
+};
+
+up_writer_t *up_writer_new(up_sink_t sink) {
+    if (!sink.write) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return NULL;
+    }
+
+    up_writer_t *writer = malloc(sizeof(*writer));
+    uint8_t *frames = malloc(16);
+    if (!writer || !frames) {
+        up_set_error(UP_ERROR_MEMORY, "Memory allocation failed");
+        free(writer);
+        free(frames);
+        return NULL;
+    }
+    up_out_init(&writer->out, sink);
+    writer->frames = frames;
+    writer->frames[0] = FRAME_DOCUMENT;
+    writer->depth = 0;
+    writer->capacity = 16;
+    writer->keyed = false;
+    writer->failed = false;
+    return writer;
+}
+
+// Once a call fails the writer stays failed, so callers may check only
+// the result of up_writer_close. A NULL message keeps the error already
+// set by the failing helper.
+static bool writer_fail(up_writer_t *writer, up_error_code_t code, const char *message) {
+    if (message) {
+        up_set_error(code, "%s", message);
+    }
+    writer->failed = true;
+    return false;
+}
+
+static bool writer_ok(up_writer_t *writer) {
+    if (!writer) {
+        up_set_error(UP_ERROR_ARGUMENT, "Invalid argument");
+        return false;
+    }
+    if (writer->out.failed) {
+        writer->failed = true;
+    }
+    return !writer->failed;
+}
+
+static bool writer_push(up_writer_t *writer, writer_frame_t frame) {
+    if (writer->depth + 1 == writer->capacity) {
+        uint8_t *frames = realloc(writer->frames, writer->capacity * 2);
+        if (!frames) {
+            return writer_fail(writer, UP_ERROR_MEMORY, "Memory allocation failed");
+        }
+        writer->frames = frames;
+        writer->capacity *= 2;
+    }
+    writer->frames[++writer->depth] = (uint8_t)frame;
+    return true;
+}
+
+// Start a value: after its key in a block, or on a line of its own in a
+// list. `empty` values (empty strings) end the key line right away.
+static bool writer_begin_value(up_writer_t *writer, bool empty) {
+    switch (writer->frames[writer->depth]) {
+        case FRAME_DOCUMENT:
+        case FRAME_BLOCK:
+            if (!writer->keyed) {
+                return writer_fail(writer, UP_ERROR_ARGUMENT, "Value written without a key");
+            }
+            writer->keyed = false;
+            up_out_char(&writer->out, empty ? '\n' : ' ');
+            return true;
+        case FRAME_LIST:
+            write_indent(&writer->out, writer->depth);
+            return true;
+        default:
+            return writer_fail(writer, UP_ERROR_ARGUMENT, "Tables only take rows");
+    }
+}
+
+bool up_writer_key(up_writer_t *writer, const char *key, const char *type) {
+    if (!writer_ok(writer)) {
+        return false;
+    }
+    writer_frame_t frame = writer->frames[writer->depth];
+    if ((frame != FRAME_DOCUMENT && frame != FRAME_BLOCK) || writer->keyed) {
+        return writer_fail(writer, UP_ERROR_ARGUMENT, "Key written where a value was expected");
+    }
+    if (!key || !is_name(key, false) || (type && !is_name(type, true))) {
+        up_set_error(UP_ERROR_FORMAT, "Cannot write key '%s'", key ? key : "(null)");
+        return writer_fail(writer, UP_OK, NULL);
+    }
+
+    write_indent(&writer->out, writer->depth);
+    out_str(&writer->out, key);
+    if (type) {
+        up_out_char(&writer->out, '!');
+        out_str(&writer->out, type);
+    }
+    writer->keyed = true;
+    return true;
+}
+
+// Strings that cannot stay on one line fall back to the fenced form, as
+// in up_document_write: only text ending in a newline reads back unchanged
+// from a fence, so anything else fails before a byte is written
+bool up_writer_scalar(up_writer_t *writer, const char *value) {
+    if (!writer_ok(writer) || !value) {
+        return value ? false : writer_fail(writer, UP_ERROR_ARGUMENT, "Invalid argument");
+    }
+    up_string_t string = {(char *)value, strlen(value)};
+    bool item = writer->frames[writer->depth] == FRAME_LIST;
+    bool empty = !item && string.length == 0;
+    bool plain = empty || (item ? fits_item(&string) : fits_plain(&string));
+    if (!plain && !fits_fence(&string)) {
+        return writer_fail(writer, UP_ERROR_FORMAT, "String cannot be written as UP text");
+    }
+
+    if (!writer_begin_value(writer, empty)) {
+        return false;
+    }
+    if (empty) {
+        return true;
+    }
+    if (plain) {
+        up_out_write(&writer->out, string.data, string.length);
+        up_out_char(&writer->out, '\n');
+        return true;
+    }
+    return write_multiline(&writer->out, &string, writer->depth) || writer_fail(writer, UP_OK, NULL);
+}
+
+bool up_writer_multiline(up_writer_t *writer, const char *text) {
+    if (!writer_ok(writer) || !text) {
+        return text ? false : writer_fail(writer, UP_ERROR_ARGUMENT, "Invalid argument");
+    }
+    up_string_t string = {(char *)text, strlen(text)};
+    if (!fits_multiline(&string)) {
+        return writer_fail(writer, UP_ERROR_FORMAT, "String cannot be written as UP text");
+    }
+    return writer_begin_value(writer, false) &&
+           (write_multiline(&writer->out, &string, writer->depth) || writer_fail(writer, UP_OK, NULL));
+}
+
+bool up_writer_begin_block(up_writer_t *writer) {
+    if (!writer_ok(writer) || !writer_begin_value(writer, false)) {
+        return false;
+    }
+    up_out_write(&writer->out, "{\n", 2);
+    return writer_push(writer, FRAME_BLOCK);
+}
+
+bool up_writer_begin_list(up_writer_t *writer) {
+    if (!writer_ok(writer) || !writer_begin_value(writer, false)) {
+        return false;
+    }
+    up_out_write(&writer->out, "[\n", 2);
+    return writer_push(writer, FRAME_LIST);
+}
+
+// The opening brace waits for the first row: a table without rows is
+// written as an empty list, since "{ }" would read back as a block
+bool up_writer_begin_table(up_writer_t *writer) {
+    if (!writer_ok(writer) || !writer_begin_value(writer, false)) {
+        return false;
+    }
+    return writer_push(writer, FRAME_TABLE_EMPTY);
+}
+
+bool up_writer_table_row(up_writer_t *writer, const char *const *cells, size_t count) {
+    if (!writer_ok(writer)) {
+        return false;
+    }
+    writer_frame_t frame = writer->frames[writer->depth];
+    if (frame != FRAME_TABLE && frame != FRAME_TABLE_EMPTY) {
+        return writer_fail(writer, UP_ERROR_ARGUMENT, "Table row written outside a table");
+    }
+    for (size_t i = 0; i < count; i++) {
+        up_string_t cell = {(char *)cells[i], cells[i] ? strlen(cells[i]) : 0};
+        if (!cells[i] || !fits_cell(&cell)) {
+            return writer_fail(writer, UP_ERROR_FORMAT, "Table cell cannot be written as UP text");
+        }
+    }
+
+    if (frame == FRAME_TABLE_EMPTY) {
+        up_out_write(&writer->out, "{\n", 2);
+        writer->frames[writer->depth] = FRAME_TABLE;
+    }
+    write_indent(&writer->out, writer->depth);
+    up_out_char(&writer->out, '[');
+    for (size_t i = 0; i < count; i++) {
+        if (i) {
+            up_out_write(&writer->out, ", ", 2);
+        }
+        out_str(&writer->out, cells[i]);
+    }
+    up_out_write(&writer->out, "]\n", 2);
+    return true;
+}
+
+static bool writer_end(up_writer_t *writer, writer_frame_t frame, const char *close) {
+    if (!writer_ok(writer)) {
+        return false;
+    }
+    writer_frame_t open = writer->frames[writer->depth];
+    if (writer->depth == 0 || writer->keyed ||
+        (open != frame && !(frame == FRAME_TABLE && open == FRAME_TABLE_EMPTY))) {
+        return writer_fail(writer, UP_ERROR_ARGUMENT, "Mismatched end of block, list or table");
+    }
+    writer->depth--;
+    if (open == FRAME_TABLE_EMPTY) {
+        up_out_write(&writer->out, "[]\n", 3);
+        return true;
+    }
+    write_indent(&writer->out, writer->depth);
+    out_str(&writer->out, close);
+    return true;
+}
+
+bool up_writer_end_block(up_writer_t *writer) {
+    return writer_end(writer, FRAME_BLOCK, "}\n");
+}
+
+bool up_writer_end_list(up_writer_t *writer) {
+    return writer_end(writer, FRAME_LIST, "]\n");
+}
+
+bool up_writer_end_table(up_writer_t *writer) {
+    return writer_end(writer, FRAME_TABLE, "}\n");
+}
+
+bool up_writer_flush(up_writer_t *writer) {
+    return writer_ok(writer) && (up_out_flush(&writer->out) || writer_fail(writer, UP_OK, NULL));
+}
+
+// Flush and free the writer. Fails if any call failed or a block, list,
+// table or key was left open.
+bool up_writer_close(up_writer_t *writer) {
+    if (!writer) {
+        return false;
+    }
+    bool ok = writer_ok(writer);
+    if (ok && (writer->depth || writer->keyed)) {
+        ok = writer_fail(writer, UP_ERROR_ARGUMENT, "Writer closed with an unfinished value");
+    }
+    ok = up_out_flush(&writer->out) && ok;
+    free(writer->frames);
+    free(writer);
+    return ok;
+}